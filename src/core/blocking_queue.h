@@ -0,0 +1,100 @@
+#ifndef SUPERPIXELS_SRC_CORE_BLOCKING_QUEUE_H_
+#define SUPERPIXELS_SRC_CORE_BLOCKING_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace Util
+{
+	namespace Concurrency
+	{
+		/**
+		 * Thread-safe FIFO queue shared between producer and consumer threads.
+		 *
+		 * When a capacity is given, push() blocks while the queue is full so that
+		 * fast producers are throttled by slow consumers. Once the queue is
+		 * closed, push() fails and pop() drains whatever is left.
+		 */
+		template <typename T>
+		class BlockingQueue
+		{
+
+			private:
+				std::deque<T> _queue;
+				size_t _capacity;
+				bool _closed = false;
+
+				std::mutex _mutex;
+				std::condition_variable _not_empty;
+				std::condition_variable _not_full;
+
+			public:
+				/**
+				 * @param capacity 				Maximum number of queued items (0 for unbounded)
+				 */
+				explicit BlockingQueue(const size_t capacity = 0) : _capacity(capacity) {}
+
+				/**
+				 * Add an item, waiting for space if the queue is full
+				 *
+				 * @param item 					Item to enqueue
+				 *
+				 * @return True if the item was queued, False if the queue was closed
+				 */
+				bool push(T item)
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_not_full.wait(lock, [this]{ return _closed || _capacity == 0 || _queue.size() < _capacity; });
+					if (_closed) { return false; }
+					_queue.push_back(std::move(item));
+					lock.unlock();
+					_not_empty.notify_one();
+					return true;
+				}
+
+				/**
+				 * Remove the oldest item, waiting until one is available
+				 *
+				 * @param item 					Holds the dequeued item
+				 *
+				 * @return True if an item was dequeued, False if the queue is closed and empty
+				 */
+				bool pop(T &item)
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_not_empty.wait(lock, [this]{ return _closed || !_queue.empty(); });
+					if (_queue.empty()) { return false; }
+					item = std::move(_queue.front());
+					_queue.pop_front();
+					lock.unlock();
+					_not_full.notify_one();
+					return true;
+				}
+
+				/**
+				 * Stop accepting items and wake up every waiting thread
+				 */
+				void close()
+				{
+					{
+						std::lock_guard<std::mutex> lock(_mutex);
+						_closed = true;
+					}
+					_not_empty.notify_all();
+					_not_full.notify_all();
+				}
+
+				size_t size()
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					return _queue.size();
+				}
+		};
+
+	} // namespace Util::Concurrency
+
+} // namespace Util
+
+#endif // SUPERPIXELS_SRC_CORE_BLOCKING_QUEUE_H_
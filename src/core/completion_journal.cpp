@@ -0,0 +1,103 @@
+#include "completion_journal.h"
+
+#include "hash.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+#include <sys/stat.h>
+
+#include <sstream>
+#include <string>
+
+namespace Superpixels
+{
+	CompletionJournal::CompletionJournal(const std::string &journal_path, const uint64_t settings_hash) :
+		_journal_path(journal_path),
+		_settings_key(Util::Hash::toHex(settings_hash))
+	{
+		load();
+
+		_file.open(_journal_path.c_str(), std::ios_base::out | std::ios_base::app);
+		if (!_file.is_open())
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Error: Could not open journal for writing ('" + _journal_path + "')");
+		}
+	}
+
+	void CompletionJournal::load()
+	{
+		std::ifstream f(_journal_path.c_str(), std::ios_base::in | std::ios_base::binary);
+		if (!f.is_open()) { return; }
+
+		std::string line;
+		uintmax_t valid_bytes = 0;
+		while (std::getline(f, line))
+		{
+			// A torn final line (e.g. from a killed job) has no newline and is discarded
+			if (f.eof()) { break; }
+			valid_bytes += line.size() + 1;
+
+			// Line format: <settings hash>\t<output hash>\t<size>\t<mtime>\t<path>
+			std::istringstream fields(line);
+			std::string settings_key;
+			Record record;
+			if (!(fields >> settings_key >> record.output_key >> record.size >> record.mtime)) { continue; }
+			if (settings_key != _settings_key) { continue; }
+			fields.get();
+			if (!std::getline(fields, record.path) || record.path.empty()) { continue; }
+
+			_completed.insert(makeKey(record));
+		}
+		f.close();
+
+		// Drop the torn line so that new records start on their own line
+		if (valid_bytes < boost::filesystem::file_size(_journal_path))
+		{
+			boost::filesystem::resize_file(_journal_path, valid_bytes);
+		}
+	}
+
+	const std::string CompletionJournal::makeKey(const Record &record) const
+	{
+		return record.output_key + '\t' + std::to_string(record.size) + '\t' + std::to_string((long long)record.mtime) + '\t' + record.path;
+	}
+
+	CompletionJournal::Record CompletionJournal::makeRecord(const std::string &input_path, const std::string &output_path) const
+	{
+		Record record;
+		record.path = boost::filesystem::absolute(boost::filesystem::path(input_path)).lexically_normal().string();
+
+		// The same input segmented into another output root is not done
+		const std::string output = boost::filesystem::absolute(boost::filesystem::path(output_path)).lexically_normal().string();
+		record.output_key = Util::Hash::toHex(Util::Hash::fastHash(output.data(), output.size()));
+
+		// A single stat of the input, outputs are never touched
+		struct stat info;
+		if (::stat(record.path.c_str(), &info) != 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Error: Could not stat input ('" + record.path + "')");
+		}
+		record.size = (uintmax_t)info.st_size;
+		record.mtime = info.st_mtime;
+
+		return record;
+	}
+
+	bool CompletionJournal::isComplete(const Record &record)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _completed.count(makeKey(record)) > 0;
+	}
+
+	void CompletionJournal::markComplete(const Record &record)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_completed.insert(makeKey(record));
+
+		// Flush every record so that it survives the process being killed
+		_file << _settings_key << '\t' << record.output_key << '\t' << record.size << '\t' << (long long)record.mtime << '\t' << record.path << '\n';
+		_file.flush();
+	}
+
+} // namespace Superpixels
@@ -0,0 +1,77 @@
+#ifndef SUPERPIXELS_SRC_CORE_COMPLETION_JOURNAL_H_
+#define SUPERPIXELS_SRC_CORE_COMPLETION_JOURNAL_H_
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace Superpixels
+{
+	/**
+	 * Append-only record of the inputs that have been fully segmented.
+	 *
+	 * Each line holds the settings hash, a hash of the output path, and the
+	 * size, modification time and absolute path of one finished input. Entries
+	 * are loaded into a hash set when the journal is opened, so a resumed run
+	 * can skip finished inputs with a single lookup instead of checking for
+	 * their outputs on disk. Entries written with different settings or to
+	 * another output root, or for inputs that have since been modified, do not
+	 * match and the input is segmented again.
+	 */
+	class CompletionJournal
+	{
+
+		public:
+			struct Record
+			{
+				std::string path;
+				std::string output_key;
+				uintmax_t size = 0;
+				std::time_t mtime = 0;
+			};
+
+		private:
+			std::string _journal_path;
+			std::string _settings_key;
+			std::unordered_set<std::string> _completed;
+			std::ofstream _file;
+			std::mutex _mutex;
+
+			const std::string makeKey(const Record &record) const;
+			void load();
+
+		public:
+			/**
+			 * @param journal_path 			Journal file to resume from and append to (created if missing)
+			 * @param settings_hash 		Hash of every setting that affects the outputs
+			 */
+			CompletionJournal(const std::string &journal_path, const uint64_t settings_hash);
+
+			/**
+			 * Describe an input file as it currently is on disk
+			 *
+			 * @param input_path 			Input file
+			 * @param output_path 			Path its outputs are written to (without extension)
+			 *
+			 * @return The record of the input, throws if it cannot be stat'ed
+			 */
+			Record makeRecord(const std::string &input_path, const std::string &output_path) const;
+
+			bool isComplete(const Record &record);
+			void markComplete(const Record &record);
+
+			inline size_t numCompleted();
+	};
+
+	size_t CompletionJournal::numCompleted()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _completed.size();
+	}
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_COMPLETION_JOURNAL_H_
@@ -0,0 +1,311 @@
+#include "directory_scanner.h"
+
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+	boost::filesystem::directory_iterator openDirectory(const std::string &path)
+	{
+		boost::system::error_code ec;
+		boost::filesystem::directory_iterator it(path, ec);
+		if (ec)
+		{
+			std::cerr << "Warning: Skipping unreadable directory ('" << path << "'): " << ec.message() << std::endl;
+		}
+		return it;
+	}
+
+	// Read up to max_entries matching files and subdirectories (flagged, with a
+	// trailing separator) sorted by path, returns false once the directory is exhausted
+	bool readChunk(boost::filesystem::directory_iterator &it, const std::string &ext, const bool recursive,
+		const size_t max_entries, std::vector<std::pair<std::string, bool> > &found)
+	{
+		const boost::filesystem::directory_iterator end;
+		try
+		{
+			for (; it != end && found.size() < max_entries; ++it)
+			{
+				// The link itself: symlinked directories are not followed, so a cycle cannot trap the traversal
+				const boost::filesystem::file_status link_status = it->symlink_status();
+				if (boost::filesystem::is_directory(link_status))
+				{
+					if (recursive) { found.emplace_back(it->path().string() + '/', true); }
+				}
+				else if (it->path().extension().string() == ext)
+				{
+					found.emplace_back(it->path().string(), false);
+				}
+			}
+		}
+		catch (const boost::filesystem::filesystem_error &e)
+		{
+			std::cerr << "Warning: Skipping the rest of an unreadable directory: " << e.what() << std::endl;
+			it = end;
+		}
+		std::sort(found.begin(), found.end());
+		return it != end;
+	}
+}
+
+namespace Util
+{
+	namespace Files
+	{
+		DirectoryScanner::DirectoryScanner(const std::string &root, const std::string &ext,
+			const bool recursive, const size_t queue_capacity) :
+			_root(root),
+			_ext(ext),
+			_recursive(recursive),
+			_capacity(queue_capacity > 0 ? queue_capacity : 1),
+			_files(queue_capacity)
+			{}
+
+		DirectoryScanner::~DirectoryScanner()
+		{
+			// Unblock any worker still waiting on a full queue or an empty directory list
+			_files.close();
+			{
+				std::lock_guard<std::mutex> lock(_dir_mutex);
+				_stopped = true;
+			}
+			_dir_cv.notify_all();
+
+			for (auto &worker : _workers)
+			{
+				worker.join();
+			}
+		}
+
+		void DirectoryScanner::start()
+		{
+			if (!_manifest_path.empty())
+			{
+				if (!Util::Files::exists(_manifest_path))
+				{
+					EXCEPTION_THROWER(Util::Exception::FileNotFoundException, "Error: Manifest does not exist ('" + _manifest_path + "')");
+				}
+				_workers.emplace_back(&DirectoryScanner::manifestWorker, this);
+				return;
+			}
+
+			if (!Util::Files::exists(_root))
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, "Error: Path does not exist ('" + _root + "')");
+			}
+			if (!Util::Files::isDir(_root))
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, "Error: Path is not a directory ('" + _root + "')");
+			}
+
+			_nodes.emplace_back(new DirectoryNode());
+			DirectoryNode *root = _nodes.back().get();
+			root->path = _root;
+			_dirs.push_back(root);
+
+			// Listing a single directory cannot be split between threads
+			const size_t num_threads = _recursive ? _num_threads : 1;
+			for (size_t i = 0; i < num_threads; i++)
+			{
+				_workers.emplace_back(&DirectoryScanner::scanWorker, this);
+			}
+			_workers.emplace_back(&DirectoryScanner::emitWorker, this, root);
+		}
+
+		bool DirectoryScanner::next(std::string &file)
+		{
+			return _files.pop(file);
+		}
+
+		bool DirectoryScanner::popDirectory(DirectoryNode *&dir)
+		{
+			std::unique_lock<std::mutex> lock(_dir_mutex);
+
+			// Wait for work the budget allows, or until no other thread can produce any more
+			_dir_cv.wait(lock, [this]{ return _stopped || (!_dirs.empty() && _num_held < _capacity) || (_dirs.empty() && _num_busy == 0); });
+			if (_stopped || _dirs.empty()) { return false; }
+
+			// Depth first, so directories are listed about in the order they are emitted
+			dir = _dirs.back();
+			_dirs.pop_back();
+			dir->claimed = true;
+			_num_busy++;
+			return true;
+		}
+
+		std::vector<DirectoryScanner::Entry> DirectoryScanner::addSubdirectories(std::vector<std::pair<std::string, bool> > &found)
+		{
+			// Called with _dir_mutex held
+			std::vector<Entry> entries;
+			entries.reserve(found.size());
+			for (auto &item : found)
+			{
+				DirectoryNode *subdir = nullptr;
+				if (item.second)
+				{
+					_nodes.emplace_back(new DirectoryNode());
+					subdir = _nodes.back().get();
+					subdir->path = item.first.substr(0, item.first.size() - 1);
+				}
+				entries.emplace_back(std::move(item.first), subdir);
+			}
+			for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+			{
+				if (it->second) { _dirs.push_back(it->second); }
+			}
+			return entries;
+		}
+
+		void DirectoryScanner::scanDirectory(DirectoryNode *dir)
+		{
+			boost::filesystem::directory_iterator it = openDirectory(dir->path);
+			bool more = true;
+			while (more)
+			{
+				{
+					// Stay within the budget, unless the emitter is waiting for this very directory
+					std::unique_lock<std::mutex> lock(_dir_mutex);
+					_dir_cv.wait(lock, [this, dir]{ return _stopped || _num_held < _capacity || _waiting == dir; });
+					if (_stopped) { break; }
+				}
+
+				std::vector<std::pair<std::string, bool> > found;
+				more = readChunk(it, _ext, _recursive, _capacity, found);
+
+				std::lock_guard<std::mutex> lock(_dir_mutex);
+				_num_held += found.size();
+				dir->chunks.push_back(addSubdirectories(found));
+				_dir_cv.notify_all();
+			}
+
+			std::lock_guard<std::mutex> lock(_dir_mutex);
+			dir->listed = true;
+			_num_busy--;
+			_dir_cv.notify_all();
+		}
+
+		void DirectoryScanner::scanWorker()
+		{
+			DirectoryNode *dir;
+			while (popDirectory(dir))
+			{
+				scanDirectory(dir);
+			}
+		}
+
+		bool DirectoryScanner::emitEntries(std::vector<Entry> &entries)
+		{
+			for (auto &entry : entries)
+			{
+				if (entry.second)
+				{
+					if (!emitDirectory(entry.second)) { return false; }
+				}
+				// Blocks while the consumer catches up
+				else if (!_files.push(std::move(entry.first)))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool DirectoryScanner::emitDirectory(DirectoryNode *dir)
+		{
+			std::unique_lock<std::mutex> lock(_dir_mutex);
+			if (!dir->claimed)
+			{
+				// No worker got to it yet: list it here a chunk at a time rather than wait
+				dir->claimed = true;
+				_dirs.erase(std::find(_dirs.begin(), _dirs.end(), dir));
+				_num_busy++;
+				lock.unlock();
+
+				boost::filesystem::directory_iterator it = openDirectory(dir->path);
+				bool more = true;
+				bool emitted = true;
+				while (more && emitted)
+				{
+					std::vector<std::pair<std::string, bool> > found;
+					more = readChunk(it, _ext, _recursive, _capacity, found);
+					std::vector<Entry> entries;
+					{
+						std::lock_guard<std::mutex> chunk_lock(_dir_mutex);
+						entries = addSubdirectories(found);
+						_dir_cv.notify_all();
+					}
+					emitted = emitEntries(entries);
+				}
+
+				lock.lock();
+				dir->listed = true;
+				_num_busy--;
+				_dir_cv.notify_all();
+				return emitted;
+			}
+
+			while (true)
+			{
+				// Reset after every chunk, as emitting its subdirectories waits for those
+				_waiting = dir;
+				_dir_cv.notify_all();
+				_dir_cv.wait(lock, [this, dir]{ return _stopped || !dir->chunks.empty() || dir->listed; });
+				if (_stopped) { return false; }
+				if (dir->chunks.empty()) { return true; }
+
+				// Only this thread reads the chunks of a directory
+				std::vector<Entry> entries = std::move(dir->chunks.front());
+				dir->chunks.pop_front();
+				lock.unlock();
+				const bool emitted = emitEntries(entries);
+				lock.lock();
+				_num_held -= entries.size();
+				if (!emitted) { return false; }
+			}
+		}
+
+		void DirectoryScanner::emitWorker(DirectoryNode *root)
+		{
+			// Every file of the tree, in sorted order
+			emitDirectory(root);
+			_files.close();
+		}
+
+		void DirectoryScanner::manifestWorker()
+		{
+			// Entries are compared lexically, without resolving symlinks
+			boost::filesystem::path root = boost::filesystem::absolute(_root).lexically_normal();
+			if (root.filename() == ".") { root = root.parent_path(); }
+
+			std::ifstream manifest(_manifest_path.c_str());
+			std::string line;
+			while (std::getline(manifest, line))
+			{
+				// Skip blank lines and comments
+				if (line.empty() || line[0] == '#') { continue; }
+				if (!_ext.empty() && Util::Files::getFileExtension(line) != _ext) { continue; }
+
+				// The outputs mirror the path below the root, so it has to be under it
+				const boost::filesystem::path path(line);
+				const boost::filesystem::path full = boost::filesystem::absolute(path.is_absolute() ? path : boost::filesystem::path(_root) / path);
+				const boost::filesystem::path relative = full.lexically_normal().lexically_relative(root);
+				if (relative.empty() || relative == "." || *relative.begin() == "..")
+				{
+					std::cerr << "Warning: Skipping manifest entry outside of the input path ('" << line << "')" << std::endl;
+					continue;
+				}
+
+				if (!_files.push(Util::Files::joinPathAndFile(_root, relative.string()))) { break; }
+			}
+			_files.close();
+		}
+
+	} // namespace Util::Files
+
+} // namespace Util
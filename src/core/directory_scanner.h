@@ -0,0 +1,122 @@
+#ifndef SUPERPIXELS_SRC_CORE_DIRECTORY_SCANNER_H_
+#define SUPERPIXELS_SRC_CORE_DIRECTORY_SCANNER_H_
+
+#include "blocking_queue.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Util
+{
+	namespace Files
+	{
+		/**
+		 * Streams the files of a given type under a root directory.
+		 *
+		 * Subdirectories are listed concurrently by a pool of worker threads and
+		 * matching paths are handed out through a bounded queue in sorted order,
+		 * each one as soon as every path sorting before it has been found, so
+		 * consumers can start working before the traversal ends. Symbolic links
+		 * to directories are not followed.
+		 *
+		 * Directories are read in chunks of at most queue_capacity entries, and
+		 * the workers stop listing ahead once that many entries wait to be
+		 * handed out, so memory stays bounded however large the tree or a
+		 * single directory is. Each chunk is sorted on its own: a directory
+		 * holding more entries than that comes out as a sequence of sorted runs.
+		 *
+		 * Alternatively, paths can be read from a precomputed manifest file (one
+		 * path per line, relative paths are resolved against the root). They are
+		 * produced in manifest order, and entries outside the root are skipped.
+		 */
+		class DirectoryScanner
+		{
+
+			private:
+				std::string _root;
+				std::string _ext;
+				bool _recursive;
+				std::string _manifest_path;
+				size_t _num_threads = 4;
+
+				struct DirectoryNode;
+				typedef std::pair<std::string, DirectoryNode*> Entry;
+
+				// A directory and the sorted chunks of its matching files and
+				// subdirectories listed so far (subdirectories by path and separator,
+				// so that they take the place of their contents among the files)
+				struct DirectoryNode
+				{
+					std::string path;
+					bool claimed = false;
+					bool listed = false;
+					std::deque<std::vector<Entry> > chunks;
+				};
+
+				// Every directory found, and the ones waiting to be listed
+				std::deque<std::unique_ptr<DirectoryNode> > _nodes;
+				std::deque<DirectoryNode*> _dirs;
+				size_t _num_busy = 0;
+				bool _stopped = false;
+				std::mutex _dir_mutex;
+				std::condition_variable _dir_cv;
+
+				// Entries listed and not emitted yet, and the directory the emitter waits for
+				size_t _capacity;
+				size_t _num_held = 0;
+				DirectoryNode *_waiting = nullptr;
+
+				// Matching files ready to be consumed
+				Util::Concurrency::BlockingQueue<std::string> _files;
+				std::vector<std::thread> _workers;
+
+				bool popDirectory(DirectoryNode *&dir);
+				std::vector<Entry> addSubdirectories(std::vector<std::pair<std::string, bool> > &found);
+				void scanDirectory(DirectoryNode *dir);
+				void scanWorker();
+				bool emitEntries(std::vector<Entry> &entries);
+				bool emitDirectory(DirectoryNode *dir);
+				void emitWorker(DirectoryNode *root);
+				void manifestWorker();
+
+			public:
+				/**
+				 * @param root 					Path to directory to search
+				 * @param ext 					File type extension (with leading period)
+				 * @param recursive 			Whether or not to recurse through subdirectories
+				 * @param queue_capacity 		Maximum number of listed paths held ahead of the consumer
+				 */
+				DirectoryScanner(const std::string &root, const std::string &ext,
+					const bool recursive, const size_t queue_capacity = 4096);
+				~DirectoryScanner();
+
+				inline void setNumThreads(const size_t num_threads);
+				inline void setManifest(const std::string &manifest_path);
+
+				// Launch the traversal threads
+				void start();
+
+				/**
+				 * Get the next matching file, waiting for the scanners if necessary
+				 *
+				 * @param file 					Holds the path to the next file
+				 *
+				 * @return True if a file was returned, False once the traversal is exhausted
+				 */
+				bool next(std::string &file);
+		};
+
+		void DirectoryScanner::setNumThreads(const size_t num_threads) { _num_threads = num_threads > 0 ? num_threads : 1; }
+		void DirectoryScanner::setManifest(const std::string &manifest_path) { _manifest_path = manifest_path; }
+
+	} // namespace Util::Files
+
+} // namespace Util
+
+#endif // SUPERPIXELS_SRC_CORE_DIRECTORY_SCANNER_H_
@@ -0,0 +1,67 @@
+#include "engine_pool.h"
+
+#include <iterator>
+#include <utility>
+
+namespace Superpixels
+{
+	void EnginePool::evict(const size_t max_engines, std::vector<std::unique_ptr<PooledEngine> > &evicted)
+	{
+		while (_num_engines > max_engines && !_idle.empty())
+		{
+			evicted.push_back(std::move(_idle.front().engine));
+			_idle.pop_front();
+			_num_engines--;
+		}
+	}
+
+	std::unique_ptr<PooledEngine> EnginePool::acquire(const uint64_t profile_key, const gSLICr::objects::settings &settings)
+	{
+		std::unique_ptr<PooledEngine> engine;
+		std::vector<std::unique_ptr<PooledEngine> > evicted;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (auto it = _idle.rbegin(); it != _idle.rend(); ++it)
+			{
+				if (it->profile_key == profile_key)
+				{
+					engine = std::move(it->engine);
+					_idle.erase(std::next(it).base());
+					break;
+				}
+			}
+
+			// Make room for the one about to be built
+			if (!engine) { evict(_max_engines - 1, evicted); }
+		}
+
+		// Freeing engines is slow too, so it is done outside the lock
+		evicted.clear();
+
+		if (engine)
+		{
+			engine->engine.Reshape(settings.img_size);
+			engine->in_img.ChangeDims(settings.img_size);
+			return engine;
+		}
+
+		// Allocating an engine is slow, so it is done outside the lock, and only counted once it succeeded
+		engine.reset(new PooledEngine(settings));
+		std::lock_guard<std::mutex> lock(_mutex);
+		_num_engines++;
+		return engine;
+	}
+
+	void EnginePool::release(const uint64_t profile_key, std::unique_ptr<PooledEngine> engine)
+	{
+		std::vector<std::unique_ptr<PooledEngine> > evicted;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_idle.push_back(IdleEngine{ profile_key, std::move(engine) });
+
+			// Engines built while every other one was busy may have gone over the limit
+			evict(_max_engines, evicted);
+		}
+	}
+
+} // namespace Superpixels
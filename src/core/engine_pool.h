@@ -0,0 +1,104 @@
+#ifndef SUPERPIXELS_SRC_CORE_ENGINE_POOL_H_
+#define SUPERPIXELS_SRC_CORE_ENGINE_POOL_H_
+
+#include "../gSLICr/gSLICr_Lib/gSLICr.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace Superpixels
+{
+	// An engine with an input image of its size (on the device only for the GPU engine)
+	struct PooledEngine
+	{
+		gSLICr::engines::core_engine engine;
+		gSLICr::UChar4Image in_img;
+
+		PooledEngine(const gSLICr::objects::settings &settings) :
+			engine(settings),
+			in_img(settings.img_size, true, settings.device_type == gSLICr::DEVICE_GPU)
+			{}
+	};
+
+	/**
+	 * Warmed gSLICr engines, kept per settings profile so that repeated work
+	 * with the same settings skips the engine allocation. An engine taken for
+	 * another image size is reshaped, which only allocates when it grows.
+	 *
+	 * An engine is used by one thread at a time: acquire() hands out an idle
+	 * engine of the profile (or builds a new one when all are busy), and
+	 * release() returns it to the pool.
+	 *
+	 * The pool holds at most max_engines engines: building one more first
+	 * destroys the least recently released idle engine of any profile. Engines
+	 * in use are never evicted, so more than that many exist while more are
+	 * busy at once.
+	 */
+	class EnginePool
+	{
+
+		private:
+			struct IdleEngine
+			{
+				uint64_t profile_key;
+				std::unique_ptr<PooledEngine> engine;
+			};
+
+			// Least recently released first
+			std::list<IdleEngine> _idle;
+			size_t _max_engines = 8;
+			size_t _num_engines = 0;
+			std::mutex _mutex;
+
+			// Take idle engines out until at most max_engines are left, called with the lock held
+			void evict(const size_t max_engines, std::vector<std::unique_ptr<PooledEngine> > &evicted);
+
+		public:
+			/**
+			 * Take an engine for a profile, building one if none is idle
+			 *
+			 * @param profile_key 			Hash of the engine settings, without the image size
+			 * @param settings 				Settings of a new engine, their image size for an idle one
+			 */
+			std::unique_ptr<PooledEngine> acquire(const uint64_t profile_key, const gSLICr::objects::settings &settings);
+
+			// Hand an engine back so later work with the same profile can reuse it
+			void release(const uint64_t profile_key, std::unique_ptr<PooledEngine> engine);
+
+			inline void setMaxEngines(const size_t max_engines);
+
+			inline size_t numEngines();
+			// Profiles with an idle engine
+			inline size_t numProfiles();
+	};
+
+	void EnginePool::setMaxEngines(const size_t max_engines)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_max_engines = max_engines > 0 ? max_engines : 1;
+	}
+
+	size_t EnginePool::numEngines()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _num_engines;
+	}
+
+	size_t EnginePool::numProfiles()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::unordered_set<uint64_t> profiles;
+		for (const IdleEngine &idle : _idle)
+		{
+			profiles.insert(idle.profile_key);
+		}
+		return profiles.size();
+	}
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_ENGINE_POOL_H_
@@ -0,0 +1,99 @@
+#ifndef SUPERPIXELS_SRC_CORE_HASH_H_
+#define SUPERPIXELS_SRC_CORE_HASH_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace Util
+{
+	namespace Hash
+	{
+		const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+		const uint64_t FNV_PRIME = 1099511628211ULL;
+
+		/**
+		 * 64-bit FNV-1a hash of a byte buffer
+		 *
+		 * @param data 						Pointer to the bytes to hash
+		 * @param num_bytes 				Number of bytes to hash
+		 * @param hash 						Running hash to continue from
+		 *
+		 * @return The updated hash
+		 */
+		inline uint64_t fnv1a64(const void *data, const size_t num_bytes, uint64_t hash = FNV_OFFSET_BASIS)
+		{
+			const unsigned char *bytes = static_cast<const unsigned char *>(data);
+			for (size_t i = 0; i < num_bytes; i++)
+			{
+				hash ^= bytes[i];
+				hash *= FNV_PRIME;
+			}
+			return hash;
+		}
+
+		// Final avalanche step of MurmurHash3
+		inline uint64_t mix64(uint64_t x)
+		{
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdULL;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+
+		/**
+		 * Fast non-cryptographic hash for large buffers (e.g. image pixels),
+		 * consuming 8 bytes per step instead of the single byte of FNV-1a
+		 *
+		 * @param data 						Pointer to the bytes to hash
+		 * @param num_bytes 				Number of bytes to hash
+		 * @param hash 						Running hash to continue from
+		 *
+		 * @return The updated hash
+		 */
+		inline uint64_t fastHash(const void *data, const size_t num_bytes, uint64_t hash = FNV_OFFSET_BASIS)
+		{
+			const unsigned char *bytes = static_cast<const unsigned char *>(data);
+			hash ^= mix64(num_bytes);
+
+			size_t i = 0;
+			for (; i + sizeof(uint64_t) <= num_bytes; i += sizeof(uint64_t))
+			{
+				uint64_t word;
+				memcpy(&word, bytes + i, sizeof(uint64_t));
+				hash = (hash ^ mix64(word)) * 0x9e3779b97f4a7c15ULL;
+			}
+			return mix64(fnv1a64(bytes + i, num_bytes - i, hash));
+		}
+
+		/**
+		 * Mix a plain value into a running hash
+		 *
+		 * NOTE: Only use with scalars and enums, struct padding is not deterministic
+		 */
+		template <typename T>
+		inline uint64_t combine(const uint64_t hash, const T &value)
+		{
+			return fnv1a64(&value, sizeof(T), hash);
+		}
+
+		inline uint64_t combine(const uint64_t hash, const std::string &value)
+		{
+			return fnv1a64(value.data(), value.size(), hash);
+		}
+
+		inline const std::string toHex(const uint64_t hash)
+		{
+			char buffer[17];
+			snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+			return std::string(buffer);
+		}
+
+	} // namespace Util::Hash
+
+} // namespace Util
+
+#endif // SUPERPIXELS_SRC_CORE_HASH_H_
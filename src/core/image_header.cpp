@@ -0,0 +1,94 @@
+#include "image_header.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace Util
+{
+	namespace Images
+	{
+		namespace
+		{
+			inline uint32_t bigEndian16(const unsigned char *bytes) { return (uint32_t)bytes[0] << 8 | bytes[1]; }
+			inline uint32_t bigEndian32(const unsigned char *bytes) { return bigEndian16(bytes) << 16 | bigEndian16(bytes + 2); }
+
+			bool readPNGSize(std::ifstream &f, int &width, int &height)
+			{
+				// The IHDR chunk comes first: length, "IHDR", width, height
+				unsigned char ihdr[16];
+				if (!f.read((char *)ihdr, sizeof(ihdr)) || std::memcmp(ihdr + 4, "IHDR", 4) != 0) { return false; }
+				width = (int)bigEndian32(ihdr + 8);
+				height = (int)bigEndian32(ihdr + 12);
+				return width > 0 && height > 0;
+			}
+
+			bool readJPEGSize(std::ifstream &f, int &width, int &height)
+			{
+				// Walk the marker segments up to the first start of frame
+				unsigned char marker[4];
+				while (f.read((char *)marker, 2))
+				{
+					if (marker[0] != 0xFF) { return false; }
+
+					// Markers may be preceded by any number of fill bytes
+					while (marker[1] == 0xFF)
+					{
+						if (!f.read((char *)marker + 1, 1)) { return false; }
+					}
+
+					// Standalone markers have no length
+					if (marker[1] == 0x01 || (marker[1] >= 0xD0 && marker[1] <= 0xD7)) { continue; }
+					if (marker[1] == 0xD9 || marker[1] == 0xDA) { return false; }
+
+					if (!f.read((char *)marker + 2, 2)) { return false; }
+					const uint32_t length = bigEndian16(marker + 2);
+					if (length < 2) { return false; }
+
+					// SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+					if (marker[1] >= 0xC0 && marker[1] <= 0xCF && marker[1] != 0xC4 && marker[1] != 0xC8 && marker[1] != 0xCC)
+					{
+						// Sample precision, height, width
+						unsigned char sof[5];
+						if (length < 2 + sizeof(sof) || !f.read((char *)sof, sizeof(sof))) { return false; }
+						height = (int)bigEndian16(sof + 1);
+						width = (int)bigEndian16(sof + 3);
+						return width > 0 && height > 0;
+					}
+					f.seekg(length - 2, std::ios_base::cur);
+				}
+				return false;
+			}
+		}
+
+		bool readImageSize(const std::string &path, int &width, int &height)
+		{
+			ImageFormat format;
+			return readImageSize(path, width, height, format);
+		}
+
+		bool readImageSize(const std::string &path, int &width, int &height, ImageFormat &format)
+		{
+			std::ifstream f(path.c_str(), std::ios_base::in | std::ios_base::binary);
+			unsigned char signature[8];
+			if (!f.read((char *)signature, 2)) { return false; }
+
+			if (signature[0] == 0xFF && signature[1] == 0xD8)
+			{
+				format = ImageFormat::JPEG;
+				return readJPEGSize(f, width, height);
+			}
+
+			static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			if (f.read((char *)signature + 2, 6) && std::memcmp(signature, PNG_SIGNATURE, 8) == 0)
+			{
+				format = ImageFormat::PNG;
+				return readPNGSize(f, width, height);
+			}
+			return false;
+		}
+
+	} // namespace Util::Images
+
+} // namespace Util
@@ -0,0 +1,38 @@
+#ifndef SUPERPIXELS_SRC_CORE_IMAGE_HEADER_H_
+#define SUPERPIXELS_SRC_CORE_IMAGE_HEADER_H_
+
+#include <string>
+
+namespace Util
+{
+	namespace Images
+	{
+		enum class ImageFormat { PNG, JPEG };
+
+		/**
+		 * Read the dimensions of a PNG or JPEG image from its header, without
+		 * decoding the pixels.
+		 *
+		 * NOTE: The stored dimensions are returned, a decoder applying an EXIF
+		 * orientation may swap them.
+		 *
+		 * @param path 					Image file
+		 * @param width 				Holds the image width
+		 * @param height 				Holds the image height
+		 *
+		 * @return True if the header was understood, False otherwise (other formats, truncated files)
+		 */
+		bool readImageSize(const std::string &path, int &width, int &height);
+
+		/**
+		 * As above, also telling the format (e.g. whether a reduced decode pays off)
+		 *
+		 * @param format 				Holds the image format
+		 */
+		bool readImageSize(const std::string &path, int &width, int &height, ImageFormat &format);
+
+	} // namespace Util::Images
+
+} // namespace Util
+
+#endif // SUPERPIXELS_SRC_CORE_IMAGE_HEADER_H_
@@ -0,0 +1,98 @@
+#include "image_resample.h"
+
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Util
+{
+	namespace Images
+	{
+		namespace
+		{
+			// Fixed-point interpolation weights, as OpenCV's 8-bit resize
+			const int WEIGHT_BITS = 11;
+			const int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+			// Source index and the weights of it and the next source pixel, for every destination pixel
+			void linearTaps(const int src_len, const int dst_len, std::vector<int> &offsets, std::vector<int> &weights)
+			{
+				offsets.resize(dst_len);
+				weights.resize(2 * dst_len);
+				const double scale = (double)src_len / dst_len;
+				for (int d = 0; d < dst_len; d++)
+				{
+					// Pixel centers line up (cv::INTER_LINEAR), the edges are clamped
+					float f = (float)((d + 0.5) * scale - 0.5);
+					int s = (int)std::floor(f);
+					f -= s;
+					if (s < 0) { s = 0; f = 0; }
+					if (s >= src_len - 1) { s = src_len - 1; f = 0; }
+					offsets[d] = s;
+
+					// Each weight is rounded on its own, as cv::resize does
+					weights[2 * d] = (int)std::nearbyint((1.f - f) * WEIGHT_ONE);
+					weights[2 * d + 1] = (int)std::nearbyint(f * WEIGHT_ONE);
+				}
+			}
+		}
+
+		void resampleToRGBA(const cv::Mat &src, unsigned char *dst, const size_t dst_step, const int width, const int height)
+		{
+			if (src.type() != CV_8UC3) { EXCEPTION_THROWER(Util::Exception::IOException, "Only 8-bit BGR images can be resampled") }
+
+			// Same size, only the channels change
+			if (src.cols == width && src.rows == height)
+			{
+#pragma omp parallel for
+				for (int y = 0; y < height; y++)
+				{
+					const unsigned char *in = src.ptr<unsigned char>(y);
+					unsigned char *out = dst + y * dst_step;
+					for (int x = 0; x < width; x++, in += 3, out += 4)
+					{
+						out[0] = in[2];
+						out[1] = in[1];
+						out[2] = in[0];
+						out[3] = 255;
+					}
+				}
+				return;
+			}
+
+			std::vector<int> xofs, xweights, yofs, yweights;
+			linearTaps(src.cols, width, xofs, xweights);
+			linearTaps(src.rows, height, yofs, yweights);
+
+#pragma omp parallel for
+			for (int y = 0; y < height; y++)
+			{
+				const unsigned char *row0 = src.ptr<unsigned char>(yofs[y]);
+				const unsigned char *row1 = src.ptr<unsigned char>(std::min(yofs[y] + 1, src.rows - 1));
+				const int b0 = yweights[2 * y];
+				const int b1 = yweights[2 * y + 1];
+				unsigned char *out = dst + y * dst_step;
+				for (int x = 0; x < width; x++, out += 4)
+				{
+					const int s0 = 3 * xofs[x];
+					const int s1 = 3 * std::min(xofs[x] + 1, src.cols - 1);
+					const int a0 = xweights[2 * x];
+					const int a1 = xweights[2 * x + 1];
+					for (int c = 0; c < 3; c++)
+					{
+						const int top = row0[s0 + c] * a0 + row0[s1 + c] * a1;
+						const int bottom = row1[s0 + c] * a0 + row1[s1 + c] * a1;
+
+						// BGR to RGB, rounding away both weight scales in the steps of cv::resize
+						out[2 - c] = (unsigned char)((((b0 * (top >> 4)) >> 16) + ((b1 * (bottom >> 4)) >> 16) + 2) >> 2);
+					}
+					out[3] = 255;
+				}
+			}
+		}
+
+	} // namespace Util::Images
+
+} // namespace Util
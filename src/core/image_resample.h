@@ -0,0 +1,36 @@
+#ifndef SUPERPIXELS_SRC_CORE_IMAGE_RESAMPLE_H_
+#define SUPERPIXELS_SRC_CORE_IMAGE_RESAMPLE_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <cstddef>
+
+namespace Util
+{
+	namespace Images
+	{
+		/**
+		 * Resample a BGR image and write it as RGBA pixels (the layout of a
+		 * gSLICr input image), resizing and converting in one multi-threaded
+		 * pass over the destination rows.
+		 *
+		 * The interpolation is bilinear on the cv::INTER_LINEAR grid, with the
+		 * fixed-point weights and rounding of OpenCV's generic 8-bit code. It is
+		 * not bit-exact with cv::resize: upscaled pixels may be off by one, and
+		 * OpenCV builds with IPP or a HAL round (and may pick other paths for
+		 * integer factors) differently. A destination of the source size is an
+		 * exact copy. Alpha is 255.
+		 *
+		 * @param src 					8-bit BGR image (CV_8UC3)
+		 * @param dst 					First destination pixel
+		 * @param dst_step 				Bytes from one destination row to the next
+		 * @param width 				Destination width
+		 * @param height 				Destination height
+		 */
+		void resampleToRGBA(const cv::Mat &src, unsigned char *dst, const size_t dst_step, const int width, const int height);
+
+	} // namespace Util::Images
+
+} // namespace Util
+
+#endif // SUPERPIXELS_SRC_CORE_IMAGE_RESAMPLE_H_
@@ -1,6 +1,8 @@
 #include "image_segmenter.h"
 
 #include "util.h"
+#include "directory_scanner.h"
+#include "hash.h"
 
 #include "../gSLICr/NVTimer.h"
 
@@ -8,10 +10,13 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <boost/filesystem.hpp>
+
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace Superpixels
 {
@@ -19,8 +24,29 @@ namespace Superpixels
 		Segmenter(settings)
 		{}
 
+	void ImageSegmenter::setVizCodec(const std::string &codec) { _viz_codec = ImageCodec::parse(codec); }
+
+	void ImageSegmenter::setLabelCodec(const std::string &codec)
+	{
+		const ImageCodec label_codec = ImageCodec::parse(codec);
+		if (!label_codec.keeps16Bit())
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Labels need a lossless 16-bit codec (png or raw), got '" + codec + "'")
+		}
+		_label_codec = label_codec;
+	}
+
+	const std::vector<std::string> ImageSegmenter::outputSuffixes() const
+	{
+		return { ".viz" + _viz_codec.extension(3), ".slic" + _label_codec.extension(1) };
+	}
+
 	void ImageSegmenter::segment()
 	{
+		openJournal();
+		openCache();
+		openWriter();
+
 		// If the input is a single file, just segment it
 		if (!Util::Files::isDir(_input_path))
 		{
@@ -28,20 +54,19 @@ namespace Superpixels
 			Util::Files::mkdir(_output_root);
 
 			// Perform the image segmentation
-			segmentImage(_input_path, _output_root);
+			dispatchImage(_input_path, _output_root);
 		}
 		else
 		{
-			// Load all file paths from the directory
-			// NOTE: This should only be used for reasonable size image 
-			// directories as it searches for and loads all paths into memory. 
-			// Use RecursiveImageSegmenter for large scale image sets
-			std::vector<std::string> files;
-			Util::Files::getFilesOfTypeInDirectory(files, _input_path, _ext,
-				 _recursive);
+			// Stream file paths from the directory as they are found
+			Util::Files::DirectoryScanner scanner(_input_path, _ext, _recursive);
+			scanner.setNumThreads(_scan_threads);
+			scanner.setManifest(_manifest_path);
+			scanner.start();
 
-			// For loop to process all the files
-			for (const auto &file : files)
+			// Loop to process all the files
+			std::string file;
+			while (scanner.next(file))
 			{
 				// Remove top-level directory from the path (i.e. remove the input_path directory)
 				const std::string topless_path = Util::Files::stripRootDir(file);
@@ -52,9 +77,80 @@ namespace Superpixels
 				Util::Files::mkdirs(output_dir);
 
 				// Segment the input image
-				segmentImage(file, output_dir);
+				dispatchImage(file, output_dir);
+			}
+		}
+
+		_writer->flush();
+	}
+
+	void ImageSegmenter::openCache()
+	{
+		if (_cache_dir.empty()) { return; }
+		_cache = std::unique_ptr<ResultCache>(new ResultCache(_cache_dir));
+	}
+
+	void ImageSegmenter::openWriter()
+	{
+		_writer.reset();
+		_writer = std::unique_ptr<OutputWriter>(new OutputWriter(_writer_threads, _writer_queue));
+	}
+
+	uint64_t ImageSegmenter::contentKey(const cv::Mat &frame) const
+	{
+		uint64_t key = engineSettingsHash();
+		key = Util::Hash::combine(key, _viz_codec.toString());
+		key = Util::Hash::combine(key, _label_codec.toString());
+		key = Util::Hash::combine(key, _settings.img_size.x);
+		key = Util::Hash::combine(key, _settings.img_size.y);
+		key = Util::Hash::combine(key, frame.cols);
+		key = Util::Hash::combine(key, frame.rows);
+		for (int y = 0; y < frame.rows; y++)
+		{
+			key = Util::Hash::fastHash(frame.ptr(y), frame.cols * frame.elemSize(), key);
+		}
+		return key;
+	}
+
+	void ImageSegmenter::openJournal()
+	{
+		if (_journal_path.empty()) { return; }
+
+		// Outputs written with other codecs do not count as done
+		uint64_t settings_hash = settingsHash();
+		settings_hash = Util::Hash::combine(settings_hash, _viz_codec.toString());
+		settings_hash = Util::Hash::combine(settings_hash, _label_codec.toString());
+
+		_journal = std::unique_ptr<CompletionJournal>(new CompletionJournal(_journal_path, settings_hash));
+		if (_verbose)
+		{
+			std::cout << "Resuming from journal: '" << _journal_path << "' ("
+				<< _journal->numCompleted() << " images already segmented)" << std::endl;
+		}
+	}
+
+	void ImageSegmenter::dispatchImage(const std::string &input_path, const std::string &output_path)
+	{
+		if (!_journal)
+		{
+			segmentImage(input_path, output_path, std::function<void()>());
+			return;
+		}
+
+		const std::string full_out_path = Util::Files::joinPathAndFile(output_path, Util::Files::getFilenameFromPath(input_path));
+		const CompletionJournal::Record record = _journal->makeRecord(input_path, full_out_path);
+		if (_journal->isComplete(record))
+		{
+			if (_verbose)
+			{
+				std::cout << "Skipping completed image: '" << input_path << "'" << std::endl;
 			}
+			return;
 		}
+
+		// Only recorded once all outputs have been written
+		CompletionJournal *journal = _journal.get();
+		segmentImage(input_path, output_path, [journal, record]() { journal->markComplete(record); });
 	}
 
 	void ImageSegmenter::writeBoundaryToBinary(const std::string &output_path, const cv::Mat & boundary) const
@@ -86,7 +182,8 @@ namespace Superpixels
 		f.close();
 	}
 
-	void ImageSegmenter::segmentImage(const std::string &input_path, const std::string &output_path)
+	void ImageSegmenter::segmentImage(const std::string &input_path, const std::string &output_path,
+		const std::function<void()> &on_written)
 	{
 		// Read the image from disk
 		if (_verbose)
@@ -94,55 +191,63 @@ namespace Superpixels
 			std::cout << "Segmenting image: '" << input_path << "'" << std::endl;
 		}
 
-		cv::Mat old_frame = cv::imread(input_path);
+		// Set image size by max side length or scale factor (a JPEG much larger is decoded reduced)
+		cv::Mat old_frame = read_image(input_path);
 		if (!old_frame.data){ EXCEPTION_THROWER(Util::Exception::IOException, "Error loading image") }
+		cv::Size s(_settings.img_size.x, _settings.img_size.y);
+
+		// Form output paths
+		std::string fname = Util::Files::getFilenameFromPath(input_path);
+		std::string full_out_path = Util::Files::joinPathAndFile(output_path, fname);
 
-		// Set image size by max side length (preserving aspect ratio)
-		if (!_use_scale)
+		// Identical decoded pixels with identical settings give identical outputs, the engine is not needed for a hit
+		const std::vector<std::string> suffixes = outputSuffixes();
+		uint64_t cache_key = 0;
+		if (_cache)
 		{
-			if (old_frame.cols <= old_frame.rows)
-			{
-				_settings.img_size.y = (int)_max_sidelen;
-				float scale = _max_sidelen / old_frame.rows;
-				_settings.img_size.x = (int)(scale * old_frame.cols);
-			}
-			else
+			cache_key = contentKey(old_frame);
+			if (_cache->fetch(cache_key, full_out_path, suffixes))
 			{
-				_settings.img_size.x = (int)_max_sidelen;
-				float scale = _max_sidelen / old_frame.cols;
-				_settings.img_size.y = (int)(scale * old_frame.rows);
+				if (_verbose)
+				{
+					std::cout << "\tCached segmentations linked to: '" << full_out_path << "'" << std::endl;
+				}
+				if (on_written) { on_written(); }
+				return;
 			}
 		}
-		// Or set image size using a scale factor
+
+		// Instantiate a core_engine for the first image, later ones reconfigure it
+		if (!_engine)
+		{
+			_engine = std::unique_ptr<gSLICr::engines::core_engine>(new gSLICr::engines::core_engine(_settings));
+		}
 		else
 		{
-			_settings.img_size.x = (int)(_scale * old_frame.cols);
-			_settings.img_size.y = (int)(_scale * old_frame.rows);
+			_engine->Reconfigure(_settings);
+		}
+		gSLICr::engines::core_engine *gSLICr_engine = _engine.get();
+		if (_verbose)
+		{
+			std::cout << "\tBackend: " << gSLICr_engine->Get_Backend_Name() << std::endl;
 		}
-		cv::Size s(_settings.img_size.x, _settings.img_size.y);
-
-		// Instantiate a core_engine
-		std::unique_ptr<gSLICr::engines::core_engine> gSLICr_engine = std::unique_ptr<gSLICr::engines::core_engine>(new gSLICr::engines::core_engine(_settings));
-
-		// gSLICr takes gSLICr::UChar4Image as input and output
-		std::unique_ptr<gSLICr::UChar4Image> in_img = std::unique_ptr<gSLICr::UChar4Image>(new gSLICr::UChar4Image(_settings.img_size, true, true));
-		std::unique_ptr<gSLICr::UChar4Image> out_seg = std::unique_ptr<gSLICr::UChar4Image>(new gSLICr::UChar4Image(_settings.img_size, true, true));
-		std::unique_ptr<gSLICr::UChar4Image> out_bound = std::unique_ptr<gSLICr::UChar4Image>(new gSLICr::UChar4Image(_settings.img_size, true, true));
 
-		// Resize the image
-		cv::Mat frame;
-		cv::resize(old_frame, frame, s);
+		// Resize the image straight into the (letterboxed) input buffer of the engine
+		gSLICr::UChar4Image *in_img = gSLICr_engine->Get_Input_Buffer(inputSize());
+		ingest_image(old_frame, in_img);
+		old_frame.release();
 
-		// GPU call: load input image from CPU onto the GPU
-		load_image(frame, in_img.get());
+		// gSLICr takes gSLICr::UChar4Image as output
+		std::unique_ptr<gSLICr::UChar4Image> out_seg = std::unique_ptr<gSLICr::UChar4Image>(new gSLICr::UChar4Image(inputSize(), true, _settings.device_type == gSLICr::DEVICE_GPU));
+		std::unique_ptr<gSLICr::UChar4Image> out_bound = std::unique_ptr<gSLICr::UChar4Image>(new gSLICr::UChar4Image(inputSize(), true, _settings.device_type == gSLICr::DEVICE_GPU));
 
 		StopWatchInterface *my_timer;
 		sdkCreateTimer(&my_timer);
 		sdkResetTimer(&my_timer);
 		sdkStartTimer(&my_timer);
 		
-		// Perform the segmentation
-		gSLICr_engine->Process_Frame(in_img.get());
+		// Perform the segmentation, a letterbox border is left out
+		gSLICr_engine->Process_Input_Buffer(_settings.img_size);
 		
 		// Stop the timer and print the time
 		sdkStopTimer(&my_timer);
@@ -172,19 +277,28 @@ namespace Superpixels
 		// cv::Mat boundary_draw_frame;
 		// boundary_draw_frame.create(s, CV_8UC3);
 		// load_image(out_bound.get(), boundary_draw_frame);
-		
-		// Form output paths
-		std::string fname = Util::Files::getFilenameFromPath(input_path);
-		std::string full_out_path = Util::Files::joinPathAndFile(output_path, fname);
 
-		// Write viz image
-		std::string viz_out_name = full_out_path + ".viz.png";
-		cv::imwrite(viz_out_name, img_draw_frame);
-		
-		// Write segmentation PGM
-		std::string pgm_out_name = full_out_path + ".slic.pgm";
-		gSLICr_engine->Write_Seg_Res_To_PGM(pgm_out_name.c_str());
-		
+		// Copy the labels out of the engine, it moves on to the next image while they are written
+		cv::Mat labels;
+		load_labels(gSLICr_engine->Get_Seg_Res(), labels);
+
+		// Encode the viz image and the labels on the writer threads
+		std::vector<OutputWriter::Job> jobs(2);
+		jobs[0].path = full_out_path + suffixes[0];
+		jobs[0].image = img_draw_frame;
+		jobs[0].codec = _viz_codec;
+		jobs[1].path = full_out_path + suffixes[1];
+		jobs[1].image = labels;
+		jobs[1].codec = _label_codec;
+
+		// Only cached once complete on disk, the journal (if any) comes last
+		ResultCache *cache = _cache.get();
+		_writer->submit(std::move(jobs), [cache, cache_key, full_out_path, suffixes, on_written]()
+		{
+			if (cache) { cache->store(cache_key, full_out_path, suffixes); }
+			if (on_written) { on_written(); }
+		});
+
 
 		///////////////////////////////////////////////////////////////
 		// Extra information that can be written to file if need be
@@ -210,7 +324,7 @@ namespace Superpixels
 
 		if (_verbose)
 		{
-			std::cout << "\tSegmentations written to: '" << full_out_path << "'" << std::endl;
+			std::cout << "\tSegmentations queued for: '" << full_out_path << "'" << std::endl;
 		}
 	}
 
@@ -2,8 +2,14 @@
 #define SUPERPIXELS_SRC_CORE_IMAGE_SEGMENTER_H_
 
 #include "segmenter.h"
+#include "completion_journal.h"
+#include "result_cache.h"
+#include "output_writer.h"
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace Superpixels
 {
@@ -14,8 +20,48 @@ namespace Superpixels
 		protected:
 			bool _recursive = false;
 			std::string _ext;
+			std::string _manifest_path;
+			size_t _scan_threads = 4;
+			std::string _journal_path;
+			std::unique_ptr<CompletionJournal> _journal;
+			std::string _cache_dir;
+			std::unique_ptr<ResultCache> _cache;
+			// Kept across images and settings changes, reconfigured in place
+			std::unique_ptr<gSLICr::engines::core_engine> _engine;
+			ImageCodec _viz_codec = ImageCodec::parse("png");
+			ImageCodec _label_codec = ImageCodec::parse("raw");
+			size_t _writer_threads = 2;
+			size_t _writer_queue = 16;
+			// Destroyed first, its pending callbacks use the journal and the cache
+			std::unique_ptr<OutputWriter> _writer;
 
-			void segmentImage(const std::string &input_path, const std::string &output_path);
+			// Suffixes of the files written for every segmented image
+			const std::vector<std::string> outputSuffixes() const;
+
+			// Open the completion journal (if any) with the current settings
+			void openJournal();
+
+			// Open the result cache (if any)
+			void openCache();
+
+			// Start the output writer threads
+			void openWriter();
+
+			// Cache key from the decoded pixels, the image size, the engine settings and the output codecs
+			uint64_t contentKey(const cv::Mat &frame) const;
+
+			// Segment an image unless the journal says it is already done
+			void dispatchImage(const std::string &input_path, const std::string &output_path);
+
+			/**
+			 * Segment an image and queue its outputs on the writer
+			 *
+			 * @param input_path 			Image to segment
+			 * @param output_path 			Directory to write the outputs to
+			 * @param on_written 			Called once all outputs are on disk (possibly on a writer thread)
+			 */
+			void segmentImage(const std::string &input_path, const std::string &output_path,
+				const std::function<void()> &on_written);
 
 			void writeBoundaryToBinary(const std::string &output_path, const cv::Mat &boundary) const;
 
@@ -24,6 +70,17 @@ namespace Superpixels
 			
 			inline void setRecursive(const bool recursive);
 			inline void setExtension(const std::string &ext);
+			inline void setManifest(const std::string &manifest_path);
+			inline void setScanThreads(const size_t scan_threads);
+			inline void setJournal(const std::string &journal_path);
+			inline void setCacheDirectory(const std::string &cache_dir);
+			inline void setWriterThreads(const size_t writer_threads);
+			inline void setWriterQueue(const size_t writer_queue);
+
+			// Codec of the visualization, e.g. "png:1" or "jpeg:90" (see ImageCodec)
+			void setVizCodec(const std::string &codec);
+			// Codec of the labels, only the lossless 16-bit "png[:level]" and "raw" (PGM) are allowed
+			void setLabelCodec(const std::string &codec);
 
 			virtual inline void setInput(const std::string &input);
 			virtual void segment();
@@ -33,6 +90,12 @@ namespace Superpixels
 
 	void ImageSegmenter::setRecursive(const bool recursive) { _recursive = recursive; }
 	void ImageSegmenter::setExtension(const std::string &ext) { _ext = ext; }
+	void ImageSegmenter::setManifest(const std::string &manifest_path) { _manifest_path = manifest_path; }
+	void ImageSegmenter::setScanThreads(const size_t scan_threads) { _scan_threads = scan_threads; }
+	void ImageSegmenter::setJournal(const std::string &journal_path) { _journal_path = journal_path; }
+	void ImageSegmenter::setCacheDirectory(const std::string &cache_dir) { _cache_dir = cache_dir; }
+	void ImageSegmenter::setWriterThreads(const size_t writer_threads) { _writer_threads = writer_threads; }
+	void ImageSegmenter::setWriterQueue(const size_t writer_queue) { _writer_queue = writer_queue; }
 	
 	void ImageSegmenter::setInput(const std::string &input) { _input_path = input; }
 
@@ -0,0 +1,255 @@
+#include "job_runner.h"
+
+#include "util.h"
+#include "image_header.h"
+
+#include "../gSLICr/NVTimer.h"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace Superpixels
+{
+	namespace
+	{
+		// Relative paths of a manifest are relative to its directory
+		const std::string resolvePath(const std::string &path, const std::string &manifest_dir)
+		{
+			if (path.empty() || boost::filesystem::path(path).is_absolute()) { return path; }
+			return Util::Files::joinPathAndFile(manifest_dir, path);
+		}
+	}
+
+
+	//////////////////
+	// MANIFEST JOB //
+	//////////////////
+
+	ManifestJob::ManifestJob(const SLICSettings &settings, EnginePool &engines, OutputWriter &writer) :
+		Segmenter(settings),
+		_engines(engines),
+		_writer(writer)
+		{}
+
+	bool ManifestJob::probeImageSize()
+	{
+		int width = 0;
+		int height = 0;
+		_size_known = Util::Images::readImageSize(_input_path, width, height);
+		if (_size_known)
+		{
+			resolveImageSize(width, height);
+		}
+		return _size_known;
+	}
+
+	void ManifestJob::segment()
+	{
+		// The decoded size has the last word (e.g. over an EXIF rotation)
+		cv::Mat old_frame = read_image(_input_path);
+		if (!old_frame.data) { EXCEPTION_THROWER(Util::Exception::IOException, "Error loading image '" + _input_path + "'") }
+		cv::Size s(_settings.img_size.x, _settings.img_size.y);
+
+		// Consecutive jobs of a bucket get the same engine back, already at their (letterboxed) size
+		const uint64_t profile_key = engineProfileKey();
+		gSLICr::objects::settings engine_settings = _settings;
+		engine_settings.img_size = inputSize();
+		std::unique_ptr<PooledEngine> pooled = _engines.acquire(profile_key, engine_settings);
+		cv::Mat viz(s, CV_8UC3);
+		cv::Mat labels;
+		try
+		{
+			ingest_image(old_frame, &pooled->in_img);
+			old_frame.release();
+			pooled->engine.Process_Frame(&pooled->in_img, _settings.img_size);
+
+			// Draw on a host copy of the input
+			std::unique_ptr<gSLICr::UChar4Image> out_seg(new gSLICr::UChar4Image(engine_settings.img_size, true, _settings.device_type == gSLICr::DEVICE_GPU));
+			pooled->engine.Draw_Segmentation_Result(out_seg.get());
+			load_image(out_seg.get(), viz);
+			load_labels(pooled->engine.Get_Seg_Res(), labels);
+		}
+		catch (...)
+		{
+			_engines.release(profile_key, std::move(pooled));
+			throw;
+		}
+		_engines.release(profile_key, std::move(pooled));
+
+		const std::string full_out_path = Util::Files::joinPathAndFile(_output_root, Util::Files::getFilenameFromPath(_input_path));
+		std::vector<OutputWriter::Job> jobs(2);
+		jobs[0].path = full_out_path + ".viz" + _viz_codec.extension(3);
+		jobs[0].image = viz;
+		jobs[0].codec = _viz_codec;
+		jobs[1].path = full_out_path + ".slic" + _label_codec.extension(1);
+		jobs[1].image = labels;
+		jobs[1].codec = _label_codec;
+		_writer.submit(std::move(jobs));
+	}
+
+
+	////////////////
+	// JOB RUNNER //
+	////////////////
+
+	JobRunner::JobRunner(const SuperpixelUserOptions &defaults) :
+		_defaults(defaults)
+		{}
+
+	void JobRunner::setVizCodec(const std::string &codec) { _viz_codec = ImageCodec::parse(codec); }
+
+	void JobRunner::setLabelCodec(const std::string &codec)
+	{
+		const ImageCodec label_codec = ImageCodec::parse(codec);
+		if (!label_codec.keeps16Bit())
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Labels need a lossless 16-bit codec (png or raw), got '" + codec + "'")
+		}
+		_label_codec = label_codec;
+	}
+
+	std::unique_ptr<ManifestJob> JobRunner::parseJob(const std::string &line, const std::string &manifest_dir, OutputWriter &writer)
+	{
+		boost::property_tree::ptree fields;
+		std::istringstream in(line);
+		boost::property_tree::read_json(in, fields);
+
+		const std::string input_path = resolvePath(fields.get<std::string>("input", ""), manifest_dir);
+		if (input_path.empty()) { EXCEPTION_THROWER(Util::Exception::IOException, "Job has no input") }
+		const std::string output_path = fields.count("output")
+			? resolvePath(fields.get<std::string>("output"), manifest_dir)
+			: _defaults.output_path;
+		if (output_path.empty()) { EXCEPTION_THROWER(Util::Exception::IOException, "Job has no output and there is no default output_path") }
+
+		// JSON values arrive as text, flags as true/false
+		SuperpixelUserOptions options = _defaults;
+		if (boost::optional<boost::property_tree::ptree &> settings = fields.get_child_optional("settings"))
+		{
+			for (const auto &setting : *settings)
+			{
+				if (!setting.second.empty()) { EXCEPTION_THROWER(Util::Exception::IOException, "Setting '" + setting.first + "' must be a number, string or boolean") }
+
+				std::string value = setting.second.data();
+				if (value == "true") { value = "1"; }
+				else if (value == "false") { value = "0"; }
+				applySetting(options, setting.first, value);
+			}
+		}
+
+		std::unique_ptr<ManifestJob> job(new ManifestJob(SLICSettings(options), _engines, writer));
+		if (options.use_scale)
+		{
+			job->setScale(options.scale);
+		}
+		else
+		{
+			job->setMaxSidelen(options.max_sidelen);
+		}
+		job->setLetterboxStep(options.letterbox_step);
+		job->setInput(input_path);
+		job->setOutputDirectory(output_path);
+		job->setCodecs(_viz_codec, _label_codec);
+		return job;
+	}
+
+	void JobRunner::run(const std::string &manifest_path)
+	{
+		std::ifstream manifest(manifest_path.c_str());
+		if (!manifest) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not open job manifest '" + manifest_path + "'") }
+		const std::string manifest_dir = Util::Files::getBasePathFromPath(manifest_path);
+
+		// Declared first, so that it outlives the jobs
+		OutputWriter writer(_writer_threads, _writer_queue);
+
+		std::vector<std::unique_ptr<ManifestJob> > jobs;
+		std::string line;
+		size_t line_number = 0;
+		while (std::getline(manifest, line))
+		{
+			line_number++;
+			if (line.find_first_not_of(" \t\r") == std::string::npos) { continue; }
+			try
+			{
+				jobs.push_back(parseJob(line, manifest_dir, writer));
+				jobs.back()->probeImageSize();
+			}
+			catch (const std::exception &error)
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, manifest_path + ":" + std::to_string(line_number) + ": " + error.what())
+			}
+		}
+
+		// Bucket by engine profile, then by input size, sizes only known once decoded last
+		typedef std::tuple<uint64_t, bool, int, int> BucketKey;
+		auto bucketKey = [&jobs](const size_t i)
+		{
+			const ManifestJob &job = *jobs[i];
+			const bool known = job.sizeKnown();
+			return BucketKey(job.profileKey(), !known, known ? job.inputShape().x : 0, known ? job.inputShape().y : 0);
+		};
+		std::vector<size_t> order(jobs.size());
+		for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+		std::stable_sort(order.begin(), order.end(), [&bucketKey](const size_t a, const size_t b) { return bucketKey(a) < bucketKey(b); });
+
+		StopWatchInterface *my_timer;
+		sdkCreateTimer(&my_timer);
+		size_t num_buckets = 0;
+		BucketKey last_key;
+		for (size_t n = 0; n < order.size(); n++)
+		{
+			const size_t i = order[n];
+			const BucketKey key = bucketKey(i);
+			if (n == 0 || key != last_key)
+			{
+				last_key = key;
+				num_buckets++;
+				if (_verbose && jobs[i]->sizeKnown())
+				{
+					std::cout << "Bucket " << num_buckets << ": " << jobs[i]->inputShape().x << "x" << jobs[i]->inputShape().y << std::endl;
+				}
+				else if (_verbose)
+				{
+					std::cout << "Bucket " << num_buckets << ": sizes unknown until decoded" << std::endl;
+				}
+			}
+			if (_verbose)
+			{
+				std::cout << "\tSegmenting image: '" << jobs[i]->inputPath() << "'" << std::endl;
+			}
+
+			sdkResetTimer(&my_timer);
+			sdkStartTimer(&my_timer);
+			jobs[i]->segment();
+			sdkStopTimer(&my_timer);
+			if (!_verbose)
+			{
+				std::cout << "\rJob " << n + 1 << "/" << order.size() << " in:[" << sdkGetTimerValue(&my_timer) << "]ms" << std::flush;
+			}
+
+			// The outputs hold their own copy of the results
+			jobs[i].reset();
+		}
+		sdkDeleteTimer(&my_timer);
+		writer.flush();
+
+		if (_verbose)
+		{
+			std::cout << "Ran " << order.size() << " jobs in " << num_buckets << " buckets on "
+				<< _engines.numEngines() << " engines" << std::endl;
+		}
+	}
+
+} // namespace Superpixels
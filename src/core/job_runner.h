@@ -0,0 +1,125 @@
+#ifndef SUPERPIXELS_SRC_CORE_JOB_RUNNER_H_
+#define SUPERPIXELS_SRC_CORE_JOB_RUNNER_H_
+
+#include "segmenter.h"
+#include "options.h"
+#include "engine_pool.h"
+#include "output_writer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Superpixels
+{
+
+	/**
+	 * One image of a job manifest with its own settings. Its engine is taken
+	 * from the runner's EnginePool and its outputs are queued on the runner's
+	 * OutputWriter.
+	 */
+	class ManifestJob : public Segmenter
+	{
+
+		private:
+			EnginePool &_engines;
+			OutputWriter &_writer;
+			ImageCodec _viz_codec;
+			ImageCodec _label_codec;
+			bool _size_known = false;
+
+		public:
+			ManifestJob(const SLICSettings &settings, EnginePool &engines, OutputWriter &writer);
+
+			inline void setCodecs(const ImageCodec &viz_codec, const ImageCodec &label_codec);
+
+			/**
+			 * Resolve the engine image size from the image header
+			 *
+			 * @return True if the size is known, False if it needs the decoded image
+			 */
+			bool probeImageSize();
+
+			inline bool sizeKnown() const;
+			// Size of the engine input, letterboxed (see Segmenter::setLetterboxStep)
+			inline gSLICr::Vector2i inputShape() const;
+			inline uint64_t profileKey() const;
+			inline const std::string &inputPath() const;
+
+			virtual inline void setInput(const std::string &input_path);
+			virtual void segment();
+	};
+
+	void ManifestJob::setCodecs(const ImageCodec &viz_codec, const ImageCodec &label_codec)
+	{
+		_viz_codec = viz_codec;
+		_label_codec = label_codec;
+	}
+	bool ManifestJob::sizeKnown() const { return _size_known; }
+	gSLICr::Vector2i ManifestJob::inputShape() const { return inputSize(); }
+	uint64_t ManifestJob::profileKey() const { return engineProfileKey(); }
+	const std::string &ManifestJob::inputPath() const { return _input_path; }
+	void ManifestJob::setInput(const std::string &input_path) { _input_path = input_path; }
+
+
+	/**
+	 * Runs a manifest of jobs with heterogeneous settings in one process.
+	 *
+	 * The manifest is a JSON-lines file, one job per line:
+	 *
+	 *   {"input": "a.jpg", "output": "out/a", "settings": {"spixel_size": 32, "max_sidelen": 640}}
+	 *
+	 * Settings are the command line SLIC options (as in the server requests)
+	 * and override the runner defaults for that job only. The output is the
+	 * directory the outputs of the job are written to, the runner's default
+	 * output directory when left out. Relative paths are resolved against the
+	 * directory of the manifest.
+	 *
+	 * Jobs are bucketed by engine profile and resolved image size (read from
+	 * the image headers) and the buckets run one after the other, so every
+	 * profile builds one engine that only reshapes between buckets. Jobs whose
+	 * size can not be read without decoding run last in their profile. With
+	 * a letterbox_step, the sizes are padded up to multiples of it and images
+	 * of mixed aspect ratios fall into a few shared buckets.
+	 *
+	 * NOTE: Jobs do not run in manifest order.
+	 */
+	class JobRunner
+	{
+
+		private:
+			SuperpixelUserOptions _defaults;
+			bool _verbose = false;
+			ImageCodec _viz_codec = ImageCodec::parse("png");
+			ImageCodec _label_codec = ImageCodec::parse("raw");
+			size_t _writer_threads = 2;
+			size_t _writer_queue = 16;
+			EnginePool _engines;
+
+			std::unique_ptr<ManifestJob> parseJob(const std::string &line, const std::string &manifest_dir, OutputWriter &writer);
+
+		public:
+			JobRunner(const SuperpixelUserOptions &defaults);
+
+			inline void setVerbose(const bool verbose);
+			inline void setWriterThreads(const size_t writer_threads);
+			inline void setWriterQueue(const size_t writer_queue);
+			inline void setMaxEngines(const size_t max_engines);
+
+			// Codecs of the outputs of every job (see ImageSegmenter)
+			void setVizCodec(const std::string &codec);
+			void setLabelCodec(const std::string &codec);
+
+			// Run every job of a JSON-lines manifest
+			void run(const std::string &manifest_path);
+	};
+
+	void JobRunner::setVerbose(const bool verbose) { _verbose = verbose; }
+	void JobRunner::setWriterThreads(const size_t writer_threads) { _writer_threads = writer_threads; }
+	void JobRunner::setWriterQueue(const size_t writer_queue) { _writer_queue = writer_queue; }
+	void JobRunner::setMaxEngines(const size_t max_engines) { _engines.setMaxEngines(max_engines); }
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_JOB_RUNNER_H_
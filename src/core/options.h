@@ -1,6 +1,9 @@
 #ifndef SUPERPIXELS_SRC_CORE_OPTIONS_H_
 #define SUPERPIXELS_SRC_CORE_OPTIONS_H_
 
+#include "util.h"
+
+#include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
 
 #include <string>
@@ -15,10 +18,18 @@ namespace Superpixels
 		int num_segs = 128;
 		int spixel_size = 256;
 		float coh_weight = 0.6f;
-		int num_iters = 6;
+		int num_iters = 5;
 		std::string color_space = "XYZ";
 		std::string seg_method = "GIVEN_SIZE";
 		bool no_enforce_connectivity = false;
+		int pyramid_levels = 0;
+		int refine_iters = 2;
+		int band_width = 0;
+		int band_after_iters = 0;
+		bool low_gradient_init = false;
+		bool dense_labels = false;
+		std::string device = "GPU";
+		std::string cpu_isa = "auto";
 
 		// Interface options
 		std::string input_path;
@@ -26,19 +37,80 @@ namespace Superpixels
 		double scale = 1.0;
 		double max_sidelen = 480.0;
 		bool use_scale = true;
+		int letterbox_step = 0;
 		bool verbose = false;
 
 		// Unique for video
 		double sampling_rate = 1.0;
+		std::string video_output = "frames";
+		std::string video_codec = "MJPG";
 
 		// Unique for images
 		std::string ext;
 		bool recursive = false;
 		bool large_scale = false;
+		std::string manifest;
+		int scan_threads = 4;
+		std::string journal;
+		std::string cache_dir;
+		int host_pool_mb = 512;
+		int max_engines = 8;
+		std::string viz_codec = "png";
+		std::string label_codec = "raw";
+		int writer_threads = 2;
+		int writer_queue = 16;
+
+		// Unique for streams
+		int frame_width = 0;
+		int frame_height = 0;
+		std::string pixel_format = "bgr24";
+
+		// Unique for the server
+		std::string socket_path;
+		int max_clients = 32;
+
+		// Unique for the job runner
+		std::string jobs_path;
 
 	};
 
 
+	// Override one SLIC option by its command line name
+	inline void applySetting(SuperpixelUserOptions &options, const std::string &key, const std::string &value)
+	{
+		if (key == "num_segs") { options.num_segs = boost::lexical_cast<int>(value); }
+		else if (key == "spixel_size") { options.spixel_size = boost::lexical_cast<int>(value); }
+		else if (key == "coh_weight") { options.coh_weight = boost::lexical_cast<float>(value); }
+		else if (key == "num_iters") { options.num_iters = boost::lexical_cast<int>(value); }
+		else if (key == "color_space") { options.color_space = value; }
+		else if (key == "seg_method") { options.seg_method = value; }
+		else if (key == "no_enforce") { options.no_enforce_connectivity = boost::lexical_cast<bool>(value); }
+		else if (key == "pyramid_levels") { options.pyramid_levels = boost::lexical_cast<int>(value); }
+		else if (key == "refine_iters") { options.refine_iters = boost::lexical_cast<int>(value); }
+		else if (key == "band_width") { options.band_width = boost::lexical_cast<int>(value); }
+		else if (key == "band_after_iters") { options.band_after_iters = boost::lexical_cast<int>(value); }
+		else if (key == "low_gradient_init") { options.low_gradient_init = boost::lexical_cast<bool>(value); }
+		else if (key == "dense_labels") { options.dense_labels = boost::lexical_cast<bool>(value); }
+		else if (key == "device") { options.device = value; }
+		else if (key == "cpu_isa") { options.cpu_isa = value; }
+		else if (key == "scale")
+		{
+			options.scale = boost::lexical_cast<double>(value);
+			options.use_scale = true;
+		}
+		else if (key == "max_sidelen")
+		{
+			options.max_sidelen = boost::lexical_cast<double>(value);
+			options.use_scale = false;
+		}
+		else if (key == "letterbox_step") { options.letterbox_step = boost::lexical_cast<int>(value); }
+		else
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Unknown setting '" + key + "'")
+		}
+	}
+
+
 	// From https://stackoverflow.com/a/21914921/3427580
 	inline void conflicting_options(const boost::program_options::variables_map & vm,
 		const std::string & opt1, const std::string & opt2)
@@ -52,6 +124,43 @@ namespace Superpixels
 	}
 
 
+	// The SLIC options shared by every command line, their defaults are the
+	// values input_options holds (see SuperpixelUserOptions)
+	inline void addSLICOptions(boost::program_options::options_description &opt, SuperpixelUserOptions &input_options)
+	{
+		opt.add_options()
+			("coh_weight", boost::program_options::value<float>(&input_options.coh_weight)->default_value(input_options.coh_weight),"Color cohesion weight")
+			("color_space", boost::program_options::value<std::string>(&input_options.color_space)->default_value(input_options.color_space),
+				"'XYZ', 'RGB', or 'CIELAB'. Color space in which to perform clustering")
+			("no_enforce", boost::program_options::bool_switch(&input_options.no_enforce_connectivity), 
+				"Flag disables enforcement of superpixel connectivity")
+			("num_iters", boost::program_options::value<int>(&input_options.num_iters)->default_value(input_options.num_iters),"Number of clustering iterations")
+			("num_segs", boost::program_options::value<int>(&input_options.num_segs)->default_value(input_options.num_segs),
+				"Number of superpixels to segment image into. Used with seg_method = GIVEN_NUM.")
+			("seg_method", boost::program_options::value<std::string>(&input_options.seg_method)->default_value(input_options.seg_method),
+				"'GIVEN_SIZE' or 'GIVEN_NUM'. SLIC Segmentation constraint (size of superpixel or total number of them)")
+			("spixel_size", boost::program_options::value<int>(&input_options.spixel_size)->default_value(input_options.spixel_size),
+				"Size of superpixels in pixels. Used with seg_method = GIVEN_SIZE.")
+			("pyramid_levels", boost::program_options::value<int>(&input_options.pyramid_levels)->default_value(input_options.pyramid_levels),
+				"Coarse-to-fine mode: cluster on an image downsampled this many times by 2, then refine at full resolution (0 disables)")
+			("refine_iters", boost::program_options::value<int>(&input_options.refine_iters)->default_value(input_options.refine_iters),
+				"Number of full resolution refinement iterations in coarse-to-fine mode")
+			("band_width", boost::program_options::value<int>(&input_options.band_width)->default_value(input_options.band_width),
+				"Distance (in pixels) from a superpixel boundary within which refinement re-evaluates pixels (0 for automatic)")
+			("band_after_iters", boost::program_options::value<int>(&input_options.band_after_iters)->default_value(input_options.band_after_iters),
+				"Number of full iterations after which only pixels near superpixel boundaries are re-evaluated (0 disables). "
+				"On the GPU the results then vary slightly from run to run")
+			("low_gradient_init", boost::program_options::bool_switch(&input_options.low_gradient_init),
+				"Move the initial superpixel centers to the lowest color gradient of their 3x3 neighborhood (usually needs fewer iterations)")
+			("dense_labels", boost::program_options::bool_switch(&input_options.dense_labels),
+				"Renumber the labels to 0..K-1 in raster order of their first pixel")
+			("device", boost::program_options::value<std::string>(&input_options.device)->default_value(input_options.device),
+				"Where to run the segmentation: GPU or CPU (multi-threaded, same labels for any number of threads)")
+			("cpu_isa", boost::program_options::value<std::string>(&input_options.cpu_isa)->default_value(input_options.cpu_isa),
+				"Instruction set of the CPU kernels: auto, scalar, sse4.2, avx2, avx512 or neon. All give the same labels.");
+	}
+
+
 	inline int parseVideoSegmenterCommandLine(int argc, char **argv, SuperpixelUserOptions &input_options)
 	{
 		boost::program_options::options_description req("Required inputs");
@@ -65,20 +174,15 @@ namespace Superpixels
 		boost::program_options::options_description opt("Optional inputs");
 		opt.add_options()
 			("help", "Print help info")
+			("video_output", boost::program_options::value<std::string>(&input_options.video_output)->default_value("frames"),
+				"'frames' writes a visualization PNG, a PGM label map and a superpixel TXT per sampled frame. 'video' (viz.avi) or 'y4m' (viz.y4m) "
+				"encode the visualizations to one stream and all label maps to labels.slcf (frame records as written by slic_stream_segmenter, then a frame index)")
+			("video_codec", boost::program_options::value<std::string>(&input_options.video_codec)->default_value("MJPG"),
+				"FourCC of the codec used for viz.avi with --video_output video")
 			("scale", boost::program_options::value<double>(&input_options.scale),"Scale to resize the images")
-			("max_sidelen", boost::program_options::value<double>(&input_options.max_sidelen),"Maximum side-length to resize the images to (preserving aspect ratio")
-			("coh_weight", boost::program_options::value<float>(&input_options.coh_weight)->default_value(0.6),"Color cohesion weight")
-			("color_space", boost::program_options::value<std::string>(&input_options.color_space)->default_value("XYZ"),
-				"'XYZ', 'RGB', or 'CIELAB'. Color space in which to perform clustering")
-			("no_enforce", boost::program_options::bool_switch(&input_options.no_enforce_connectivity), 
-				"Flag disables enforcement of superpixel connectivity")
-			("num_iters", boost::program_options::value<int>(&input_options.num_iters)->default_value(5),"Number of clustering iterations")
-			("num_segs", boost::program_options::value<int>(&input_options.num_segs)->default_value(128),
-				"Number of superpixels to segment image into. Used with seg_method = GIVEN_NUM.")
-			("seg_method", boost::program_options::value<std::string>(&input_options.seg_method)->default_value("GIVEN_SIZE"),
-				"'GIVEN_SIZE' or 'GIVEN_NUM'. SLIC Segmentation constraint (size of superpixel or total number of them)")
-			("spixel_size", boost::program_options::value<int>(&input_options.spixel_size)->default_value(256),
-				"Size of superpixels in pixels. Used with seg_method = GIVEN_SIZE.")
+			("max_sidelen", boost::program_options::value<double>(&input_options.max_sidelen),"Maximum side-length to resize the images to (preserving aspect ratio");
+		addSLICOptions(opt, input_options);
+		opt.add_options()
 			("verbose", boost::program_options::bool_switch(&input_options.verbose)->default_value(false), "Verbosity");
 
 
@@ -145,22 +249,33 @@ namespace Superpixels
 			("help", "Print help info")
 			("scale", boost::program_options::value<double>(&input_options.scale),"Scale to resize the images")
 			("max_sidelen", boost::program_options::value<double>(&input_options.max_sidelen),"Maximum side-length to resize the images to (preserving aspect ratio")
+			("letterbox_step", boost::program_options::value<int>(&input_options.letterbox_step)->default_value(0),
+				"Pad the resized images up to a multiple of this many pixels per side, so images of nearby sizes share one engine shape. "
+				"The padding is left out of the segmentation and cropped from the outputs (0 disables it)")
 			("recursive", boost::program_options::bool_switch(&input_options.recursive), 
-				"Simple recursion into subdirectorys to load images (loads all paths into memory)")
+				"Simple recursion into subdirectorys to load images")
 			("large_scale", boost::program_options::bool_switch(&input_options.large_scale), 
 				"Faster recursion into subdirectorys to load images (for large-scale datasets)")
-			("coh_weight", boost::program_options::value<float>(&input_options.coh_weight)->default_value(0.6),"Color cohesion weight")
-			("color_space", boost::program_options::value<std::string>(&input_options.color_space)->default_value("XYZ"),
-				"'XYZ', 'RGB', or 'CIELAB'. Color space in which to perform clustering")
-			("no_enforce", boost::program_options::bool_switch(&input_options.no_enforce_connectivity), 
-				"Flag disables enforcement of superpixel connectivity")
-			("num_iters", boost::program_options::value<int>(&input_options.num_iters)->default_value(5),"Number of clustering iterations")
-			("num_segs", boost::program_options::value<int>(&input_options.num_segs)->default_value(128),
-				"Number of superpixels to segment image into. Used with seg_method = GIVEN_NUM.")
-			("seg_method", boost::program_options::value<std::string>(&input_options.seg_method)->default_value("GIVEN_SIZE"),
-				"'GIVEN_SIZE' or 'GIVEN_NUM'. SLIC Segmentation constraint (size of superpixel or total number of them)")
-			("spixel_size", boost::program_options::value<int>(&input_options.spixel_size)->default_value(256),
-				"Size of superpixels in pixels. Used with seg_method = GIVEN_SIZE.")
+			("manifest", boost::program_options::value<std::string>(&input_options.manifest),
+				"Text file listing the images to segment (one path per line, relative to input_path) instead of scanning input_path")
+			("scan_threads", boost::program_options::value<int>(&input_options.scan_threads)->default_value(4),
+				"Number of threads used to scan subdirectories for images")
+			("journal", boost::program_options::value<std::string>(&input_options.journal),
+				"Journal file recording finished images. Rerunning with the same journal skips them")
+			("cache_dir", boost::program_options::value<std::string>(&input_options.cache_dir),
+				"Directory of cached results. Images with identical (resized) pixels and settings are linked from it instead of segmented")
+			("host_pool_mb", boost::program_options::value<int>(&input_options.host_pool_mb)->default_value(512),
+				"Megabytes of freed host buffers kept for reuse by the next images (0 disables recycling)")
+			("viz_codec", boost::program_options::value<std::string>(&input_options.viz_codec)->default_value("png"),
+				"Format of the visualizations: 'png[:0-9]', 'jpeg[:0-100]', 'webp[:1-101]' or 'raw' (PPM). The number is the compression level or quality")
+			("label_codec", boost::program_options::value<std::string>(&input_options.label_codec)->default_value("raw"),
+				"Format of the 16-bit label images: 'raw' (PGM) or 'png[:0-9]'")
+			("writer_threads", boost::program_options::value<int>(&input_options.writer_threads)->default_value(2),
+				"Number of threads encoding and writing the outputs (0 writes them on the segmentation thread)")
+			("writer_queue", boost::program_options::value<int>(&input_options.writer_queue)->default_value(16),
+				"Maximum number of output images waiting to be written before segmentation pauses");
+		addSLICOptions(opt, input_options);
+		opt.add_options()
 			("verbose", boost::program_options::bool_switch(&input_options.verbose)->default_value(false), "Verbosity");
 
 
@@ -194,6 +309,261 @@ namespace Superpixels
 			// Try to assign input values to their mapped variables
 			// Throws exceptions if failure (wrong type, missing args, etc)
 			boost::program_options::notify(vm);
+
+			if (input_options.letterbox_step < 0)
+			{
+				std::cerr << "Error: letterbox_step cannot be negative" << std::endl;
+				return -1;
+			}
+
+			if (input_options.scan_threads < 1)
+			{
+				std::cerr << "Error: scan_threads must be at least 1" << std::endl;
+				return -1;
+			}
+		}
+		catch(std::exception& e)
+		{
+			std::cout << all << std::endl;
+			return -1;
+		}
+		catch(...)
+		{
+			std::cerr << "Exception of unknown type!" << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	inline int parseStreamSegmenterCommandLine(int argc, char **argv, SuperpixelUserOptions &input_options)
+	{
+		boost::program_options::options_description req("Required inputs");
+		req.add_options()
+			("width", boost::program_options::value<int>(&input_options.frame_width)->required(), "Width of the input frames")
+			("height", boost::program_options::value<int>(&input_options.frame_height)->required(), "Height of the input frames");
+
+		// Defines optional input option group  
+		boost::program_options::options_description opt("Optional inputs");
+		opt.add_options()
+			("help", "Print help info")
+			("input_path", boost::program_options::value<std::string>(&input_options.input_path)->default_value("-"),
+				"Pipe or file to read raw frames from ('-' for stdin)")
+			("output_path", boost::program_options::value<std::string>(&input_options.output_path)->default_value("-"),
+				"Pipe or file to write the segmented frames to ('-' for stdout)")
+			("pixel_format", boost::program_options::value<std::string>(&input_options.pixel_format)->default_value("bgr24"),
+				"'bgr24' or 'yuv420p' (planar I420). Pixel format of the input frames")
+			("scale", boost::program_options::value<double>(&input_options.scale),"Scale to resize the frames")
+			("max_sidelen", boost::program_options::value<double>(&input_options.max_sidelen),"Maximum side-length to resize the frames to (preserving aspect ratio");
+		addSLICOptions(opt, input_options);
+		opt.add_options()
+			("verbose", boost::program_options::bool_switch(&input_options.verbose)->default_value(false), "Verbosity (on stderr)");
+
+
+		// Creates a combined option group
+		boost::program_options::options_description all("Allowed inputs");
+		all.add(req).add(opt);
+
+		// stdout carries the segmentations, so usage goes to stderr
+		try
+		{
+			// Parse the inputs and map to their corresponding variables
+			boost::program_options::variables_map vm;
+			boost::program_options::store(boost::program_options::parse_command_line(argc, argv, all), vm);
+
+			// Handle mutually exlusive options
+			conflicting_options(vm, "scale", "max_sidelen");
+
+			if (vm.count("max_sidelen"))
+			{
+				input_options.use_scale = false;
+			}
+
+			// If help is input, print full usage
+			if (vm.count("help"))
+			{
+				std::cerr << all << std::endl;
+				return -1;
+			}
+
+			// Try to assign input values to their mapped variables
+			// Throws exceptions if failure (wrong type, missing args, etc)
+			boost::program_options::notify(vm);
+		}
+		catch(std::exception& e)
+		{
+			std::cerr << all << std::endl;
+			return -1;
+		}
+		catch(...)
+		{
+			std::cerr << "Exception of unknown type!" << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	inline int parseSegmentationServerCommandLine(int argc, char **argv, SuperpixelUserOptions &input_options)
+	{
+		boost::program_options::options_description req("Required inputs");
+		req.add_options()
+			("socket_path", boost::program_options::value<std::string>(&input_options.socket_path)->required(), "Unix domain socket to listen on");
+
+		// Defines optional input option group, the defaults of requests that do not override them
+		boost::program_options::options_description opt("Optional inputs (request defaults)");
+		opt.add_options()
+			("help", "Print help info")
+			("scale", boost::program_options::value<double>(&input_options.scale),"Scale to resize the images")
+			("max_sidelen", boost::program_options::value<double>(&input_options.max_sidelen),"Maximum side-length to resize the images to (preserving aspect ratio")
+			("letterbox_step", boost::program_options::value<int>(&input_options.letterbox_step)->default_value(0),
+				"Pad the resized images up to a multiple of this many pixels per side, so images of nearby sizes share one engine shape. "
+				"The padding is left out of the segmentation and cropped from the outputs (0 disables it)");
+		addSLICOptions(opt, input_options);
+		opt.add_options()
+			("max_clients", boost::program_options::value<int>(&input_options.max_clients)->default_value(32),
+				"Maximum number of connected clients, further connections are refused")
+			("max_engines", boost::program_options::value<int>(&input_options.max_engines)->default_value(8),
+				"Maximum number of warm engines kept across settings profiles, the least recently used idle one is freed first")
+			("verbose", boost::program_options::bool_switch(&input_options.verbose)->default_value(false), "Verbosity");
+
+
+		// Creates a combined option group
+		boost::program_options::options_description all("Allowed inputs");
+		all.add(req).add(opt);
+
+		try
+		{
+			// Parse the inputs and map to their corresponding variables
+			boost::program_options::variables_map vm;
+			boost::program_options::store(boost::program_options::parse_command_line(argc, argv, all), vm);
+
+			// Handle mutually exlusive options
+			conflicting_options(vm, "scale", "max_sidelen");
+
+			if (vm.count("max_sidelen"))
+			{
+				input_options.use_scale = false;
+			}
+
+			// If help is input, print full usage
+			if (vm.count("help"))
+			{
+				std::cout << all << std::endl;
+				return -1;
+			}
+
+			// Try to assign input values to their mapped variables
+			// Throws exceptions if failure (wrong type, missing args, etc)
+			boost::program_options::notify(vm);
+
+			if (input_options.letterbox_step < 0)
+			{
+				std::cerr << "Error: letterbox_step cannot be negative" << std::endl;
+				return -1;
+			}
+
+			if (input_options.max_clients < 1)
+			{
+				std::cerr << "Error: max_clients must be at least 1" << std::endl;
+				return -1;
+			}
+
+			if (input_options.max_engines < 1)
+			{
+				std::cerr << "Error: max_engines must be at least 1" << std::endl;
+				return -1;
+			}
+		}
+		catch(std::exception& e)
+		{
+			std::cout << all << std::endl;
+			return -1;
+		}
+		catch(...)
+		{
+			std::cerr << "Exception of unknown type!" << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	inline int parseJobRunnerCommandLine(int argc, char **argv, SuperpixelUserOptions &input_options)
+	{
+		boost::program_options::options_description req("Required inputs");
+		req.add_options()
+			("jobs", boost::program_options::value<std::string>(&input_options.jobs_path)->required(),
+				"JSON-lines job manifest, one {\"input\": ..., \"output\": ..., \"settings\": {...}} object per line");
+
+		// Defines optional input option group, the defaults of jobs that do not override them
+		boost::program_options::options_description opt("Optional inputs (job defaults)");
+		opt.add_options()
+			("help", "Print help info")
+			("output_path", boost::program_options::value<std::string>(&input_options.output_path),
+				"Directory to save the segmentations of jobs without an output")
+			("scale", boost::program_options::value<double>(&input_options.scale),"Scale to resize the images")
+			("max_sidelen", boost::program_options::value<double>(&input_options.max_sidelen),"Maximum side-length to resize the images to (preserving aspect ratio")
+			("letterbox_step", boost::program_options::value<int>(&input_options.letterbox_step)->default_value(0),
+				"Pad the resized images up to a multiple of this many pixels per side, so images of nearby sizes share one engine shape. "
+				"The padding is left out of the segmentation and cropped from the outputs (0 disables it)")
+			("viz_codec", boost::program_options::value<std::string>(&input_options.viz_codec)->default_value("png"),
+				"Format of the visualizations: 'png[:0-9]', 'jpeg[:0-100]', 'webp[:1-101]' or 'raw' (PPM). The number is the compression level or quality")
+			("label_codec", boost::program_options::value<std::string>(&input_options.label_codec)->default_value("raw"),
+				"Format of the 16-bit label images: 'raw' (PGM) or 'png[:0-9]'")
+			("writer_threads", boost::program_options::value<int>(&input_options.writer_threads)->default_value(2),
+				"Number of threads encoding and writing the outputs (0 writes them on the segmentation thread)")
+			("writer_queue", boost::program_options::value<int>(&input_options.writer_queue)->default_value(16),
+				"Maximum number of output images waiting to be written before segmentation pauses")
+			("host_pool_mb", boost::program_options::value<int>(&input_options.host_pool_mb)->default_value(512),
+				"Megabytes of freed host buffers kept for reuse by the next images (0 disables recycling)")
+			("max_engines", boost::program_options::value<int>(&input_options.max_engines)->default_value(8),
+				"Maximum number of warm engines kept across settings profiles, the least recently used idle one is freed first");
+		addSLICOptions(opt, input_options);
+		opt.add_options()
+			("verbose", boost::program_options::bool_switch(&input_options.verbose)->default_value(false), "Verbosity");
+
+
+		// Creates a combined option group
+		boost::program_options::options_description all("Allowed inputs");
+		all.add(req).add(opt);
+
+		try
+		{
+			// Parse the inputs and map to their corresponding variables
+			boost::program_options::variables_map vm;
+			boost::program_options::store(boost::program_options::parse_command_line(argc, argv, all), vm);
+
+			// Handle mutually exlusive options
+			conflicting_options(vm, "scale", "max_sidelen");
+
+			if (vm.count("max_sidelen"))
+			{
+				input_options.use_scale = false;
+			}
+
+			// If help is input, print full usage
+			if (vm.count("help"))
+			{
+				std::cout << all << std::endl;
+				return -1;
+			}
+
+			// Try to assign input values to their mapped variables
+			// Throws exceptions if failure (wrong type, missing args, etc)
+			boost::program_options::notify(vm);
+
+			if (input_options.letterbox_step < 0)
+			{
+				std::cerr << "Error: letterbox_step cannot be negative" << std::endl;
+				return -1;
+			}
+
+			if (input_options.max_engines < 1)
+			{
+				std::cerr << "Error: max_engines must be at least 1" << std::endl;
+				return -1;
+			}
 		}
 		catch(std::exception& e)
 		{
@@ -0,0 +1,291 @@
+#include "output_writer.h"
+
+#include "hash.h"
+#include "util.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Superpixels
+{
+	ImageCodec ImageCodec::parse(const std::string &spec)
+	{
+		ImageCodec codec;
+		const size_t colon = spec.find(':');
+		const std::string name = spec.substr(0, colon);
+
+		int min_level = 0;
+		int max_level = 0;
+		if (name == "png") { codec.type = PNG; max_level = 9; }
+		else if (name == "jpeg" || name == "jpg") { codec.type = JPEG; max_level = 100; }
+		else if (name == "webp") { codec.type = WEBP; min_level = 1; max_level = 101; }
+		else if (name == "raw") { codec.type = RAW; }
+		else
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Unknown image codec '" + spec + "' (use png, jpeg, webp or raw)")
+		}
+
+		if (colon != std::string::npos)
+		{
+			const std::string level = spec.substr(colon + 1);
+			char *end = nullptr;
+			codec.level = (int)std::strtol(level.c_str(), &end, 10);
+			if (codec.type == RAW || level.empty() || *end != '\0' || codec.level < min_level || codec.level > max_level)
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, "Invalid level in image codec '" + spec + "'")
+			}
+		}
+		return codec;
+	}
+
+	const std::string ImageCodec::extension(const int channels) const
+	{
+		switch (type)
+		{
+			case PNG: return ".png";
+			case JPEG: return ".jpg";
+			case WEBP: return ".webp";
+			default: return channels == 1 ? ".pgm" : ".ppm";
+		}
+	}
+
+	const std::vector<int> ImageCodec::params() const
+	{
+		std::vector<int> params;
+		if (level < 0) { return params; }
+
+		switch (type)
+		{
+			case PNG: params.push_back(cv::IMWRITE_PNG_COMPRESSION); break;
+			case JPEG: params.push_back(cv::IMWRITE_JPEG_QUALITY); break;
+			case WEBP: params.push_back(cv::IMWRITE_WEBP_QUALITY); break;
+			default: return params;
+		}
+		params.push_back(level);
+		return params;
+	}
+
+	const std::string ImageCodec::toString() const
+	{
+		static const char *NAMES[] = { "png", "jpeg", "webp", "raw" };
+		std::string spec = NAMES[type];
+		if (level >= 0) { spec += ":" + std::to_string(level); }
+		return spec;
+	}
+
+	void OutputWriter::write(const Job &job)
+	{
+		// A name unique to the process and thread, keeping the extension cv::imwrite picks the format by
+		const boost::filesystem::path output(job.path);
+		const boost::filesystem::path tmp_path = output.parent_path() / ("." + output.stem().string() + ".tmp" + std::to_string(getpid()) + "-" +
+			Util::Hash::toHex(std::hash<std::thread::id>()(std::this_thread::get_id())) + output.extension().string());
+
+		boost::system::error_code ec;
+		try
+		{
+			encode(job, tmp_path.string());
+		}
+		catch (...)
+		{
+			boost::filesystem::remove(tmp_path, ec);
+			throw;
+		}
+
+		boost::filesystem::rename(tmp_path, output, ec);
+		if (ec)
+		{
+			boost::filesystem::remove(tmp_path, ec);
+			EXCEPTION_THROWER(Util::Exception::IOException, "Error writing '" + job.path + "'")
+		}
+	}
+
+	void OutputWriter::encode(const Job &job, const std::string &path)
+	{
+		if (job.codec.type != ImageCodec::RAW)
+		{
+			if (!cv::imwrite(path, job.image, job.codec.params()))
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, "Error writing '" + job.path + "'")
+			}
+			return;
+		}
+
+		// Binary PNM, 16-bit samples are big-endian
+		const cv::Mat &image = job.image;
+		const int channels = image.channels();
+		const bool wide = image.depth() == CV_16U;
+		std::vector<unsigned char> row(image.cols * channels * (wide ? 2 : 1));
+
+		std::ofstream f(path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		f << (channels == 1 ? "P5\n" : "P6\n") << image.cols << " " << image.rows << "\n" << (wide ? 65535 : 255) << "\n";
+		for (int y = 0; y < image.rows; y++)
+		{
+			if (wide)
+			{
+				const unsigned short *src = image.ptr<unsigned short>(y);
+				for (int i = 0; i < image.cols; i++)
+				{
+					row[2 * i] = (unsigned char)(src[i] >> 8);
+					row[2 * i + 1] = (unsigned char)(src[i] & 0xff);
+				}
+			}
+			else if (channels == 3)
+			{
+				// BGR to RGB
+				const unsigned char *src = image.ptr<unsigned char>(y);
+				for (int i = 0; i < 3 * image.cols; i += 3)
+				{
+					row[i] = src[i + 2];
+					row[i + 1] = src[i + 1];
+					row[i + 2] = src[i];
+				}
+			}
+			else
+			{
+				const unsigned char *src = image.ptr<unsigned char>(y);
+				std::copy(src, src + image.cols, row.begin());
+			}
+			f.write((const char*)row.data(), row.size());
+		}
+		f.close();
+		if (!f)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Error writing '" + job.path + "'")
+		}
+	}
+
+	OutputWriter::OutputWriter(const size_t num_threads, const size_t queue_capacity) :
+		_queue(queue_capacity > 0 ? queue_capacity : 1)
+	{
+		for (size_t i = 0; i < num_threads; i++)
+		{
+			_workers.emplace_back(&OutputWriter::worker, this);
+		}
+	}
+
+	OutputWriter::~OutputWriter()
+	{
+		_queue.close();
+		for (auto &worker : _workers)
+		{
+			worker.join();
+		}
+	}
+
+	void OutputWriter::submit(std::vector<Job> jobs, std::function<void()> on_written)
+	{
+		rethrowError();
+
+		// Without workers (or outputs) everything happens right here
+		if (_workers.empty() || jobs.empty())
+		{
+			for (const auto &job : jobs)
+			{
+				write(job);
+			}
+			if (on_written) { on_written(); }
+			return;
+		}
+
+		std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+		batch->remaining = jobs.size();
+		batch->on_written = std::move(on_written);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_pending += jobs.size();
+		}
+
+		for (auto &job : jobs)
+		{
+			QueuedJob queued;
+			queued.job = std::move(job);
+			queued.batch = batch;
+			_queue.push(std::move(queued));
+		}
+	}
+
+	void OutputWriter::flush()
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_idle.wait(lock, [this]{ return _pending == 0; });
+		}
+		rethrowError();
+	}
+
+	void OutputWriter::worker()
+	{
+		QueuedJob queued;
+		while (_queue.pop(queued))
+		{
+			std::exception_ptr error;
+			try
+			{
+				write(queued.job);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			// Release the image before waiting for the next job
+			queued.job.image.release();
+			finishJob(queued.batch, error);
+			queued.batch.reset();
+		}
+	}
+
+	void OutputWriter::finishJob(const std::shared_ptr<Batch> &batch, const std::exception_ptr &error)
+	{
+		std::function<void()> on_written;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (error)
+			{
+				batch->failed = true;
+				if (!_error) { _error = error; }
+			}
+			if (--batch->remaining == 0 && !batch->failed)
+			{
+				on_written = std::move(batch->on_written);
+			}
+		}
+
+		if (on_written)
+		{
+			try
+			{
+				on_written();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_error) { _error = std::current_exception(); }
+			}
+		}
+
+		// Only idle once the callback is done, flush() waits for it too
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_pending == 0) { _idle.notify_all(); }
+	}
+
+	void OutputWriter::rethrowError()
+	{
+		std::exception_ptr error;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::swap(error, _error);
+		}
+		if (error) { std::rethrow_exception(error); }
+	}
+
+} // namespace Superpixels
@@ -0,0 +1,134 @@
+#ifndef SUPERPIXELS_SRC_CORE_OUTPUT_WRITER_H_
+#define SUPERPIXELS_SRC_CORE_OUTPUT_WRITER_H_
+
+#include "blocking_queue.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Superpixels
+{
+	/**
+	 * Image format and compression level of one kind of output.
+	 *
+	 * Given as "<codec>[:<level>]" with codec one of png (level 0-9, zlib
+	 * compression), jpeg (quality 0-100), webp (quality 1-100, above 100 is
+	 * lossless) or raw (uncompressed PPM/PGM, no level). Without a level the
+	 * codec default is used.
+	 */
+	struct ImageCodec
+	{
+		enum Type { PNG, JPEG, WEBP, RAW };
+
+		Type type = PNG;
+		int level = -1;
+
+		static ImageCodec parse(const std::string &spec);
+
+		// Extension (with leading period) of an image with the given number of channels
+		const std::string extension(const int channels) const;
+
+		// Parameters for cv::imwrite
+		const std::vector<int> params() const;
+
+		const std::string toString() const;
+
+		// Whether 16-bit images (e.g. labels) are stored losslessly
+		inline bool keeps16Bit() const { return type == PNG || type == RAW; }
+	};
+
+	/**
+	 * Encodes and writes output images on a pool of worker threads.
+	 *
+	 * The outputs of one input are submitted together and a callback runs once
+	 * all of them are on disk (e.g. to record the input as finished). Jobs wait
+	 * in a bounded queue, so a full queue blocks submit() and holds the
+	 * producer back to the pace of the disk and the encoders.
+	 *
+	 * The first failed write is rethrown by the next submit() or flush(), the
+	 * callback of an input with a failed output never runs.
+	 */
+	class OutputWriter
+	{
+
+		public:
+			struct Job
+			{
+				std::string path;
+				cv::Mat image;
+				ImageCodec codec;
+			};
+
+			/**
+			 * Encode and write one image on the calling thread. The image is written
+			 * to a temporary file renamed over the output, so an existing output (which
+			 * may be a hard link into the result cache) is replaced, never truncated.
+			 *
+			 * @param job 					Output path, 8-bit BGR/gray or 16-bit gray image and codec
+			 */
+			static void write(const Job &job);
+
+		private:
+			// Encode the image of a job into path
+			static void encode(const Job &job, const std::string &path);
+
+			// Outputs of one input, shared by their queued jobs
+			struct Batch
+			{
+				size_t remaining;
+				bool failed = false;
+				std::function<void()> on_written;
+			};
+
+			struct QueuedJob
+			{
+				Job job;
+				std::shared_ptr<Batch> batch;
+			};
+
+			Util::Concurrency::BlockingQueue<QueuedJob> _queue;
+			std::vector<std::thread> _workers;
+
+			// Jobs submitted but not finished yet
+			size_t _pending = 0;
+			std::exception_ptr _error;
+			std::mutex _mutex;
+			std::condition_variable _idle;
+
+			void worker();
+			void finishJob(const std::shared_ptr<Batch> &batch, const std::exception_ptr &error);
+			void rethrowError();
+
+		public:
+			/**
+			 * @param num_threads 			Number of writer threads (0 writes on the submitting thread)
+			 * @param queue_capacity 		Maximum number of queued output images
+			 */
+			OutputWriter(const size_t num_threads, const size_t queue_capacity);
+
+			// Finishes the queued jobs, their errors are dropped (call flush() first to see them)
+			~OutputWriter();
+
+			/**
+			 * Queue the outputs of one input, waiting for space if the queue is full
+			 *
+			 * @param jobs 					Outputs to write
+			 * @param on_written 			Called (on a writer thread) once every output is written
+			 */
+			void submit(std::vector<Job> jobs, std::function<void()> on_written = std::function<void()>());
+
+			// Wait until every queued job is written
+			void flush();
+	};
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_OUTPUT_WRITER_H_
@@ -1,11 +1,7 @@
 #include "recursive_image_segmenter.h"
 
 #include "util.h"
-
-#include <boost/filesystem.hpp>
-#include <boost/range/iterator_range.hpp>
-
-#include <omp.h>
+#include "directory_scanner.h"
 
 #include <iostream>
 #include <string>
@@ -22,39 +18,38 @@ namespace Superpixels
 		{
 			EXCEPTION_THROWER(Util::Exception::IOException, "RecursiveImageSegmenter requires a directory as the input path")
 		}
-		this->recursiveSegmentation(_input_path, _output_root);
-	}
 
-	void RecursiveImageSegmenter::recursiveSegmentation(const std::string &input_dir, const std::string &output_dir)
-	{
-		const boost::filesystem::path path = boost::filesystem::path(input_dir);
+		openJournal();
+		openCache();
+		openWriter();
 
-		// DFS through the filetree
-		// Go through each file in the root
-		#pragma omp parallel for
-		for (const auto &file : boost::make_iterator_range(boost::filesystem::directory_iterator(path), {}))
-		{
-			// If it is a directory, recurse
-			if (boost::filesystem::is_directory(file))
-			{
-				// This is the source directory
-				const std::string src_dir = file.path().string();
+		// Traverse the filetree in parallel, segmenting images as soon as they are found
+		Util::Files::DirectoryScanner scanner(_input_path, _ext, true);
+		scanner.setNumThreads(_scan_threads);
+		scanner.setManifest(_manifest_path);
+		scanner.start();
 
-				// Create the corresponding target directory
-				const std::string path_tail = Util::Files::getFilenameFromPath(src_dir);
-				const std::string tgt_dir = Util::Files::joinPathAndFile(output_dir, path_tail);
-				Util::Files::mkdir(tgt_dir);
+		std::string file;
+		std::string last_dir;
+		while (scanner.next(file))
+		{
+			// Mirror the source directory structure in the output root
+			const std::string src_dir = Util::Files::getBasePathFromPath(file);
+			const std::string tgt_dir = Util::Files::joinPathAndFile(_output_root,
+				Util::Files::getRelativePath(src_dir, _input_path));
 
-				// Recurse into this subdirectory
-				this->recursiveSegmentation(src_dir, tgt_dir);
-			}
-			// If it is not a directory, segment the image
-			else
+			// Files of the same directory tend to arrive together, so skip redundant mkdirs
+			if (tgt_dir != last_dir)
 			{
-				// Perform segmentation and write to corresponding output folder
-				this->segmentImage(file.path().string(), output_dir);
+				Util::Files::mkdirs(tgt_dir);
+				last_dir = tgt_dir;
 			}
-		}	
+
+			// Perform segmentation and write to corresponding output folder
+			this->dispatchImage(file, tgt_dir);
+		}
+
+		_writer->flush();
 	}
 
 } // namespace Superpixels
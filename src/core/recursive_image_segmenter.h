@@ -11,9 +11,6 @@ namespace Superpixels
 	class RecursiveImageSegmenter : public ImageSegmenter
 	{
 
-		private:
-			void recursiveSegmentation(const std::string &input_dir, const std::string &output_dir);
-
 		public:
 			RecursiveImageSegmenter(const SLICSettings &settings);
 			
@@ -0,0 +1,83 @@
+#include "result_cache.h"
+
+#include "hash.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace Superpixels
+{
+	ResultCache::ResultCache(const std::string &cache_dir) :
+		_cache_dir(cache_dir)
+	{
+		Util::Files::mkdirs(_cache_dir);
+	}
+
+	const std::string ResultCache::entryPath(const uint64_t key, const std::string &suffix) const
+	{
+		const std::string hex = Util::Hash::toHex(key);
+		return Util::Files::joinPathAndFile(Util::Files::joinPathAndFile(_cache_dir, hex.substr(0, 2)), hex + suffix);
+	}
+
+	bool ResultCache::fetch(const uint64_t key, const std::string &output_base, const std::vector<std::string> &suffixes) const
+	{
+		// Only a complete entry counts as a hit
+		for (const auto &suffix : suffixes)
+		{
+			if (!Util::Files::exists(entryPath(key, suffix))) { return false; }
+		}
+
+		try
+		{
+			for (const auto &suffix : suffixes)
+			{
+				const boost::filesystem::path entry(entryPath(key, suffix));
+				const boost::filesystem::path output(output_base + suffix);
+				boost::filesystem::remove(output);
+
+				boost::system::error_code ec;
+				boost::filesystem::create_hard_link(entry, output, ec);
+				if (ec)
+				{
+					boost::filesystem::copy_file(entry, output, boost::filesystem::copy_option::overwrite_if_exists);
+				}
+			}
+		}
+		catch (const boost::filesystem::filesystem_error &e)
+		{
+			std::cerr << "Warning: Could not restore cached result for '" << output_base << "': " << e.what() << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void ResultCache::store(const uint64_t key, const std::string &output_base, const std::vector<std::string> &suffixes) const
+	{
+		try
+		{
+			Util::Files::mkdirs(Util::Files::getBasePathFromPath(entryPath(key, "")));
+
+			for (const auto &suffix : suffixes)
+			{
+				// Copy under a name unique to the process and thread and rename, so that
+				// readers never see a partial file (the cache may be shared by processes)
+				const boost::filesystem::path entry(entryPath(key, suffix));
+				const boost::filesystem::path tmp_entry(entry.string() + ".tmp" + std::to_string(getpid()) + "-" +
+					Util::Hash::toHex(std::hash<std::thread::id>()(std::this_thread::get_id())));
+				boost::filesystem::copy_file(output_base + suffix, tmp_entry, boost::filesystem::copy_option::overwrite_if_exists);
+				boost::filesystem::rename(tmp_entry, entry);
+			}
+		}
+		catch (const boost::filesystem::filesystem_error &e)
+		{
+			std::cerr << "Warning: Could not cache result for '" << output_base << "': " << e.what() << std::endl;
+		}
+	}
+
+} // namespace Superpixels
@@ -0,0 +1,58 @@
+#ifndef SUPERPIXELS_SRC_CORE_RESULT_CACHE_H_
+#define SUPERPIXELS_SRC_CORE_RESULT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Superpixels
+{
+	/**
+	 * On-disk store of segmentation outputs keyed by a content hash.
+	 *
+	 * Entries live in <cache_dir>/<2 hex digits>/<16 hex digits><suffix>, one
+	 * file per output type. Outputs are copied into the cache and hard-linked
+	 * back out on a hit (falling back to a copy across filesystems).
+	 *
+	 * NOTE: Restored outputs share storage with the cache entry, so an existing
+	 * output must be replaced rather than truncated (OutputWriter renames a
+	 * temporary file over it).
+	 */
+	class ResultCache
+	{
+
+		private:
+			std::string _cache_dir;
+
+			const std::string entryPath(const uint64_t key, const std::string &suffix) const;
+
+		public:
+			/**
+			 * @param cache_dir 			Directory holding the cache entries (created if missing)
+			 */
+			ResultCache(const std::string &cache_dir);
+
+			/**
+			 * Place the cached outputs for a key next to the given output base path
+			 *
+			 * @param key 					Content hash of the input and settings
+			 * @param output_base 			Output path without suffix (e.g. <dir>/<image name>)
+			 * @param suffixes 				Suffixes of all the outputs of one image
+			 *
+			 * @return True on a hit with all outputs in place, False on a miss
+			 */
+			bool fetch(const uint64_t key, const std::string &output_base, const std::vector<std::string> &suffixes) const;
+
+			/**
+			 * Add freshly written outputs to the cache
+			 *
+			 * @param key 					Content hash of the input and settings
+			 * @param output_base 			Output path without suffix (e.g. <dir>/<image name>)
+			 * @param suffixes 				Suffixes of all the outputs of one image
+			 */
+			void store(const uint64_t key, const std::string &output_base, const std::vector<std::string> &suffixes) const;
+	};
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_RESULT_CACHE_H_
@@ -0,0 +1,412 @@
+#include "segmentation_server.h"
+
+#include "util.h"
+#include "hash.h"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <boost/lexical_cast.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+
+namespace Superpixels
+{
+	namespace
+	{
+		// A mapped POSIX shared memory object, unmapped when it goes out of scope
+		class SharedMemory
+		{
+
+			private:
+				void *_data = MAP_FAILED;
+				size_t _size = 0;
+
+			public:
+				// Map an existing object read-only, it must hold at least min_size bytes
+				SharedMemory(const std::string &name, const size_t min_size)
+				{
+					int fd = shm_open(name.c_str(), O_RDONLY, 0);
+					if (fd < 0) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not open shared memory '" + name + "'") }
+
+					struct stat st;
+					if (fstat(fd, &st) != 0 || (size_t)st.st_size < min_size)
+					{
+						close(fd);
+						EXCEPTION_THROWER(Util::Exception::IOException, "Shared memory '" + name + "' is smaller than the declared image")
+					}
+					_size = min_size;
+					_data = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+					close(fd);
+					if (_data == MAP_FAILED) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not map shared memory '" + name + "'") }
+				}
+
+				// Create (or resize, unless exclusive) an object of exactly size bytes and map it for writing
+				SharedMemory(const std::string &name, const size_t size, const bool exclusive)
+				{
+					int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | (exclusive ? O_EXCL : 0), 0600);
+					if (fd < 0) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not create shared memory '" + name + "'") }
+					if (ftruncate(fd, size) != 0)
+					{
+						close(fd);
+						EXCEPTION_THROWER(Util::Exception::IOException, "Could not resize shared memory '" + name + "'")
+					}
+					_size = size;
+					_data = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+					close(fd);
+					if (_data == MAP_FAILED) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not map shared memory '" + name + "'") }
+				}
+
+				~SharedMemory()
+				{
+					if (_data != MAP_FAILED) { munmap(_data, _size); }
+				}
+
+				void *data() const { return _data; }
+		};
+
+		bool sendLine(const int fd, const std::string &line)
+		{
+			const std::string data = line + "\n";
+			size_t num_sent = 0;
+			while (num_sent < data.size())
+			{
+				// No SIGPIPE if the client has gone away
+				ssize_t n = send(fd, data.data() + num_sent, data.size() - num_sent, MSG_NOSIGNAL);
+				if (n < 0 && errno == EINTR) { continue; }
+				if (n <= 0) { return false; }
+				num_sent += n;
+			}
+			return true;
+		}
+	}
+
+
+	////////////////////
+	// SERVER REQUEST //
+	////////////////////
+
+	ServerRequest::ServerRequest(const SLICSettings &settings, EnginePool &engines) :
+		Segmenter(settings),
+		_engines(engines)
+		{}
+
+	void ServerRequest::setSharedInput(const std::string &shm_name, const int width, const int height)
+	{
+		if (width <= 0 || height <= 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Shared memory input needs a positive width and height")
+		}
+		_shm_input = shm_name;
+		_shm_width = width;
+		_shm_height = height;
+	}
+
+	void ServerRequest::segment()
+	{
+		// The pixels stay mapped until the frame has been loaded into the engine
+		std::unique_ptr<SharedMemory> shm_input;
+		cv::Mat old_frame;
+		if (!_shm_input.empty())
+		{
+			shm_input.reset(new SharedMemory(_shm_input, (size_t)_shm_width * _shm_height * 3));
+			old_frame = cv::Mat(_shm_height, _shm_width, CV_8UC3, shm_input->data());
+
+			// Set image size by max side length or scale factor
+			resolveImageSize(old_frame.cols, old_frame.rows);
+		}
+		else
+		{
+			// Sets the image size too
+			old_frame = read_image(_input_path);
+			if (!old_frame.data) { EXCEPTION_THROWER(Util::Exception::IOException, "Error loading image '" + _input_path + "'") }
+		}
+
+		const uint64_t profile_key = engineProfileKey();
+		gSLICr::objects::settings engine_settings = _settings;
+		engine_settings.img_size = inputSize();
+		std::unique_ptr<PooledEngine> pooled = _engines.acquire(profile_key, engine_settings);
+		try
+		{
+			ingest_image(old_frame, &pooled->in_img);
+			old_frame.release();
+			shm_input.reset();
+
+			pooled->engine.Process_Frame(&pooled->in_img, _settings.img_size);
+
+			// Write the labels straight into the client's shared memory, without a letterbox border
+			const gSLICr::IntImage *labels = pooled->engine.Get_Seg_Res();
+			const int width = _settings.img_size.x;
+			const int height = _settings.img_size.y;
+			SharedMemory reply(_reply_name, (size_t)width * height * sizeof(int), _reply_exclusive);
+			for (int y = 0; y < height; y++)
+			{
+				std::memcpy((int*)reply.data() + (size_t)y * width, labels->GetData(MEMORYDEVICE_CPU) + (size_t)y * labels->noDims.x, width * sizeof(int));
+			}
+
+			_num_labels = _settings.dense_labels
+				? pooled->engine.Get_No_Labels()
+				: (int)pooled->engine.Get_Label_Spixels().size();
+		}
+		catch (...)
+		{
+			_engines.release(profile_key, std::move(pooled));
+			throw;
+		}
+		_engines.release(profile_key, std::move(pooled));
+	}
+
+
+	/////////////////////////
+	// SEGMENTATION SERVER //
+	/////////////////////////
+
+	volatile std::sig_atomic_t SegmentationServer::_stop = 0;
+
+	void SegmentationServer::onSignal(int) { _stop = 1; }
+
+	SegmentationServer::SegmentationServer(const SuperpixelUserOptions &defaults) :
+		_defaults(defaults),
+		_num_replies(0)
+		{}
+
+	const std::string SegmentationServer::handleSegment(std::istringstream &fields, Client *client)
+	{
+		SuperpixelUserOptions options = _defaults;
+		std::string image_path, shm_name, reply_name;
+		int width = 0;
+		int height = 0;
+
+		std::string field;
+		while (fields >> field)
+		{
+			const size_t eq = field.find('=');
+			if (eq == std::string::npos) { EXCEPTION_THROWER(Util::Exception::IOException, "Expected <key>=<value>, got '" + field + "'") }
+			const std::string key = field.substr(0, eq);
+			const std::string value = field.substr(eq + 1);
+
+			if (key == "image")
+			{
+				// The path runs to the end of the line, so it may hold spaces
+				std::string rest;
+				std::getline(fields, rest);
+				image_path = value + rest;
+			}
+			else if (key == "shm") { shm_name = value; }
+			else if (key == "width") { width = boost::lexical_cast<int>(value); }
+			else if (key == "height") { height = boost::lexical_cast<int>(value); }
+			else if (key == "reply") { reply_name = value; }
+			else { applySetting(options, key, value); }
+		}
+		if (image_path.empty() == shm_name.empty())
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "A segment request needs exactly one of image= and shm=")
+		}
+
+		// Server names are created exclusively and belong to the connection
+		const std::string server_prefix = "/slic-" + std::to_string(getpid()) + "-";
+		const bool server_named = reply_name.empty();
+		if (server_named)
+		{
+			reply_name = server_prefix + std::to_string(_num_replies++);
+			client->server_replies.push_back(reply_name);
+		}
+		else if (reply_name.size() < 2 || reply_name[0] != '/' || reply_name.find('/', 1) != std::string::npos
+			|| reply_name.compare(0, server_prefix.size(), server_prefix) == 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Reply must be a single '/name' outside the server's '" + server_prefix + "*' names, got '" + reply_name + "'")
+		}
+
+		ServerRequest request(SLICSettings(options), _engines);
+		if (options.use_scale)
+		{
+			request.setScale(options.scale);
+		}
+		else
+		{
+			request.setMaxSidelen(options.max_sidelen);
+		}
+		request.setLetterboxStep(options.letterbox_step);
+		if (!shm_name.empty())
+		{
+			request.setSharedInput(shm_name, width, height);
+		}
+		else
+		{
+			request.setInput(image_path);
+		}
+		request.setReplyName(reply_name, server_named);
+		request.segment();
+
+		std::ostringstream reply;
+		reply << "ok reply=" << reply_name
+			<< " width=" << request.labelSize().x
+			<< " height=" << request.labelSize().y
+			<< " num_labels=" << request.numLabels();
+		return reply.str();
+	}
+
+	const std::string SegmentationServer::handleRequest(const std::string &line, Client *client)
+	{
+		std::istringstream fields(line);
+		std::string command;
+		fields >> command;
+
+		try
+		{
+			if (command == "segment")
+			{
+				return handleSegment(fields, client);
+			}
+			else if (command == "ping")
+			{
+				return "ok";
+			}
+			else if (command == "stats")
+			{
+				return "ok engines=" + std::to_string(_engines.numEngines())
+					+ " profiles=" + std::to_string(_engines.numProfiles());
+			}
+			return "error Unknown command '" + command + "'";
+		}
+		catch (const std::exception &e)
+		{
+			// Keep the reply on one line
+			std::string message = e.what();
+			for (char &c : message) { if (c == '\n') { c = ' '; } }
+			return "error " + message;
+		}
+	}
+
+	void SegmentationServer::serveClient(Client *client)
+	{
+		std::string buffer;
+		char chunk[4096];
+		while (!_stop)
+		{
+			ssize_t n = recv(client->fd, chunk, sizeof(chunk), 0);
+			if (n < 0 && errno == EINTR) { continue; }
+			if (n <= 0) { break; }
+			buffer.append(chunk, n);
+
+			// Answer every complete line, in order
+			size_t eol;
+			bool connected = true;
+			while (connected && (eol = buffer.find('\n')) != std::string::npos)
+			{
+				std::string line = buffer.substr(0, eol);
+				buffer.erase(0, eol + 1);
+				if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+				if (line.empty()) { continue; }
+
+				if (_verbose) { std::cout << "Request: " << line << std::endl; }
+				connected = sendLine(client->fd, handleRequest(line, client));
+			}
+			if (!connected) { break; }
+
+			// The rest of an overlong line is not waited for
+			if (buffer.size() > MAX_LINE_LENGTH)
+			{
+				sendLine(client->fd, "error Request line longer than " + std::to_string(MAX_LINE_LENGTH) + " bytes");
+				break;
+			}
+		}
+
+		// Replies the client has not unlinked already
+		for (const std::string &reply_name : client->server_replies) { shm_unlink(reply_name.c_str()); }
+
+		client->done = true;
+	}
+
+	void SegmentationServer::reapClients(const bool all)
+	{
+		for (auto it = _clients.begin(); it != _clients.end();)
+		{
+			if (all || (*it)->done)
+			{
+				// Wake up a client still blocked on its socket
+				if (!(*it)->done) { shutdown((*it)->fd, SHUT_RDWR); }
+				(*it)->thread.join();
+				close((*it)->fd);
+				it = _clients.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	void SegmentationServer::serve()
+	{
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (_socket_path.empty() || _socket_path.size() >= sizeof(address.sun_path))
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Invalid socket path '" + _socket_path + "'")
+		}
+		std::strncpy(address.sun_path, _socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+		int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listen_fd < 0) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not create a socket") }
+
+		// A stale socket from a previous server would make bind() fail
+		unlink(_socket_path.c_str());
+		if (bind(listen_fd, (sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0)
+		{
+			close(listen_fd);
+			EXCEPTION_THROWER(Util::Exception::IOException, "Could not listen on '" + _socket_path + "'")
+		}
+
+		_stop = 0;
+		std::signal(SIGINT, onSignal);
+		std::signal(SIGTERM, onSignal);
+		if (_verbose) { std::cout << "Listening on: '" << _socket_path << "'" << std::endl; }
+
+		while (!_stop)
+		{
+			// Wake up regularly to notice a stop signal and finished clients
+			pollfd listen_poll = { listen_fd, POLLIN, 0 };
+			int ready = poll(&listen_poll, 1, 500);
+			reapClients(false);
+			if (ready <= 0) { continue; }
+
+			int client_fd = accept(listen_fd, NULL, NULL);
+			if (client_fd < 0) { continue; }
+
+			// Finished clients have been reaped, the rest are connected
+			if (_clients.size() >= _max_clients)
+			{
+				sendLine(client_fd, "error Too many clients (" + std::to_string(_max_clients) + ")");
+				close(client_fd);
+				continue;
+			}
+
+			std::unique_ptr<Client> client(new Client());
+			client->done = false;
+			client->fd = client_fd;
+			client->thread = std::thread(&SegmentationServer::serveClient, this, client.get());
+			_clients.push_back(std::move(client));
+		}
+
+		reapClients(true);
+		close(listen_fd);
+		unlink(_socket_path.c_str());
+		if (_verbose) { std::cout << "Server stopped" << std::endl; }
+	}
+
+} // namespace Superpixels
@@ -0,0 +1,144 @@
+#ifndef SUPERPIXELS_SRC_CORE_SEGMENTATION_SERVER_H_
+#define SUPERPIXELS_SRC_CORE_SEGMENTATION_SERVER_H_
+
+#include "segmenter.h"
+#include "options.h"
+#include "engine_pool.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Superpixels
+{
+
+	/**
+	 * One segmentation asked of the server: its settings, its input (an image
+	 * file or BGR pixels in shared memory) and the shared memory object the
+	 * labels are written to.
+	 */
+	class ServerRequest : public Segmenter
+	{
+
+		private:
+			EnginePool &_engines;
+			std::string _shm_input;
+			int _shm_width = 0;
+			int _shm_height = 0;
+			std::string _reply_name;
+			bool _reply_exclusive = false;
+			int _num_labels = 0;
+
+		public:
+			ServerRequest(const SLICSettings &settings, EnginePool &engines);
+
+			// Read width*height BGR pixels (3 bytes each, row-major) from a shared memory object
+			void setSharedInput(const std::string &shm_name, const int width, const int height);
+			// Shared memory object the int32 label map is written to, created or resized (created only if exclusive)
+			inline void setReplyName(const std::string &reply_name, const bool exclusive);
+
+			inline const gSLICr::Vector2i &labelSize() const;
+			inline int numLabels() const;
+
+			virtual inline void setInput(const std::string &input_path);
+			virtual void segment();
+	};
+
+	void ServerRequest::setReplyName(const std::string &reply_name, const bool exclusive)
+	{
+		_reply_name = reply_name;
+		_reply_exclusive = exclusive;
+	}
+	const gSLICr::Vector2i &ServerRequest::labelSize() const { return _settings.img_size; }
+	int ServerRequest::numLabels() const { return _num_labels; }
+	void ServerRequest::setInput(const std::string &input_path) { _input_path = input_path; }
+
+
+	/**
+	 * Long-lived segmentation service on a Unix domain socket. Engines stay
+	 * warm between requests in an EnginePool, one per settings profile and
+	 * concurrent request up to the engine limit, and every client connection
+	 * is served by its own thread. Connections beyond the client limit are answered with an error
+	 * and closed, as are clients sending a line longer than MAX_LINE_LENGTH.
+	 *
+	 * Requests and replies are single text lines of space-separated fields:
+	 *
+	 *   segment [reply=/name] [<setting>=<value> ...] image=<path to the end of the line>
+	 *   segment [reply=/name] [<setting>=<value> ...] shm=/name width=W height=H
+	 *   ping
+	 *   stats
+	 *
+	 * Settings are the command line SLIC options (spixel_size, color_space,
+	 * scale, max_sidelen, letterbox_step, ..., with 0/1 for the flags) and
+	 * override the server defaults for that request only. A segment request
+	 * is answered with
+	 *
+	 *   ok reply=/name width=W height=H num_labels=K
+	 *
+	 * where /name is a POSIX shared memory object holding the W*H int32 labels.
+	 * With reply= the client names it (a single "/name", created or resized)
+	 * and must shm_unlink() it. Without reply= the server creates a fresh
+	 * object and unlinks it when the connection closes, so the client maps it
+	 * before disconnecting (a mapping outlives the name) and may unlink it
+	 * earlier itself. Failures are answered with "error <message>".
+	 */
+	class SegmentationServer
+	{
+
+		private:
+			SuperpixelUserOptions _defaults;
+			std::string _socket_path;
+			bool _verbose = false;
+			size_t _max_clients = 32;
+			EnginePool _engines;
+			std::atomic<uint64_t> _num_replies;
+
+			// Longest request line, a client exceeding it is disconnected
+			static const size_t MAX_LINE_LENGTH = 65536;
+
+			struct Client
+			{
+				std::thread thread;
+				std::atomic<bool> done;
+				int fd;
+				// Replies named by the server, unlinked on disconnect
+				std::vector<std::string> server_replies;
+			};
+			std::list<std::unique_ptr<Client> > _clients;
+
+			static volatile std::sig_atomic_t _stop;
+			static void onSignal(int);
+
+			// Join the threads of disconnected clients
+			void reapClients(const bool all);
+
+			void serveClient(Client *client);
+			const std::string handleRequest(const std::string &line, Client *client);
+			const std::string handleSegment(std::istringstream &fields, Client *client);
+
+		public:
+			SegmentationServer(const SuperpixelUserOptions &defaults);
+
+			inline void setSocketPath(const std::string &socket_path);
+			inline void setVerbose(const bool verbose);
+			inline void setMaxClients(const size_t max_clients);
+			inline void setMaxEngines(const size_t max_engines);
+
+			// Accept clients until SIGINT or SIGTERM
+			void serve();
+	};
+
+	void SegmentationServer::setSocketPath(const std::string &socket_path) { _socket_path = socket_path; }
+	void SegmentationServer::setVerbose(const bool verbose) { _verbose = verbose; }
+	void SegmentationServer::setMaxClients(const size_t max_clients) { _max_clients = max_clients; }
+	void SegmentationServer::setMaxEngines(const size_t max_engines) { _engines.setMaxEngines(max_engines); }
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_SEGMENTATION_SERVER_H_
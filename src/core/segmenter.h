@@ -3,26 +3,40 @@
 
 #include "options.h"
 #include "util.h"
+#include "hash.h"
+#include "image_header.h"
+#include "image_resample.h"
 
 #include "../gSLICr/gSLICr_Lib/gSLICr.h"
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/core/core.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <memory>
 
 namespace Superpixels
 {
+	// The SLIC options of SuperpixelUserOptions, which holds their defaults
 	struct SLICSettings
 	{
-		int num_segs = 2000;
-		int spixel_size = 16;
-		float coh_weight = 0.6f;
-		int num_iters = 5;
-		std::string color_space = "XYZ";
-		std::string seg_method = "GIVEN_SIZE";
-		bool enforce_connectivity = true;
+		int num_segs;
+		int spixel_size;
+		float coh_weight;
+		int num_iters;
+		std::string color_space;
+		std::string seg_method;
+		bool enforce_connectivity;
+		int pyramid_levels;
+		int refine_iters;
+		int band_width;
+		int band_after_iters;
+		bool low_gradient_init;
+		bool dense_labels;
+		std::string device;
+		std::string cpu_isa;
 
 		SLICSettings(const SuperpixelUserOptions &options) :
 			num_segs(options.num_segs),
@@ -31,7 +45,15 @@ namespace Superpixels
 			num_iters(options.num_iters),
 			color_space(options.color_space),
 			seg_method(options.seg_method),
-			enforce_connectivity(!options.no_enforce_connectivity)
+			enforce_connectivity(!options.no_enforce_connectivity),
+			pyramid_levels(options.pyramid_levels),
+			refine_iters(options.refine_iters),
+			band_width(options.band_width),
+			band_after_iters(options.band_after_iters),
+			low_gradient_init(options.low_gradient_init),
+			dense_labels(options.dense_labels),
+			device(options.device),
+			cpu_isa(options.cpu_isa)
 			{}
 	};
 
@@ -47,18 +69,51 @@ namespace Superpixels
 			std::string _input_path;
 			std::string _output_root;
 			bool _use_scale = true; // If false, uses the maximum side length
+			int _letterbox_step = 0; // If positive, the engine input is padded to multiples of it
 
 			inline void load_image(const cv::Mat& inimg, gSLICr::UChar4Image* outimg) const;
+			// Only the top-left outimg-sized part of a letterboxed inimg is copied
 			inline void load_image(const gSLICr::UChar4Image* inimg, cv::Mat& outimg) const;
+			// Copy the labels of an engine into a CV_16UC1 image, cropped to the image size
+			inline void load_labels(const gSLICr::IntImage* inimg, cv::Mat& outimg) const;
+			// Resize a decoded BGR image to the image size straight into the top-left
+			// of outimg, the letterbox border past it is zeroed
+			inline void ingest_image(const cv::Mat& inimg, gSLICr::UChar4Image* outimg) const;
+
+			// Set the engine image size for an input of the given size (by scale or max side length)
+			inline void resolveImageSize(const int width, const int height);
+
+			// Size of the engine input, the image size padded up to the letterbox step.
+			// The engine segments only the image size part of it (see core_engine::Process_Frame).
+			inline gSLICr::Vector2i inputSize() const;
+
+			// Decode an image and set the engine image size for it. A JPEG is decoded
+			// at 1/2, 1/4 or 1/8 of its size when that is still at least the image size.
+			inline cv::Mat read_image(const std::string& path);
+
+			// Hash of the gSLICr engine settings (excluding the image size)
+			inline uint64_t engineSettingsHash() const;
+
+			// Hash of every setting that affects the segmentation outputs
+			inline uint64_t settingsHash() const;
+
+			// Engine settings that pick a pooled engine (see EnginePool), it is reshaped to the image size
+			inline uint64_t engineProfileKey() const;
 			
 		public:
 			inline Segmenter(const SLICSettings &settings);
 
-			// NOTE: Changing settings requires re-initializing gSLICr engine which is slow
+			// NOTE: Engines kept by a segmenter take the new settings in place (see
+			// core_engine::Reconfigure), only a new superpixel geometry reallocates
 			inline void changeSettings(const SLICSettings &settings);
 
 			inline void setScale(const double scale);
 			inline void setMaxSidelen(const double max_sidelen);
+			// Pad the engine input up to multiples of letterbox_step pixels per side, so
+			// images of nearby sizes share one engine shape (0 disables it). The labels
+			// match the unpadded image, except that GIVEN_NUM sizes the superpixels for
+			// the padded one.
+			inline void setLetterboxStep(const int letterbox_step);
 			inline void setVerbose(const bool verbose);
 
 			virtual inline void setOutputDirectory(const std::string &output_root);
@@ -111,6 +166,30 @@ namespace Superpixels
 		}
 		// Whether or not run the enforce connectivity step
 		_settings.do_enforce_connectivity = settings.enforce_connectivity;
+		// Coarse-to-fine clustering
+		if (settings.pyramid_levels < 0 || settings.refine_iters < 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "pyramid_levels and refine_iters cannot be negative")
+		}
+		_settings.pyramid_levels = settings.pyramid_levels;
+		_settings.refine_iters = settings.refine_iters;
+		_settings.band_width = settings.band_width;
+		_settings.band_after_iters = settings.band_after_iters;
+		// Start the centers on the lowest gradient of their neighborhood
+		_settings.low_gradient_init = settings.low_gradient_init;
+		// Labels 0..K-1 in raster order of first appearance
+		_settings.dense_labels = settings.dense_labels;
+		// gSLICr::DEVICE_GPU for CUDA or gSLICr::DEVICE_CPU for the host
+		if (settings.device == "CPU")
+		{
+			_settings.device_type = gSLICr::DEVICE_CPU;
+		}
+		else
+		{
+			_settings.device_type = gSLICr::DEVICE_GPU;
+		}
+		// Instruction set of the CPU kernels ("auto" for the best available)
+		_settings.cpu_isa = gSLICr::engines::Parse_CPU_ISA(settings.cpu_isa.c_str());
 	}
 
 	void Segmenter::setOutputDirectory(const std::string &output_root)
@@ -128,6 +207,7 @@ namespace Superpixels
 		_max_sidelen = max_sidelen;
 		_use_scale = false;
 	}
+	void Segmenter::setLetterboxStep(const int letterbox_step) { _letterbox_step = letterbox_step; }
 	void Segmenter::setVerbose(const bool verbose) { _verbose = verbose; }
 
 
@@ -150,10 +230,12 @@ namespace Superpixels
 	void Segmenter::load_image(const gSLICr::UChar4Image* inimg, cv::Mat& outimg) const
 	{
 		const gSLICr::Vector4u* inimg_ptr = inimg->GetData(MEMORYDEVICE_CPU);
+		const int width = std::min(outimg.cols, inimg->noDims.x);
+		const int height = std::min(outimg.rows, inimg->noDims.y);
 
-		for (int y = 0; y < inimg->noDims.y; y++)
+		for (int y = 0; y < height; y++)
 		{
-			for (int x = 0; x < inimg->noDims.x; x++)
+			for (int x = 0; x < width; x++)
 			{
 				int idx = x + y * inimg->noDims.x;
 				outimg.at<cv::Vec3b>(y, x)[0] = inimg_ptr[idx].b;
@@ -163,6 +245,154 @@ namespace Superpixels
 		}
 	}
 
+	void Segmenter::load_labels(const gSLICr::IntImage* inimg, cv::Mat& outimg) const
+	{
+		const int* inimg_ptr = inimg->GetData(MEMORYDEVICE_CPU);
+		const int width = std::min(_settings.img_size.x, inimg->noDims.x);
+		const int height = std::min(_settings.img_size.y, inimg->noDims.y);
+
+		outimg.create(cv::Size(width, height), CV_16UC1);
+		for (int y = 0; y < height; y++)
+		{
+			unsigned short* row = outimg.ptr<unsigned short>(y);
+			for (int x = 0; x < width; x++)
+			{
+				row[x] = (unsigned short)inimg_ptr[x + y * inimg->noDims.x];
+			}
+		}
+	}
+
+	void Segmenter::ingest_image(const cv::Mat& inimg, gSLICr::UChar4Image* outimg) const
+	{
+		gSLICr::Vector4u* outimg_ptr = outimg->GetData(MEMORYDEVICE_CPU);
+		const int width = std::min(_settings.img_size.x, outimg->noDims.x);
+		const int height = std::min(_settings.img_size.y, outimg->noDims.y);
+		Util::Images::resampleToRGBA(inimg, (unsigned char*)outimg_ptr, outimg->noDims.x * sizeof(gSLICr::Vector4u), width, height);
+
+		// The engine skips the border, zeroing it keeps pooled buffers free of older images
+		for (int y = 0; y < outimg->noDims.y; y++)
+		{
+			const int x_start = y < height ? width : 0;
+			std::memset(outimg_ptr + y * outimg->noDims.x + x_start, 0, (outimg->noDims.x - x_start) * sizeof(gSLICr::Vector4u));
+		}
+	}
+
+	void Segmenter::resolveImageSize(const int width, const int height)
+	{
+		// Set image size by max side length (preserving aspect ratio)
+		if (!_use_scale)
+		{
+			if (width <= height)
+			{
+				_settings.img_size.y = (int)_max_sidelen;
+				float scale = _max_sidelen / height;
+				_settings.img_size.x = (int)(scale * width);
+			}
+			else
+			{
+				_settings.img_size.x = (int)_max_sidelen;
+				float scale = _max_sidelen / width;
+				_settings.img_size.y = (int)(scale * height);
+			}
+		}
+		// Or set image size using a scale factor
+		else
+		{
+			_settings.img_size.x = (int)(_scale * width);
+			_settings.img_size.y = (int)(_scale * height);
+		}
+	}
+
+	cv::Mat Segmenter::read_image(const std::string& path)
+	{
+		// Only the header is read to find the image size before decoding
+		int width = 0;
+		int height = 0;
+		int reduction = 1;
+		Util::Images::ImageFormat format;
+		if (Util::Images::readImageSize(path, width, height, format) && format == Util::Images::ImageFormat::JPEG)
+		{
+			resolveImageSize(width, height);
+			for (int r = 8; r > 1 && reduction == 1; r /= 2)
+			{
+				// The decoder rounds the reduced size up
+				if ((width + r - 1) / r >= _settings.img_size.x && (height + r - 1) / r >= _settings.img_size.y) { reduction = r; }
+			}
+		}
+
+		const int flags = reduction == 8 ? cv::IMREAD_REDUCED_COLOR_8
+			: reduction == 4 ? cv::IMREAD_REDUCED_COLOR_4
+			: reduction == 2 ? cv::IMREAD_REDUCED_COLOR_2
+			: cv::IMREAD_COLOR;
+		cv::Mat image = cv::imread(path, flags);
+		if (!image.data) { return image; }
+
+		// The decoded size has the last word (e.g. over an EXIF rotation), but a
+		// reduced one is only used to tell whether the image was turned
+		if (reduction == 1)
+		{
+			resolveImageSize(image.cols, image.rows);
+		}
+		else if (image.cols == (width + reduction - 1) / reduction && image.rows == (height + reduction - 1) / reduction)
+		{
+			resolveImageSize(width, height);
+		}
+		else
+		{
+			resolveImageSize(height, width);
+		}
+		return image;
+	}
+
+	gSLICr::Vector2i Segmenter::inputSize() const
+	{
+		if (_letterbox_step <= 0) { return _settings.img_size; }
+
+		// Round every side up, so the nearby sizes of mixed aspect ratios meet
+		const int step = _letterbox_step;
+		return gSLICr::Vector2i((_settings.img_size.x + step - 1) / step * step, (_settings.img_size.y + step - 1) / step * step);
+	}
+
+	uint64_t Segmenter::engineSettingsHash() const
+	{
+		uint64_t hash = Util::Hash::FNV_OFFSET_BASIS;
+		hash = Util::Hash::combine(hash, _settings.no_segs);
+		hash = Util::Hash::combine(hash, _settings.spixel_size);
+		hash = Util::Hash::combine(hash, _settings.no_iters);
+		hash = Util::Hash::combine(hash, _settings.coh_weight);
+		hash = Util::Hash::combine(hash, _settings.do_enforce_connectivity);
+		hash = Util::Hash::combine(hash, (int)_settings.color_space);
+		hash = Util::Hash::combine(hash, (int)_settings.seg_method);
+		hash = Util::Hash::combine(hash, _settings.pyramid_levels);
+		hash = Util::Hash::combine(hash, _settings.refine_iters);
+		hash = Util::Hash::combine(hash, _settings.band_width);
+		hash = Util::Hash::combine(hash, _settings.band_after_iters);
+		hash = Util::Hash::combine(hash, _settings.low_gradient_init);
+		hash = Util::Hash::combine(hash, _settings.dense_labels);
+		hash = Util::Hash::combine(hash, (int)_settings.device_type);
+		return hash;
+	}
+
+	uint64_t Segmenter::settingsHash() const
+	{
+		uint64_t hash = engineSettingsHash();
+
+		// The resizing policy determines the image size the engine sees
+		hash = Util::Hash::combine(hash, _use_scale);
+		hash = Util::Hash::combine(hash, _use_scale ? _scale : _max_sidelen);
+
+		// The padded size sets the superpixel size for a given number of them
+		hash = Util::Hash::combine(hash, _settings.seg_method == gSLICr::GIVEN_NUM ? _letterbox_step : 0);
+		return hash;
+	}
+
+	uint64_t Segmenter::engineProfileKey() const
+	{
+		uint64_t key = engineSettingsHash();
+		key = Util::Hash::combine(key, (int)_settings.cpu_isa);
+		return key;
+	}
+
 	void Segmenter::changeSettings(const SLICSettings &settings)
 	{
 		_settings.no_segs = settings.num_segs;
@@ -201,6 +431,30 @@ namespace Superpixels
 		}
 		// Whether or not run the enforce connectivity step
 		_settings.do_enforce_connectivity = settings.enforce_connectivity;
+		// Coarse-to-fine clustering
+		if (settings.pyramid_levels < 0 || settings.refine_iters < 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "pyramid_levels and refine_iters cannot be negative")
+		}
+		_settings.pyramid_levels = settings.pyramid_levels;
+		_settings.refine_iters = settings.refine_iters;
+		_settings.band_width = settings.band_width;
+		_settings.band_after_iters = settings.band_after_iters;
+		// Start the centers on the lowest gradient of their neighborhood
+		_settings.low_gradient_init = settings.low_gradient_init;
+		// Labels 0..K-1 in raster order of first appearance
+		_settings.dense_labels = settings.dense_labels;
+		// gSLICr::DEVICE_GPU for CUDA or gSLICr::DEVICE_CPU for the host
+		if (settings.device == "CPU")
+		{
+			_settings.device_type = gSLICr::DEVICE_CPU;
+		}
+		else
+		{
+			_settings.device_type = gSLICr::DEVICE_GPU;
+		}
+		// Instruction set of the CPU kernels ("auto" for the best available)
+		_settings.cpu_isa = gSLICr::engines::Parse_CPU_ISA(settings.cpu_isa.c_str());
 	}
 
 } // namespace Superpixels
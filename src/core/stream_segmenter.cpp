@@ -0,0 +1,194 @@
+#include "stream_segmenter.h"
+
+#include "util.h"
+
+#include "../gSLICr/NVTimer.h"
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Superpixels
+{
+	const char StreamSegmenter::FRAME_MAGIC[4] = { 'S', 'L', 'C', 'F' };
+
+	StreamSegmenter::StreamSegmenter(const SLICSettings &settings) :
+		Segmenter(settings)
+		{
+			_input_path = "-";
+			_output_root = "-";
+		}
+
+	void StreamSegmenter::setFrameSize(const int width, const int height)
+	{
+		if (width <= 0 || height <= 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Frame width and height must be positive")
+		}
+		_frame_width = width;
+		_frame_height = height;
+	}
+
+	StreamSegmenter::PixelFormat StreamSegmenter::parsePixelFormat(const std::string &name)
+	{
+		if (name == "bgr24") { return BGR24; }
+		if (name == "yuv420p") { return YUV420P; }
+		EXCEPTION_THROWER(Util::Exception::IOException, "Unknown pixel format '" + name + "' (use bgr24 or yuv420p)")
+	}
+
+	bool StreamSegmenter::readFrame(std::FILE *input, std::vector<uint8_t> &raw) const
+	{
+		size_t num_read = 0;
+		while (num_read < raw.size())
+		{
+			size_t n = std::fread(raw.data() + num_read, 1, raw.size() - num_read, input);
+			if (n == 0) { break; }
+			num_read += n;
+		}
+
+		if (num_read == 0 && std::feof(input)) { return false; }
+		if (num_read < raw.size())
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Input ended in the middle of a frame (wrong frame size or pixel format?)")
+		}
+		return true;
+	}
+
+	void StreamSegmenter::decodeFrame(std::vector<uint8_t> &raw, cv::Mat &bgr) const
+	{
+		if (_pixel_format == YUV420P)
+		{
+			// I420 is a full resolution Y plane followed by the quarter resolution U and V planes
+			cv::Mat yuv(_frame_height * 3 / 2, _frame_width, CV_8UC1, raw.data());
+			cv::cvtColor(yuv, bgr, cv::COLOR_YUV2BGR_I420);
+		}
+		else
+		{
+			// Wraps the buffer, no copy
+			bgr = cv::Mat(_frame_height, _frame_width, CV_8UC3, raw.data());
+		}
+	}
+
+	void StreamSegmenter::packFrame(const uint32_t frame_index, gSLICr::engines::core_engine &engine, std::vector<char> &record)
+	{
+		const gSLICr::IntImage *labels = engine.Get_Seg_Res();
+		const std::vector<std::pair<int, gSLICr::objects::spixel_info> > spixels = engine.Get_Label_Spixels();
+
+		uint32_t header[4] = { frame_index, (uint32_t)labels->noDims.x, (uint32_t)labels->noDims.y, (uint32_t)spixels.size() };
+		const size_t label_bytes = labels->dataSize * sizeof(int32_t);
+
+		record.resize(sizeof(FRAME_MAGIC) + sizeof(header) + label_bytes + spixels.size() * (2 * sizeof(int32_t) + 6 * sizeof(float)));
+		char *entry = record.data();
+		std::memcpy(entry, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+		entry += sizeof(FRAME_MAGIC);
+		std::memcpy(entry, header, sizeof(header));
+		entry += sizeof(header);
+		std::memcpy(entry, labels->GetData(MEMORYDEVICE_CPU), label_bytes);
+		entry += label_bytes;
+
+		// One record per superpixel, the layout documented in the header
+		for (const auto &label_spixel : spixels)
+		{
+			const gSLICr::objects::spixel_info &info = label_spixel.second;
+			int32_t ints[2] = { label_spixel.first, info.no_pixels };
+			float floats[6] = { info.center.x, info.center.y,
+				info.color_info.r, info.color_info.g, info.color_info.b, info.color_info.a };
+			std::memcpy(entry, ints, sizeof(ints));
+			std::memcpy(entry + sizeof(ints), floats, sizeof(floats));
+			entry += sizeof(ints) + sizeof(floats);
+		}
+	}
+
+	void StreamSegmenter::writeFrame(std::FILE *output, uint32_t frame_index, gSLICr::engines::core_engine &engine) const
+	{
+		std::vector<char> record;
+		packFrame(frame_index, engine, record);
+
+		bool ok = std::fwrite(record.data(), record.size(), 1, output) == 1
+			&& std::fflush(output) == 0;
+		if (!ok)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Error writing to the output stream")
+		}
+	}
+
+	void StreamSegmenter::segment()
+	{
+		if (_frame_width <= 0 || _frame_height <= 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "The frame size must be set before streaming")
+		}
+		if (_pixel_format == YUV420P && (_frame_width % 2 || _frame_height % 2))
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "yuv420p frames must have an even width and height")
+		}
+
+		// Open the streams, stdin and stdout unless given a pipe or file
+		std::unique_ptr<std::FILE, int (*)(std::FILE *)> input(nullptr, std::fclose);
+		std::unique_ptr<std::FILE, int (*)(std::FILE *)> output(nullptr, std::fclose);
+		if (_input_path != "-")
+		{
+			input.reset(std::fopen(_input_path.c_str(), "rb"));
+			if (!input) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not open input '" + _input_path + "'") }
+		}
+		if (_output_root != "-")
+		{
+			output.reset(std::fopen(_output_root.c_str(), "wb"));
+			if (!output) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not open output '" + _output_root + "'") }
+		}
+		std::FILE *in_stream = input ? input.get() : stdin;
+		std::FILE *out_stream = output ? output.get() : stdout;
+
+		// Set image size by max side length or scale factor
+		resolveImageSize(_frame_width, _frame_height);
+
+		// Instantiate a core_engine, reused for every frame
+		std::unique_ptr<gSLICr::engines::core_engine> gSLICr_engine(new gSLICr::engines::core_engine(_settings));
+		if (_verbose)
+		{
+			std::cerr << "Segmenting on: " << gSLICr_engine->Get_Backend_Name() << std::endl;
+		}
+
+		// The buffers are reused from frame to frame
+		size_t frame_bytes = _pixel_format == YUV420P
+			? (size_t)_frame_width * _frame_height * 3 / 2
+			: (size_t)_frame_width * _frame_height * 3;
+		std::vector<uint8_t> raw(frame_bytes);
+		cv::Mat bgr;
+
+		StopWatchInterface *my_timer;
+		sdkCreateTimer(&my_timer);
+
+		uint32_t frame_index = 0;
+		while (readFrame(in_stream, raw))
+		{
+			decodeFrame(raw, bgr);
+			ingest_image(bgr, gSLICr_engine->Get_Input_Buffer(_settings.img_size));
+
+			sdkResetTimer(&my_timer);
+			sdkStartTimer(&my_timer);
+			gSLICr_engine->Process_Input_Buffer();
+			sdkStopTimer(&my_timer);
+
+			writeFrame(out_stream, frame_index, *gSLICr_engine);
+
+			if (_verbose)
+			{
+				std::cerr << "\rFrame " << frame_index << " segmented in:[" << sdkGetTimerValue(&my_timer) << "]ms" << std::flush;
+			}
+			frame_index++;
+		}
+
+		if (_verbose)
+		{
+			std::cerr << std::endl << "Segmented " << frame_index << " frames" << std::endl;
+		}
+	}
+
+} // namespace Superpixels
@@ -0,0 +1,83 @@
+#ifndef SUPERPIXELS_SRC_CORE_STREAM_SEGMENTER_H_
+#define SUPERPIXELS_SRC_CORE_STREAM_SEGMENTER_H_
+
+#include "segmenter.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Superpixels
+{
+
+	/**
+	 * Segments raw frames read from stdin (or a pipe) and writes the results to
+	 * stdout (or a pipe), so it can sit in a pipeline such as
+	 *
+	 *   ffmpeg -i in.mp4 -f rawvideo -pix_fmt bgr24 - | slic_stream_segmenter --width W --height H
+	 *
+	 * Input frames are headerless and all of the declared size: width*height*3
+	 * bytes for bgr24 and width*height*3/2 bytes for yuv420p (planar I420).
+	 *
+	 * Every segmented frame is written as one record (host byte order):
+	 *
+	 *   char     magic[4]        "SLCF"
+	 *   uint32   frame_index     0 for the first frame read
+	 *   uint32   width, height   size of the label map (after scaling)
+	 *   uint32   num_spixels     number of spixel table entries
+	 *   int32    labels[height][width]
+	 *   num_spixels x { int32 label; int32 num_pixels;
+	 *                   float32 center_x, center_y;
+	 *                   float32 color[4]; }   (in the clustering color space)
+	 *
+	 * Nothing else is written to the output, diagnostics go to stderr.
+	 */
+	class StreamSegmenter : public Segmenter
+	{
+
+		public:
+			enum PixelFormat { BGR24, YUV420P };
+
+			static const char FRAME_MAGIC[4];
+
+			// Serialize the engine's last result as one frame record (see above)
+			static void packFrame(const uint32_t frame_index, gSLICr::engines::core_engine &engine, std::vector<char> &record);
+
+		private:
+			int _frame_width = 0;
+			int _frame_height = 0;
+			PixelFormat _pixel_format = BGR24;
+
+			// Read one raw frame, False on a clean end of stream
+			bool readFrame(std::FILE *input, std::vector<uint8_t> &raw) const;
+
+			// Convert a raw frame to BGR
+			void decodeFrame(std::vector<uint8_t> &raw, cv::Mat &bgr) const;
+
+			void writeFrame(std::FILE *output, uint32_t frame_index, gSLICr::engines::core_engine &engine) const;
+
+		public:
+			StreamSegmenter(const SLICSettings &settings);
+
+			void setFrameSize(const int width, const int height);
+			inline void setPixelFormat(const PixelFormat pixel_format);
+
+			// Parse "bgr24" or "yuv420p"
+			static PixelFormat parsePixelFormat(const std::string &name);
+
+			// "-" (the default) reads from stdin, anything else is opened as a file or named pipe
+			virtual inline void setInput(const std::string &input);
+			// "-" (the default) writes to stdout
+			virtual inline void setOutputDirectory(const std::string &output);
+			virtual void segment();
+	};
+
+	void StreamSegmenter::setPixelFormat(const PixelFormat pixel_format) { _pixel_format = pixel_format; }
+
+	void StreamSegmenter::setInput(const std::string &input) { _input_path = input; }
+	void StreamSegmenter::setOutputDirectory(const std::string &output) { _output_root = output; }
+
+} // namespace Superpixels
+
+#endif // SUPERPIXELS_SRC_CORE_STREAM_SEGMENTER_H_
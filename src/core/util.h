@@ -89,6 +89,20 @@ namespace Util
 			return boost::filesystem::extension(file);
 		}
 
+		/**
+		 * Get a path relative to a root directory (purely lexical, no filesystem access)
+		 *
+		 * @param path 						Path to a file or directory under root
+		 * @param root 						Path to the root directory
+		 *
+		 * @return The part of path below root
+		 */
+		inline const std::string getRelativePath(const std::string &path, const std::string &root)
+		{
+			const boost::filesystem::path b_path(path);
+			return b_path.lexically_relative(boost::filesystem::path(root)).string();
+		}
+
 		inline const std::string stripRootDir(const std::string &path)
 		{
 			boost::filesystem::path b_path(path);
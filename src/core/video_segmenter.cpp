@@ -1,4 +1,5 @@
 #include "video_segmenter.h"
+#include "stream_segmenter.h"
 
 #include "util.h"
 
@@ -8,11 +9,57 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <cmath>
+#include <cstring>
+#include <exception>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace Superpixels
 {
+	namespace
+	{
+		// Visualizations as a raw YUV4MPEG2 stream, full resolution chroma
+		class Y4MWriter
+		{
+
+			private:
+				std::unique_ptr<std::FILE, int (*)(std::FILE *)> _file;
+
+			public:
+				Y4MWriter(const std::string &path, const cv::Size &size, const double fps) :
+					_file(std::fopen(path.c_str(), "wb"), std::fclose)
+				{
+					if (!_file) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not open '" + path + "'") }
+
+					// The frame rate is a ratio of integers
+					const int fps_num = (int)std::lround(fps * 1000.0);
+					std::fprintf(_file.get(), "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C444\n", size.width, size.height, fps_num);
+				}
+
+				void write(const cv::Mat &bgr)
+				{
+					cv::Mat yuv;
+					cv::cvtColor(bgr, yuv, cv::COLOR_BGR2YUV);
+					std::vector<cv::Mat> planes;
+					cv::split(yuv, planes);
+
+					bool ok = std::fputs("FRAME\n", _file.get()) >= 0;
+					for (size_t i = 0; ok && i < planes.size(); i++)
+					{
+						ok = std::fwrite(planes[i].data, planes[i].total(), 1, _file.get()) == 1;
+					}
+					if (!ok) { EXCEPTION_THROWER(Util::Exception::IOException, "Error writing the Y4M stream") }
+				}
+		};
+	}
+
+	const char VideoSegmenter::INDEX_MAGIC[4] = { 'S', 'L', 'C', 'I' };
+
 	VideoSegmenter::VideoSegmenter(const SLICSettings &settings) :
 		Segmenter(settings)
 		{}
@@ -26,6 +73,92 @@ namespace Superpixels
 		_input_path = input_video;
 	}
 
+	void VideoSegmenter::setVideoCodec(const std::string &video_codec)
+	{
+		if (video_codec.size() != 4)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Video codec must be a FourCC such as MJPG, got '" + video_codec + "'")
+		}
+		_video_codec = video_codec;
+	}
+
+	VideoSegmenter::VideoOutput VideoSegmenter::parseVideoOutput(const std::string &name)
+	{
+		if (name == "frames") { return FRAMES; }
+		if (name == "video") { return VIDEO; }
+		if (name == "y4m") { return Y4M; }
+		EXCEPTION_THROWER(Util::Exception::IOException, "Unknown video output '" + name + "' (use frames, video or y4m)")
+	}
+
+	void VideoSegmenter::writeFrameFiles(gSLICr::engines::core_engine &engine, const cv::Mat &viz, const int frame_index) const
+	{
+		char out_name[100];
+
+		sprintf(out_name, Util::Files::joinPathAndFile(_output_root, "img_%06i.png.slic.pgm").c_str(), frame_index);
+		engine.Write_Seg_Res_To_PGM(out_name);
+		sprintf(out_name, Util::Files::joinPathAndFile(_output_root, "img_%06i.png.centers.txt").c_str(), frame_index);
+		engine.Write_Superpixel_Info_To_TXT(out_name, _settings.color_space);
+		sprintf(out_name, Util::Files::joinPathAndFile(_output_root, "img_%06i.png.viz.png").c_str(), frame_index);
+		imwrite(out_name, viz);
+	}
+
+	void VideoSegmenter::segmentFrames(cv::VideoCapture &cap, Util::Concurrency::BlockingQueue<EncodedFrame> *queue)
+	{
+		cv::Size s(_settings.img_size.x, _settings.img_size.y);
+
+		// Instantiate a core_engine
+		std::unique_ptr<gSLICr::engines::core_engine> gSLICr_engine(new gSLICr::engines::core_engine(_settings));
+		std::cout << "Segmenting on: " << gSLICr_engine->Get_Backend_Name() << std::endl;
+
+		// gSLICr takes gSLICr::UChar4Image as output, frames are resized into its input buffer
+		std::unique_ptr<gSLICr::UChar4Image> out_img(new gSLICr::UChar4Image(_settings.img_size, true, _settings.device_type == gSLICr::DEVICE_GPU));
+
+		cv::Mat oldFrame;
+		cv::Mat boundry_draw_frame;
+		boundry_draw_frame.create(s, CV_8UC3);
+
+		StopWatchInterface *my_timer;
+		sdkCreateTimer(&my_timer);
+
+		double frame_step = _sampling_rate;
+		double current_frame = 0;
+		cap.set(CV_CAP_PROP_POS_FRAMES, current_frame);
+
+		while (cap.read(oldFrame))
+		{
+
+			ingest_image(oldFrame, gSLICr_engine->Get_Input_Buffer(_settings.img_size));
+		    
+		    sdkResetTimer(&my_timer);
+		    sdkStartTimer(&my_timer);
+			gSLICr_engine->Process_Input_Buffer();
+			sdkStopTimer(&my_timer);
+			std::cout<<"\rsegmentation in:["<<sdkGetTimerValue(&my_timer)<<"]ms" << std::flush;
+		    
+			gSLICr_engine->Draw_Segmentation_Result(out_img.get());
+
+			if (!queue)
+			{
+				load_image(out_img.get(), boundry_draw_frame);
+				writeFrameFiles(*gSLICr_engine, boundry_draw_frame, (int)current_frame);
+			}
+			else
+			{
+				// A new image per frame, the encoder may still hold the previous ones
+				EncodedFrame encoded;
+				encoded.frame_index = (uint32_t)current_frame;
+				encoded.viz.create(s, CV_8UC3);
+				load_image(out_img.get(), encoded.viz);
+				StreamSegmenter::packFrame((uint32_t)current_frame, *gSLICr_engine, encoded.record);
+
+				// Fails once the encoder has given up
+				if (!queue->push(std::move(encoded))) { break; }
+			}
+			
+			current_frame += frame_step;
+			cap.set(CV_CAP_PROP_POS_FRAMES, current_frame);
+		}
+	}
 
 	void VideoSegmenter::segment()
 	{
@@ -59,56 +192,126 @@ namespace Superpixels
 		}
 		cv::Size s(_settings.img_size.x, _settings.img_size.y);
 
+		if (_video_output == FRAMES)
+		{
+			segmentFrames(cap, nullptr);
+			return;
+		}
 
-		// Instantiate a core_engine
-		gSLICr::engines::core_engine* gSLICr_engine = new gSLICr::engines::core_engine(_settings);
+		// The output plays the sampled frames at the source speed
+		double fps = cap.get(CV_CAP_PROP_FPS);
+		if (fps <= 0) { fps = 25.0; }
+		if (_sampling_rate > 0) { fps /= _sampling_rate; }
 
-		// gSLICr takes gSLICr::UChar4Image as input and output
-		gSLICr::UChar4Image* in_img = new gSLICr::UChar4Image(_settings.img_size, true, true);
-		gSLICr::UChar4Image* out_img = new gSLICr::UChar4Image(_settings.img_size, true, true);
+		// Open the outputs up front so that failures show before segmenting
+		cv::VideoWriter video_writer;
+		std::unique_ptr<Y4MWriter> y4m_writer;
+		if (_video_output == VIDEO)
+		{
+			const std::string video_path = Util::Files::joinPathAndFile(_output_root, "viz.avi");
+			const int fourcc = CV_FOURCC(_video_codec[0], _video_codec[1], _video_codec[2], _video_codec[3]);
+			if (!video_writer.open(video_path, fourcc, fps, s, true))
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, "Could not open '" + video_path + "' for writing with codec " + _video_codec)
+			}
+		}
+		else
+		{
+			y4m_writer.reset(new Y4MWriter(Util::Files::joinPathAndFile(_output_root, "viz.y4m"), s, fps));
+		}
 
+		const std::string labels_path = Util::Files::joinPathAndFile(_output_root, "labels.slcf");
+		std::unique_ptr<std::FILE, int (*)(std::FILE *)> labels(std::fopen(labels_path.c_str(), "wb"), std::fclose);
+		if (!labels) { EXCEPTION_THROWER(Util::Exception::IOException, "Could not open '" + labels_path + "'") }
 
-		cv::Mat oldFrame, frame;
-		cv::Mat boundry_draw_frame;
-		boundry_draw_frame.create(s, CV_8UC3);
+		// Encode on a separate thread, a full queue holds the segmentation back
+		Util::Concurrency::BlockingQueue<EncodedFrame> queue(ENCODER_QUEUE_SIZE);
+		std::exception_ptr encoder_error;
+		std::vector<std::pair<uint32_t, uint64_t> > record_offsets;
+		uint64_t index_offset = 0;
+		std::thread encoder([&]()
+		{
+			try
+			{
+				EncodedFrame encoded;
+				while (queue.pop(encoded))
+				{
+					if (y4m_writer) { y4m_writer->write(encoded.viz); }
+					else
+					{
+						// write() does not report errors, a failing backend closes the writer
+						video_writer.write(encoded.viz);
+						if (!video_writer.isOpened())
+						{
+							EXCEPTION_THROWER(Util::Exception::IOException, "Error writing the " + _video_codec + " video")
+						}
+					}
 
-		StopWatchInterface *my_timer;
-		sdkCreateTimer(&my_timer);
+					record_offsets.push_back(std::make_pair(encoded.frame_index, index_offset));
+					index_offset += encoded.record.size();
+					if (std::fwrite(encoded.record.data(), encoded.record.size(), 1, labels.get()) != 1)
+					{
+						EXCEPTION_THROWER(Util::Exception::IOException, "Error writing '" + labels_path + "'")
+					}
+				}
+			}
+			catch (...)
+			{
+				encoder_error = std::current_exception();
+				queue.close();
+			}
+		});
 
-		int save_count = 0;
+		try
+		{
+			segmentFrames(cap, &queue);
+		}
+		catch (...)
+		{
+			queue.close();
+			encoder.join();
+			throw;
+		}
 
-		double frame_step = _sampling_rate;
-		double current_frame = 0;
-		cap.set(CV_CAP_PROP_POS_FRAMES, current_frame);
+		// Let the encoder finish the queued frames
+		queue.close();
+		encoder.join();
+		if (encoder_error) { std::rethrow_exception(encoder_error); }
 
-		while (cap.read(oldFrame))
+		// The record index and its footer (see the header), right after the records
+		std::vector<char> index(sizeof(INDEX_MAGIC) + sizeof(uint32_t)
+			+ record_offsets.size() * (sizeof(uint32_t) + sizeof(uint64_t)) + sizeof(uint64_t) + sizeof(INDEX_MAGIC));
+		char *entry = index.data();
+		const uint32_t num_frames = (uint32_t)record_offsets.size();
+		std::memcpy(entry, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+		entry += sizeof(INDEX_MAGIC);
+		std::memcpy(entry, &num_frames, sizeof(num_frames));
+		entry += sizeof(num_frames);
+		for (const auto &frame_offset : record_offsets)
 		{
+			std::memcpy(entry, &frame_offset.first, sizeof(frame_offset.first));
+			std::memcpy(entry + sizeof(frame_offset.first), &frame_offset.second, sizeof(frame_offset.second));
+			entry += sizeof(frame_offset.first) + sizeof(frame_offset.second);
+		}
+		std::memcpy(entry, &index_offset, sizeof(index_offset));
+		std::memcpy(entry + sizeof(index_offset), INDEX_MAGIC, sizeof(INDEX_MAGIC));
 
-			cv::resize(oldFrame, frame, s);
-			
-			load_image(frame, in_img);
-		    
-		    sdkResetTimer(&my_timer);
-		    sdkStartTimer(&my_timer);
-			gSLICr_engine->Process_Frame(in_img);
-			sdkStopTimer(&my_timer);
-			std::cout<<"\rsegmentation in:["<<sdkGetTimerValue(&my_timer)<<"]ms" << std::flush;
-		    
-			gSLICr_engine->Draw_Segmentation_Result(out_img);
-			
-			load_image(out_img, boundry_draw_frame);
-			char out_name[100];
-
-			sprintf(out_name, Util::Files::joinPathAndFile(_output_root, "img_%06i.png.slic.pgm").c_str(), (int)current_frame);
-			gSLICr_engine->Write_Seg_Res_To_PGM(out_name);
-			sprintf(out_name, Util::Files::joinPathAndFile(_output_root, "img_%06i.png.centers.txt").c_str(), (int)current_frame);
-			gSLICr_engine->Write_Superpixel_Info_To_TXT(out_name, _settings.color_space);
-			sprintf(out_name, Util::Files::joinPathAndFile(_output_root, "img_%06i.png.viz.png").c_str(), (int)current_frame);
-			imwrite(out_name, boundry_draw_frame);
-			
-			save_count++;
-			current_frame += frame_step;
-			cap.set(CV_CAP_PROP_POS_FRAMES, current_frame);
+		if (std::fwrite(index.data(), index.size(), 1, labels.get()) != 1 || std::fflush(labels.get()) != 0)
+		{
+			EXCEPTION_THROWER(Util::Exception::IOException, "Error writing '" + labels_path + "'")
+		}
+
+		// Frames went to the writer, an empty file means the backend dropped them
+		video_writer.release();
+		if (_video_output == VIDEO && !record_offsets.empty())
+		{
+			const std::string video_path = Util::Files::joinPathAndFile(_output_root, "viz.avi");
+			boost::system::error_code error;
+			const uintmax_t video_size = boost::filesystem::file_size(video_path, error);
+			if (error || video_size == 0)
+			{
+				EXCEPTION_THROWER(Util::Exception::IOException, "Error writing '" + video_path + "'")
+			}
 		}
 	}
 
@@ -2,30 +2,87 @@
 #define SUPERPIXELS_SRC_CORE_VIDEO_SEGMENTER_H_
 
 #include "segmenter.h"
+#include "blocking_queue.h"
 
+#include <cstdint>
+#include <cstdio>
 #include <string>
+#include <vector>
 
 namespace Superpixels
 {
 
+	/**
+	 * Segments sampled frames of a video. By default every sampled frame gets
+	 * its own files (visualization PNG, PGM label map and superpixel TXT).
+	 *
+	 * With the VIDEO or Y4M output, the visualizations are encoded to a single
+	 * viz.avi (through cv::VideoWriter) or viz.y4m (raw 4:4:4 YUV4MPEG2) stream
+	 * and the label maps go to labels.slcf, one StreamSegmenter frame record
+	 * per sampled frame indexed by its frame number in the video. Both are
+	 * written by an encoder thread while the next frames are segmented.
+	 *
+	 * After the last record labels.slcf holds an index of the records, so that
+	 * a frame can be found without reading the ones before it (host byte order):
+	 *
+	 *   char     magic[4]        "SLCI"
+	 *   uint32   num_frames
+	 *   num_frames x { uint32 frame_index; uint64 offset; }   (of the record in the file)
+	 *   uint64   index_offset    offset of the "SLCI" above
+	 *   char     magic[4]        "SLCI"
+	 *
+	 * A reader seeks to the last 12 bytes for the index, a sequential reader
+	 * stops at the first magic that is not "SLCF".
+	 */
 	class VideoSegmenter : public Segmenter
 	{
 
+		public:
+			enum VideoOutput { FRAMES, VIDEO, Y4M };
+
 		private:
 			double _sampling_rate = 1.0;
+			VideoOutput _video_output = FRAMES;
+			std::string _video_codec = "MJPG";
+
+			// A segmented frame waiting for the encoder thread
+			struct EncodedFrame
+			{
+				uint32_t frame_index;
+				cv::Mat viz;
+				std::vector<char> record;
+			};
+
+			// Frames in flight between the segmentation and the encoder thread
+			static const size_t ENCODER_QUEUE_SIZE = 8;
+
+			static const char INDEX_MAGIC[4];
+
+			// Per-frame files, the original output
+			void writeFrameFiles(gSLICr::engines::core_engine &engine, const cv::Mat &viz, const int frame_index) const;
+
+			// Segment the sampled frames, handing each to the encoder through the queue when given
+			void segmentFrames(cv::VideoCapture &cap, Util::Concurrency::BlockingQueue<EncodedFrame> *queue);
 
 		public:
 			VideoSegmenter(const SLICSettings &settings);
 			
 			inline void setSamplingRate(const double sampling_rate);
+			inline void setVideoOutput(const VideoOutput video_output);
+			// FourCC of the cv::VideoWriter codec
+			void setVideoCodec(const std::string &video_codec);
+
+			// Parse "frames", "video" or "y4m"
+			static VideoOutput parseVideoOutput(const std::string &name);
 
 			virtual void setInput(const std::string &input_video);
 			virtual void segment();
 	};
 
 	void VideoSegmenter::setSamplingRate(const double sampling_rate) { _sampling_rate = sampling_rate; }
+	void VideoSegmenter::setVideoOutput(const VideoOutput video_output) { _video_output = video_output; }
 
 
 } // namespace Superpixels
 
-#endif // SUPERPIXELS_SRC_CORE_VIDEO_SEGMENTER_H_
\ No newline at end of file
+#endif // SUPERPIXELS_SRC_CORE_VIDEO_SEGMENTER_H_
@@ -16,6 +16,9 @@ int main(int arg, char ** argv)
 		if (parseImageSegmenterCommandLine(arg, argv, user_options)) { return -1; }
 		SLICSettings slic_settings(user_options);
 
+		// Engines and images are rebuilt per image, their host buffers are recycled
+		ORUtils::MemoryAllocators::DefaultHostPool().SetCapacity((size_t)user_options.host_pool_mb << 20);
+
 		// TODO: Make this more elegant (factory function?)
 		if (user_options.large_scale)
 		{
@@ -23,6 +26,14 @@ int main(int arg, char ** argv)
 			recursive_image_segmenter.setInput(user_options.input_path);
 			recursive_image_segmenter.setOutputDirectory(user_options.output_path);
 			recursive_image_segmenter.setExtension(user_options.ext);
+			recursive_image_segmenter.setManifest(user_options.manifest);
+			recursive_image_segmenter.setScanThreads(user_options.scan_threads);
+			recursive_image_segmenter.setJournal(user_options.journal);
+			recursive_image_segmenter.setCacheDirectory(user_options.cache_dir);
+			recursive_image_segmenter.setVizCodec(user_options.viz_codec);
+			recursive_image_segmenter.setLabelCodec(user_options.label_codec);
+			recursive_image_segmenter.setWriterThreads(user_options.writer_threads);
+			recursive_image_segmenter.setWriterQueue(user_options.writer_queue);
 			if (user_options.use_scale)
 			{
 				recursive_image_segmenter.setScale(user_options.scale);
@@ -31,6 +42,7 @@ int main(int arg, char ** argv)
 			{
 				recursive_image_segmenter.setMaxSidelen(user_options.max_sidelen);
 			}
+			recursive_image_segmenter.setLetterboxStep(user_options.letterbox_step);
 			recursive_image_segmenter.setVerbose(user_options.verbose);
 
 			// Segment the image(s)
@@ -44,6 +56,14 @@ int main(int arg, char ** argv)
 			image_segmenter.setOutputDirectory(user_options.output_path);
 			image_segmenter.setExtension(user_options.ext);
 			image_segmenter.setRecursive(user_options.recursive);
+			image_segmenter.setManifest(user_options.manifest);
+			image_segmenter.setScanThreads(user_options.scan_threads);
+			image_segmenter.setJournal(user_options.journal);
+			image_segmenter.setCacheDirectory(user_options.cache_dir);
+			image_segmenter.setVizCodec(user_options.viz_codec);
+			image_segmenter.setLabelCodec(user_options.label_codec);
+			image_segmenter.setWriterThreads(user_options.writer_threads);
+			image_segmenter.setWriterQueue(user_options.writer_queue);
 			if (user_options.use_scale)
 			{
 				image_segmenter.setScale(user_options.scale);
@@ -52,12 +72,20 @@ int main(int arg, char ** argv)
 			{
 				image_segmenter.setMaxSidelen(user_options.max_sidelen);
 			}
+			image_segmenter.setLetterboxStep(user_options.letterbox_step);
 			image_segmenter.setVerbose(user_options.verbose);
 
 			// Segment the image(s)
 			image_segmenter.segment();
 		}
 
+		if (user_options.verbose)
+		{
+			ORUtils::RecyclingAllocator::Stats stats = ORUtils::MemoryAllocators::DefaultHostPool().GetStats();
+			std::cout << "Host buffer pool: " << stats.hits << " hits, " << stats.misses << " misses, "
+				<< stats.releases << " releases, " << (stats.cachedBytes >> 20) << " MB cached" << std::endl;
+		}
+
 		return 0;
 	}
 	catch (const std::exception &e)
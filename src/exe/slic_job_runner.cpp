@@ -0,0 +1,38 @@
+#include "../core/job_runner.h"
+#include "../core/util.h"
+#include "../core/options.h"
+
+#include <iostream>
+
+
+int main(int arg, char ** argv)
+{
+	try
+	{
+		// Parse command line arguments, they become the defaults of every job
+		Superpixels::SuperpixelUserOptions user_options;
+		if (Superpixels::parseJobRunnerCommandLine(arg, argv, user_options)) { return -1; }
+
+		// Engines are kept per settings profile, their host buffers are recycled
+		ORUtils::MemoryAllocators::DefaultHostPool().SetCapacity((size_t)user_options.host_pool_mb << 20);
+
+		// Create the runner and set parameters
+		Superpixels::JobRunner runner(user_options);
+		runner.setVizCodec(user_options.viz_codec);
+		runner.setLabelCodec(user_options.label_codec);
+		runner.setWriterThreads(user_options.writer_threads);
+		runner.setWriterQueue(user_options.writer_queue);
+		runner.setMaxEngines(user_options.max_engines);
+		runner.setVerbose(user_options.verbose);
+
+		// Run every job of the manifest
+		runner.run(user_options.jobs_path);
+
+		return 0;
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
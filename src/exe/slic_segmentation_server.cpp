@@ -0,0 +1,33 @@
+#include "../core/segmentation_server.h"
+#include "../core/util.h"
+#include "../core/options.h"
+
+#include <iostream>
+
+
+int main(int arg, char ** argv)
+{
+	try
+	{
+		// Parse command line arguments, they become the defaults of every request
+		Superpixels::SuperpixelUserOptions user_options;
+		if (Superpixels::parseSegmentationServerCommandLine(arg, argv, user_options)) { return -1; }
+
+		// Create the server and set parameters
+		Superpixels::SegmentationServer server(user_options);
+		server.setSocketPath(user_options.socket_path);
+		server.setMaxClients(user_options.max_clients);
+		server.setMaxEngines(user_options.max_engines);
+		server.setVerbose(user_options.verbose);
+
+		// Serve requests until interrupted
+		server.serve();
+
+		return 0;
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
@@ -0,0 +1,43 @@
+#include "../core/stream_segmenter.h"
+#include "../core/util.h"
+#include "../core/options.h"
+
+#include <iostream>
+
+
+int main(int arg, char ** argv)
+{
+	try
+	{
+		// Parse command line arguments
+		Superpixels::SuperpixelUserOptions user_options;
+		if (Superpixels::parseStreamSegmenterCommandLine(arg, argv, user_options)) { return -1; }
+		Superpixels::SLICSettings slic_settings(user_options);
+
+		// Create stream segmenter and set parameters
+		Superpixels::StreamSegmenter stream_segmenter(slic_settings);
+		stream_segmenter.setInput(user_options.input_path);
+		stream_segmenter.setOutputDirectory(user_options.output_path);
+		stream_segmenter.setFrameSize(user_options.frame_width, user_options.frame_height);
+		stream_segmenter.setPixelFormat(Superpixels::StreamSegmenter::parsePixelFormat(user_options.pixel_format));
+		if (user_options.use_scale)
+		{
+			stream_segmenter.setScale(user_options.scale);
+		}
+		else
+		{
+			stream_segmenter.setMaxSidelen(user_options.max_sidelen);
+		}
+		stream_segmenter.setVerbose(user_options.verbose);
+
+		// Segment frames until the input ends
+		stream_segmenter.segment();
+
+		return 0;
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
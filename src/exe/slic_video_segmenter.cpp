@@ -19,6 +19,8 @@ int main(int arg, char ** argv)
 		video_segmenter.setInput(user_options.input_path);
 		video_segmenter.setOutputDirectory(user_options.output_path);
 		video_segmenter.setSamplingRate(user_options.sampling_rate);
+		video_segmenter.setVideoOutput(Superpixels::VideoSegmenter::parseVideoOutput(user_options.video_output));
+		video_segmenter.setVideoCodec(user_options.video_codec);
 		if (user_options.use_scale)
 		{
 			video_segmenter.setScale(user_options.scale);
@@ -40,22 +40,16 @@ namespace ORUtils
 			this->noDims = noDims;
 		}
 
-		/** Resize an image, loosing all old image data.
-		Essentially any previously allocated data is
-		released, new memory is allocated.
+		/** Resize an image, the old image data is not
+		preserved. Memory is only reallocated when the new
+		size does not fit the current allocation.
 		*/
 		void ChangeDims(Vector2<int> newDims)
 		{
 			if (newDims != noDims)
 			{
 				this->noDims = newDims;
-
-				bool allocate_CPU = this->isAllocated_CPU;
-				bool allocate_CUDA = this->isAllocated_CUDA;
-				bool metalCompatible = this->isMetalCompatible;
-
-				this->Free();
-				this->Allocate(newDims.x * newDims.y, allocate_CPU, allocate_CUDA, metalCompatible);
+				this->Resize(newDims.x * newDims.y);
 			}
 		}
 
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "PlatformIndependence.h"
+#include "MemoryPool.h"
 
 #ifndef COMPILE_WITHOUT_CUDA
 #include "CUDADefines.h"
@@ -35,6 +36,9 @@ namespace ORUtils
 	protected:
 #ifndef __METALC__
 		bool isAllocated_CPU, isAllocated_CUDA, isMetalCompatible;
+
+		/** Allocators the current data came from (and goes back to). */
+		MemoryAllocator *allocator_CPU, *allocator_CUDA;
 #endif
 		/** Pointer to memory on CPU host. */
 		DEVICEPTR(T)* data_cpu;
@@ -52,9 +56,12 @@ namespace ORUtils
 	public:
 		enum MemoryCopyDirection { CPU_TO_CPU, CPU_TO_CUDA, CUDA_TO_CPU, CUDA_TO_CUDA };
 
-		/** Total number of allocated entries in the data array. */
+		/** Number of entries in use in the data array. */
 		size_t dataSize;
 
+		/** Number of entries allocated, dataSize never exceeds it. */
+		size_t dataCapacity;
+
 		/** Get the data pointer on CPU or GPU. */
 		inline DEVICEPTR(T)* GetData(MemoryDeviceType memoryType)
 		{
@@ -167,6 +174,25 @@ namespace ORUtils
 
 		virtual ~MemoryBlock() { this->Free(); }
 
+		/** Change the number of entries in use. The allocation is
+		kept when it is large enough, otherwise it is replaced by a
+		larger one and the old data is lost.
+		*/
+		void Resize(size_t newDataSize)
+		{
+			if (newDataSize <= dataCapacity)
+			{
+				dataSize = newDataSize;
+				return;
+			}
+
+			bool allocate_CPU = this->isAllocated_CPU;
+			bool allocate_CUDA = this->isAllocated_CUDA;
+			bool metalCompatible = this->isMetalCompatible;
+
+			Allocate(newDataSize, allocate_CPU, allocate_CUDA, metalCompatible);
+		}
+
 		/** Allocate image data of the specified size. If the
 		data has been allocated before, the data is freed.
 		*/
@@ -175,6 +201,7 @@ namespace ORUtils
 			Free();
 
 			this->dataSize = dataSize;
+			this->dataCapacity = dataSize;
 
 			if (allocate_CPU)
 			{
@@ -189,12 +216,12 @@ namespace ORUtils
 				switch (allocType)
 				{
 				case 0:
-					data_cpu = new T[dataSize];
+					allocator_CPU = &MemoryAllocators::Host();
+					data_cpu = (T*)allocator_CPU->Allocate(dataSize * sizeof(T), MEMORYALLOC_HOST);
 					break;
 				case 1:
-#ifndef COMPILE_WITHOUT_CUDA
-					ORcudaSafeCall(cudaMallocHost((void**)&data_cpu, dataSize * sizeof(T)));
-#endif
+					allocator_CPU = &MemoryAllocators::Host();
+					data_cpu = (T*)allocator_CPU->Allocate(dataSize * sizeof(T), MEMORYALLOC_PINNED);
 					break;
 				case 2:
 #ifdef COMPILE_WITH_METAL
@@ -210,7 +237,8 @@ namespace ORUtils
 			if (allocate_CUDA)
 			{
 #ifndef COMPILE_WITHOUT_CUDA
-				ORcudaSafeCall(cudaMalloc((void**)&data_cuda, dataSize * sizeof(T)));
+				allocator_CUDA = &MemoryAllocators::Device();
+				data_cuda = (T*)allocator_CUDA->Allocate(dataSize * sizeof(T), MEMORYALLOC_CUDA);
 				this->isAllocated_CUDA = allocate_CUDA;
 #endif
 			}
@@ -231,16 +259,14 @@ namespace ORUtils
 				switch (allocType)
 				{
 				case 0:
-					delete[] data_cpu;
+					allocator_CPU->Free(data_cpu, dataCapacity * sizeof(T), MEMORYALLOC_HOST);
 					break;
 				case 1:
-#ifndef COMPILE_WITHOUT_CUDA
-					ORcudaSafeCall(cudaFreeHost(data_cpu));
-#endif
+					allocator_CPU->Free(data_cpu, dataCapacity * sizeof(T), MEMORYALLOC_PINNED);
 					break;
 				case 2:
 #ifdef COMPILE_WITH_METAL
-					freeMetalData((void**)&data_cpu, (void**)&data_metalBuffer, dataSize * sizeof(T), true);
+					freeMetalData((void**)&data_cpu, (void**)&data_metalBuffer, dataCapacity * sizeof(T), true);
 #endif
 					break;
 				}
@@ -252,7 +278,7 @@ namespace ORUtils
 			if (isAllocated_CUDA)
 			{
 #ifndef COMPILE_WITHOUT_CUDA
-				ORcudaSafeCall(cudaFree(data_cuda));
+				allocator_CUDA->Free(data_cuda, dataCapacity * sizeof(T), MEMORYALLOC_CUDA);
 #endif
 				isAllocated_CUDA = false;
 			}
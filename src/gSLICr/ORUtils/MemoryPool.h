@@ -0,0 +1,244 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+#pragma once
+
+#ifndef __METALC__
+
+#ifndef COMPILE_WITHOUT_CUDA
+#include "CUDADefines.h"
+#endif
+
+#include <stddef.h>
+
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ORUtils
+{
+	/** Kinds of memory a MemoryBlock asks for. */
+	enum MemoryAllocationType { MEMORYALLOC_HOST, MEMORYALLOC_PINNED, MEMORYALLOC_CUDA, MEMORYALLOC_TYPES };
+
+	/** \brief
+	Source of the raw memory behind MemoryBlock. A block is always freed
+	through the allocator that allocated it, with the same size and type.
+	*/
+	class MemoryAllocator
+	{
+	public:
+		virtual ~MemoryAllocator() {}
+
+		virtual void* Allocate(size_t bytes, MemoryAllocationType type) = 0;
+		virtual void Free(void *ptr, size_t bytes, MemoryAllocationType type) = 0;
+	};
+
+	/** \brief
+	Allocates and frees straight from the system (or the CUDA runtime).
+	*/
+	class DirectAllocator : public MemoryAllocator
+	{
+	public:
+		void* Allocate(size_t bytes, MemoryAllocationType type)
+		{
+			void *ptr = NULL;
+			switch (type)
+			{
+			case MEMORYALLOC_HOST:
+				ptr = ::operator new(bytes);
+				break;
+#ifndef COMPILE_WITHOUT_CUDA
+			case MEMORYALLOC_PINNED:
+				ORcudaSafeCall(cudaMallocHost(&ptr, bytes));
+				break;
+			case MEMORYALLOC_CUDA:
+				ORcudaSafeCall(cudaMalloc(&ptr, bytes));
+				break;
+#endif
+			default: break;
+			}
+			return ptr;
+		}
+
+		void Free(void *ptr, size_t, MemoryAllocationType type)
+		{
+			switch (type)
+			{
+			case MEMORYALLOC_HOST:
+				::operator delete(ptr);
+				break;
+#ifndef COMPILE_WITHOUT_CUDA
+			case MEMORYALLOC_PINNED:
+				ORcudaSafeCall(cudaFreeHost(ptr));
+				break;
+			case MEMORYALLOC_CUDA:
+				ORcudaSafeCall(cudaFree(ptr));
+				break;
+#endif
+			default: break;
+			}
+		}
+
+		static DirectAllocator& Instance()
+		{
+			// never destroyed, blocks may be freed during static destruction
+			static DirectAllocator *instance = new DirectAllocator();
+			return *instance;
+		}
+	};
+
+	/** \brief
+	Keeps freed blocks in per-type free lists of size classes and hands
+	them out again, so that repeatedly building and destroying blocks of
+	the same sizes stops reaching the system allocator.
+
+	Sizes are rounded up to classes four to a power of two (at most 25%
+	slack). Freed blocks are kept while the cached bytes stay under the
+	capacity, beyond it they are released.
+	*/
+	class RecyclingAllocator : public MemoryAllocator
+	{
+	public:
+		struct Stats
+		{
+			size_t hits, misses;
+			// freed blocks released because the cache was full
+			size_t releases;
+			size_t cachedBytes;
+		};
+
+	private:
+		static const size_t MIN_CLASS_BYTES = 256;
+
+		MemoryAllocator &upstream;
+		size_t capacity;
+		std::map<size_t, std::vector<void*> > freeLists[MEMORYALLOC_TYPES];
+		Stats stats;
+		std::mutex mutex;
+
+		static size_t SizeClass(size_t bytes)
+		{
+			if (bytes <= MIN_CLASS_BYTES) return MIN_CLASS_BYTES;
+
+			size_t step = MIN_CLASS_BYTES / 4;
+			while (step * 8 <= bytes) step *= 2;
+			return (bytes + step - 1) / step * step;
+		}
+
+	public:
+		/** Cached (free) bytes are kept under @p capacity. */
+		RecyclingAllocator(size_t capacity = (size_t)512 << 20, MemoryAllocator &upstream = DirectAllocator::Instance())
+			: upstream(upstream), capacity(capacity)
+		{
+			stats.hits = stats.misses = stats.releases = stats.cachedBytes = 0;
+		}
+
+		~RecyclingAllocator() { Trim(); }
+
+		void* Allocate(size_t bytes, MemoryAllocationType type)
+		{
+			size_t classBytes = SizeClass(bytes);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				std::map<size_t, std::vector<void*> >::iterator it = freeLists[type].find(classBytes);
+				if (it != freeLists[type].end() && !it->second.empty())
+				{
+					void *ptr = it->second.back();
+					it->second.pop_back();
+					stats.cachedBytes -= classBytes;
+					stats.hits++;
+					return ptr;
+				}
+				stats.misses++;
+			}
+			return upstream.Allocate(classBytes, type);
+		}
+
+		void Free(void *ptr, size_t bytes, MemoryAllocationType type)
+		{
+			if (ptr == NULL) return;
+
+			size_t classBytes = SizeClass(bytes);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (stats.cachedBytes + classBytes <= capacity)
+				{
+					freeLists[type][classBytes].push_back(ptr);
+					stats.cachedBytes += classBytes;
+					return;
+				}
+				stats.releases++;
+			}
+			upstream.Free(ptr, classBytes, type);
+		}
+
+		/** Release every cached block. */
+		void Trim()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (int type = 0; type < MEMORYALLOC_TYPES; type++)
+			{
+				for (std::map<size_t, std::vector<void*> >::iterator it = freeLists[type].begin(); it != freeLists[type].end(); ++it)
+				{
+					for (size_t i = 0; i < it->second.size(); i++) upstream.Free(it->second[i], it->first, (MemoryAllocationType)type);
+				}
+				freeLists[type].clear();
+			}
+			stats.cachedBytes = 0;
+		}
+
+		/** Change the capacity, releasing cached blocks if it shrinks below them. */
+		void SetCapacity(size_t capacity)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				this->capacity = capacity;
+				if (stats.cachedBytes <= capacity) return;
+			}
+			Trim();
+		}
+
+		Stats GetStats()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return stats;
+		}
+	};
+
+	/** \brief
+	Allocators used by newly allocated MemoryBlocks: host memory (plain and
+	pinned) is recycled by default, device memory comes from the runtime.
+	*/
+	class MemoryAllocators
+	{
+		static MemoryAllocator*& HostSlot()
+		{
+			static MemoryAllocator *allocator = &DefaultHostPool();
+			return allocator;
+		}
+
+		static MemoryAllocator*& DeviceSlot()
+		{
+			static MemoryAllocator *allocator = &DirectAllocator::Instance();
+			return allocator;
+		}
+
+	public:
+		/** The default host allocator, e.g. to read its stats or set its capacity. */
+		static RecyclingAllocator& DefaultHostPool()
+		{
+			// never destroyed, blocks may be freed during static destruction
+			static RecyclingAllocator *pool = new RecyclingAllocator();
+			return *pool;
+		}
+
+		static MemoryAllocator& Host() { return *HostSlot(); }
+		static MemoryAllocator& Device() { return *DeviceSlot(); }
+
+		/** Blocks allocated before the change are still freed through their own allocator. */
+		static void SetHost(MemoryAllocator &allocator) { HostSlot() = &allocator; }
+		static void SetDevice(MemoryAllocator &allocator) { DeviceSlot() = &allocator; }
+	};
+}
+
+#endif
@@ -15,7 +15,14 @@ using namespace std;
 
 gSLICr::engines::core_engine::core_engine(const objects::settings& in_settings)
 {
-	slic_seg_engine = new seg_engine_GPU(in_settings);
+	if (in_settings.device_type == DEVICE_CPU)
+	{
+		slic_seg_engine = new seg_engine_CPU(in_settings);
+	}
+	else
+	{
+		slic_seg_engine = new seg_engine_GPU(in_settings);
+	}
 }
 
 gSLICr::engines::core_engine::~core_engine()
@@ -28,11 +35,109 @@ void gSLICr::engines::core_engine::Process_Frame(UChar4Image* in_img)
 	slic_seg_engine->Perform_Segmentation(in_img);
 }
 
+void gSLICr::engines::core_engine::Process_Frame(UChar4Image* in_img, Vector2i content_size)
+{
+	slic_seg_engine->Perform_Segmentation(in_img, content_size);
+}
+
+UChar4Image* gSLICr::engines::core_engine::Get_Input_Buffer(Vector2i img_size)
+{
+	return slic_seg_engine->Get_Source_Img(img_size);
+}
+
+void gSLICr::engines::core_engine::Process_Input_Buffer()
+{
+	slic_seg_engine->Perform_Segmentation();
+}
+
+void gSLICr::engines::core_engine::Process_Input_Buffer(Vector2i content_size)
+{
+	slic_seg_engine->Perform_Segmentation(content_size);
+}
+
+Vector2i gSLICr::engines::core_engine::Get_Content_Size()
+{
+	return slic_seg_engine->Get_Content_Size();
+}
+
+void gSLICr::engines::core_engine::Reshape(Vector2i img_size)
+{
+	slic_seg_engine->Reshape(img_size);
+}
+
+void gSLICr::engines::core_engine::Reconfigure(const objects::settings& in_settings)
+{
+	const objects::settings& old_settings = slic_seg_engine->Get_Settings();
+	if (in_settings.device_type == old_settings.device_type && in_settings.cpu_isa == old_settings.cpu_isa)
+	{
+		slic_seg_engine->Reconfigure(in_settings);
+		return;
+	}
+
+	delete slic_seg_engine;
+	if (in_settings.device_type == DEVICE_CPU)
+	{
+		slic_seg_engine = new seg_engine_CPU(in_settings);
+	}
+	else
+	{
+		slic_seg_engine = new seg_engine_GPU(in_settings);
+	}
+}
+
+const char* gSLICr::engines::core_engine::Get_Backend_Name()
+{
+	return slic_seg_engine->Get_Backend_Name();
+}
+
 const IntImage * gSLICr::engines::core_engine::Get_Seg_Res()
 {
 	return slic_seg_engine->Get_Seg_Mask();
 }
 
+const SpixelMap * gSLICr::engines::core_engine::Get_Spixel_Map()
+{
+	return slic_seg_engine->Get_Superpixel_Map();
+}
+
+const IntImage * gSLICr::engines::core_engine::Get_Label_Table()
+{
+	return slic_seg_engine->Get_Label_Table();
+}
+
+int gSLICr::engines::core_engine::Get_No_Labels()
+{
+	return slic_seg_engine->Get_No_Labels();
+}
+
+std::vector<std::pair<int, spixel_info> > gSLICr::engines::core_engine::Get_Label_Spixels()
+{
+	SpixelMap* spixel_map = slic_seg_engine->Get_Superpixel_Map();
+	const spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
+	const IntImage* label_table = slic_seg_engine->Get_Label_Table();
+
+	std::vector<std::pair<int, spixel_info> > label_spixels;
+	if (label_table != NULL)
+	{
+		// dense labels go through the table
+		const int* table = label_table->GetData(MEMORYDEVICE_CPU);
+		for (int k = 0; k < slic_seg_engine->Get_No_Labels(); k++)
+		{
+			label_spixels.push_back(std::make_pair(k, spixel_list[table[k]]));
+		}
+	}
+	else
+	{
+		// cells of a padded border have no label
+		for (size_t i = 0; i < spixel_map->dataSize; i++)
+		{
+			if (spixel_list[i].id < 0) continue;
+			label_spixels.push_back(std::make_pair(spixel_list[i].id, spixel_list[i]));
+		}
+	}
+	return label_spixels;
+}
+
 void gSLICr::engines::core_engine::Draw_Segmentation_Result(UChar4Image* out_img)
 {
 	slic_seg_engine->Draw_Segmentation_Result(out_img);
@@ -46,15 +151,16 @@ void gSLICr::engines::core_engine::Draw_Boundary_Only(UChar4Image* out_img)
 void gSLICr::engines::core_engine::Write_Seg_Res_To_PGM(const char* fileName)
 {
 	const IntImage* idx_img = slic_seg_engine->Get_Seg_Mask();
-	int width = idx_img->noDims.x;
-	int height = idx_img->noDims.y;
+	int stride = idx_img->noDims.x;
+	int width = slic_seg_engine->Get_Content_Size().x;
+	int height = slic_seg_engine->Get_Content_Size().y;
 	const int* data_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
 
 	ofstream f(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
 	f << "P5\n" << width << " " << height << "\n65535\n";
 	for (int i = 0; i < height * width; ++i)
 	{
-		ushort label = (ushort)data_ptr[i];
+		ushort label = (ushort)data_ptr[(i / width) * stride + i % width];
 		ushort label_buffer = (label << 8 | label >> 8);
 		f.write((const char*)&label_buffer, sizeof(ushort));
 	}
@@ -65,15 +171,10 @@ bool gSLICr::engines::core_engine::Write_Centroids_To_Binary(const char* fileNam
 {
 	unordered_map<ushort, std::pair<float, float>> centroids;
 
-	// Get Get_Superpixel_Map
-	SpixelMap* spixel_map = slic_seg_engine->Get_Superpixel_Map();
-	const size_t num_segs = spixel_map->dataSize;
-	spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
-
 	// Go through all superpixels and make an ID-->(Cx,Cy) map
-	for (int i = 0; i < num_segs; i++)
+	for (const auto& label_spixel : Get_Label_Spixels())
 	{
-			centroids.emplace(spixel_list[i].id, std::make_pair(spixel_list[i].center.x, spixel_list[i].center.y));
+			centroids.emplace(label_spixel.first, std::make_pair(label_spixel.second.center.x, label_spixel.second.center.y));
 	}
 
 	if (centroids.size() == 0)
@@ -82,8 +183,9 @@ bool gSLICr::engines::core_engine::Write_Centroids_To_Binary(const char* fileNam
 	}
 
 	const IntImage* idx_img = slic_seg_engine->Get_Seg_Mask();
-	int width = idx_img->noDims.x;
-	int height = idx_img->noDims.y;
+	int stride = idx_img->noDims.x;
+	int width = slic_seg_engine->Get_Content_Size().x;
+	int height = slic_seg_engine->Get_Content_Size().y;
 	const int* data_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
 
 	ofstream f(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
@@ -93,7 +195,7 @@ bool gSLICr::engines::core_engine::Write_Centroids_To_Binary(const char* fileNam
 	f.write((const char*)&width, sizeof(int));
 	for (int i = 0; i < height * width; ++i)
 	{
-		ushort label = (ushort)data_ptr[i];
+		ushort label = (ushort)data_ptr[(i / width) * stride + i % width];
 		ushort label_buffer = (label << 8 | label >> 8);
 		auto c = centroids.at(label);
 		f.write((const char*)&(c.first), sizeof(float));
@@ -108,18 +210,13 @@ bool gSLICr::engines::core_engine::Write_Colors_To_Binary(const char* fileName)
 {
 	unordered_map<ushort, std::tuple<float, float, float>> centroids;
 
-	// Get Get_Superpixel_Map
-	SpixelMap* spixel_map = slic_seg_engine->Get_Superpixel_Map();
-	const size_t num_segs = spixel_map->dataSize;
-	spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
-
 	// Go through all superpixels and make an ID-->(Cx,Cy) map
-	for (int i = 0; i < num_segs; i++)
+	for (const auto& label_spixel : Get_Label_Spixels())
 	{
-			centroids.emplace(spixel_list[i].id, 
-				std::make_tuple(spixel_list[i].color_info.r,
-					spixel_list[i].color_info.g,
-					spixel_list[i].color_info.b));
+			centroids.emplace(label_spixel.first, 
+				std::make_tuple(label_spixel.second.color_info.r,
+					label_spixel.second.color_info.g,
+					label_spixel.second.color_info.b));
 	}
 
 	if (centroids.size() == 0)
@@ -128,8 +225,9 @@ bool gSLICr::engines::core_engine::Write_Colors_To_Binary(const char* fileName)
 	}
 
 	const IntImage* idx_img = slic_seg_engine->Get_Seg_Mask();
-	int width = idx_img->noDims.x;
-	int height = idx_img->noDims.y;
+	int stride = idx_img->noDims.x;
+	int width = slic_seg_engine->Get_Content_Size().x;
+	int height = slic_seg_engine->Get_Content_Size().y;
 	const int* data_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
 
 	ofstream f(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
@@ -139,7 +237,7 @@ bool gSLICr::engines::core_engine::Write_Colors_To_Binary(const char* fileName)
 	f.write((const char*)&width, sizeof(int));
 	for (int i = 0; i < height * width; ++i)
 	{
-		ushort label = (ushort)data_ptr[i];
+		ushort label = (ushort)data_ptr[(i / width) * stride + i % width];
 		ushort label_buffer = (label << 8 | label >> 8);
 		auto c = centroids.at(label);
 		f.write((const char*)&(std::get<0>(c)), sizeof(float));
@@ -154,9 +252,13 @@ bool gSLICr::engines::core_engine::Write_Colors_To_Binary(const char* fileName)
 
 void gSLICr::engines::core_engine::Write_Superpixel_Info_To_TXT(const char* filename, gSLICr::COLOR_SPACE color_space)
 {
-	SpixelMap* spixel_map = slic_seg_engine->Get_Superpixel_Map();
-	const size_t num_segs = spixel_map->dataSize;
-	spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
+	// Empty superpixels are skipped, dense labels all hold pixels
+	bool dense = slic_seg_engine->Get_Label_Table() != NULL;
+	std::vector<std::pair<int, spixel_info> > rows;
+	for (const auto& label_spixel : Get_Label_Spixels())
+	{
+		if (dense || label_spixel.second.no_pixels > 0) rows.push_back(label_spixel);
+	}
 
 	// Open output file for writing
 	std::ofstream file;
@@ -175,20 +277,17 @@ void gSLICr::engines::core_engine::Write_Superpixel_Info_To_TXT(const char* file
 			file << "# ID NUM_PIX CX CY L A B A" << std::endl;
 			break;
 	}
-	file << num_segs << std::endl;
-	for (int i = 0; i < num_segs; i++)
+	file << rows.size() << std::endl;
+	for (const auto& row : rows)
 	{
-		if (spixel_list[i].no_pixels > 0)
-		{
-			file << spixel_list[i].id << " ";
-			file << spixel_list[i].no_pixels << " ";
-			file << spixel_list[i].center.x << " ";
-			file << spixel_list[i].center.y <<" ";
-			file << spixel_list[i].color_info.r << " ";
-			file << spixel_list[i].color_info.g << " ";
-			file << spixel_list[i].color_info.b << " ";
-			file << spixel_list[i].color_info.a << std::endl;
-		}
+		file << row.first << " ";
+		file << row.second.no_pixels << " ";
+		file << row.second.center.x << " ";
+		file << row.second.center.y <<" ";
+		file << row.second.color_info.r << " ";
+		file << row.second.color_info.g << " ";
+		file << row.second.color_info.b << " ";
+		file << row.second.color_info.a << std::endl;
 	}
 	file << std::endl;
 
@@ -2,8 +2,12 @@
 
 #pragma once
 #include "gSLICr_seg_engine_GPU.h"
+#include "gSLICr_seg_engine_CPU.h"
 #include "../gSLICr_defines.h"
 
+#include <utility>
+#include <vector>
+
 
 namespace gSLICr
 {
@@ -23,9 +27,47 @@ namespace gSLICr
 			// Function to segment in_img
 			void Process_Frame(UChar4Image* in_img);
 
+			// Segment only the top-left content_size part of in_img, the rest
+			// is a padded border that takes no part in the clustering and
+			// keeps the label -1 (frames of several sizes letterboxed to one)
+			void Process_Frame(UChar4Image* in_img, Vector2i content_size);
+
+			// The host image of img_size the next frame can be written into,
+			// Process_Input_Buffer then segments it without copying an in_img
+			UChar4Image* Get_Input_Buffer(Vector2i img_size);
+			void Process_Input_Buffer();
+			void Process_Input_Buffer(Vector2i content_size);
+
+			// The part of the last frame that was segmented, the writers
+			// below crop the result to it
+			Vector2i Get_Content_Size();
+
+			// Switch to frames of another size, memory is kept when it fits
+			// (Process_Frame also does it for a frame of another size)
+			void Reshape(Vector2i img_size);
+
+			// Take new settings, keeping the buffers unless the superpixel
+			// geometry changes (a new device or CPU instruction set rebuilds
+			// the engine)
+			void Reconfigure(const objects::settings& in_settings);
+
+			// Which backend (and CPU instruction set) runs the segmentation
+			const char* Get_Backend_Name();
+
 			// Function to get the pointer to the segmented mask image
 			const IntImage * Get_Seg_Res();
 
+			// The superpixel map the labels index, on the host
+			const SpixelMap * Get_Spixel_Map();
+
+			// With dense_labels, the labels are 0..Get_No_Labels()-1 and the
+			// table gives the superpixel map index of each (NULL otherwise)
+			const IntImage * Get_Label_Table();
+			int Get_No_Labels();
+
+			// Every label the segmentation result can hold, with its superpixel
+			std::vector<std::pair<int, objects::spixel_info> > Get_Label_Spixels();
+
 			// Function to draw segmentation result on out_img
 			void Draw_Segmentation_Result(UChar4Image* out_img);
 			
@@ -0,0 +1,158 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#include "gSLICr_cpu_dispatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace gSLICr;
+using namespace gSLICr::engines;
+
+bool gSLICr::engines::Is_CPU_ISA_Supported(CPU_ISA isa)
+{
+	switch (isa)
+	{
+	case CPU_ISA_SCALAR:
+		return true;
+#ifdef GSLICR_WITH_X86_KERNELS
+	case CPU_ISA_SSE42:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.2");
+	case CPU_ISA_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	case CPU_ISA_AVX512:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef GSLICR_WITH_NEON_KERNELS
+	case CPU_ISA_NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+CPU_ISA gSLICr::engines::Detect_CPU_ISA()
+{
+	static const CPU_ISA by_preference[] = { CPU_ISA_AVX512, CPU_ISA_AVX2, CPU_ISA_SSE42, CPU_ISA_NEON };
+
+	for (size_t i = 0; i < sizeof(by_preference) / sizeof(by_preference[0]); i++)
+	{
+		if (Is_CPU_ISA_Supported(by_preference[i])) return by_preference[i];
+	}
+	return CPU_ISA_SCALAR;
+}
+
+const char* gSLICr::engines::Get_CPU_ISA_Name(CPU_ISA isa)
+{
+	switch (isa)
+	{
+	case CPU_ISA_SCALAR: return "scalar";
+	case CPU_ISA_SSE42: return "sse4.2";
+	case CPU_ISA_AVX2: return "avx2";
+	case CPU_ISA_AVX512: return "avx512";
+	case CPU_ISA_NEON: return "neon";
+	default: return "auto";
+	}
+}
+
+CPU_ISA gSLICr::engines::Parse_CPU_ISA(const char* name)
+{
+	static const CPU_ISA all[] = { CPU_ISA_SCALAR, CPU_ISA_SSE42, CPU_ISA_AVX2, CPU_ISA_AVX512, CPU_ISA_NEON };
+
+	for (size_t i = 0; name != NULL && i < sizeof(all) / sizeof(all[0]); i++)
+	{
+		if (strcmp(name, Get_CPU_ISA_Name(all[i])) == 0) return all[i];
+	}
+	return CPU_ISA_AUTO;
+}
+
+// the conversion kernel of isa instantiated for color_space
+template <COLOR_SPACE color_space>
+static Cvt_Img_Row_Fn Select_Cvt_Img_Row(CPU_ISA isa)
+{
+	switch (isa)
+	{
+#ifdef GSLICR_WITH_X86_KERNELS
+	case CPU_ISA_SSE42:
+		return Cvt_Img_Row_SSE42<color_space>;
+	case CPU_ISA_AVX2:
+	case CPU_ISA_AVX512:
+		return Cvt_Img_Row_AVX2<color_space>;
+#endif
+#ifdef GSLICR_WITH_NEON_KERNELS
+	case CPU_ISA_NEON:
+		return Cvt_Img_Row_NEON<color_space>;
+#endif
+	default:
+		return Cvt_Img_Row_Scalar<color_space>;
+	}
+}
+
+cpu_kernel_table gSLICr::engines::Select_CPU_Kernels(CPU_ISA requested, COLOR_SPACE color_space)
+{
+	CPU_ISA isa = requested;
+	if (isa == CPU_ISA_AUTO) isa = Parse_CPU_ISA(getenv("GSLICR_FORCE_ISA"));
+	if (isa == CPU_ISA_AUTO) isa = Detect_CPU_ISA();
+
+	// step down the x86 ladder, anything else goes straight to scalar
+	while (!Is_CPU_ISA_Supported(isa))
+	{
+		isa = (isa == CPU_ISA_AVX512) ? CPU_ISA_AVX2 : (isa == CPU_ISA_AVX2) ? CPU_ISA_SSE42 : CPU_ISA_SCALAR;
+	}
+
+	cpu_kernel_table table;
+	table.isa = isa;
+	table.color_space = color_space;
+	table.find_center_association_row = Find_Center_Association_Row_Scalar;
+	table.accumulate_cluster_row = Accumulate_Cluster_Row_Scalar;
+	table.draw_boundary_row = Draw_Boundary_Row_Scalar;
+
+	// wider sets reuse the narrower kernels where they gain nothing
+	switch (isa)
+	{
+#ifdef GSLICR_WITH_X86_KERNELS
+	case CPU_ISA_SSE42:
+		table.find_center_association_row = Find_Center_Association_Row_SSE42;
+		table.accumulate_cluster_row = Accumulate_Cluster_Row_SSE42;
+		table.draw_boundary_row = Draw_Boundary_Row_SSE42;
+		break;
+	case CPU_ISA_AVX2:
+		table.find_center_association_row = Find_Center_Association_Row_AVX2;
+		table.accumulate_cluster_row = Accumulate_Cluster_Row_SSE42;
+		table.draw_boundary_row = Draw_Boundary_Row_AVX2;
+		break;
+	case CPU_ISA_AVX512:
+		table.find_center_association_row = Find_Center_Association_Row_AVX512;
+		table.accumulate_cluster_row = Accumulate_Cluster_Row_SSE42;
+		table.draw_boundary_row = Draw_Boundary_Row_AVX512;
+		break;
+#endif
+#ifdef GSLICR_WITH_NEON_KERNELS
+	case CPU_ISA_NEON:
+		table.find_center_association_row = Find_Center_Association_Row_NEON;
+		table.accumulate_cluster_row = Accumulate_Cluster_Row_NEON;
+		table.draw_boundary_row = Draw_Boundary_Row_NEON;
+		break;
+#endif
+	default:
+		break;
+	}
+
+	switch (color_space)
+	{
+	case XYZ:
+		table.cvt_img_row = Select_Cvt_Img_Row<XYZ>(isa);
+		break;
+	case RGB:
+		table.cvt_img_row = Select_Cvt_Img_Row<RGB>(isa);
+		break;
+	default:
+		table.cvt_img_row = Select_Cvt_Img_Row<CIELAB>(isa);
+		break;
+	}
+
+	return table;
+}
@@ -0,0 +1,40 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#pragma once
+#include "gSLICr_seg_engine_CPU_kernels.h"
+
+namespace gSLICr
+{
+	namespace engines
+	{
+		// The row kernels the CPU engine runs, all for the same instruction set
+		// and with the conversion specialized for one color space
+		struct cpu_kernel_table
+		{
+			CPU_ISA isa;
+			COLOR_SPACE color_space;
+			Cvt_Img_Row_Fn cvt_img_row;
+			Find_Center_Association_Row_Fn find_center_association_row;
+			Accumulate_Cluster_Row_Fn accumulate_cluster_row;
+			Draw_Boundary_Row_Fn draw_boundary_row;
+		};
+
+		// whether this binary has kernels for isa and the running CPU supports it
+		bool Is_CPU_ISA_Supported(CPU_ISA isa);
+
+		// the best instruction set available
+		CPU_ISA Detect_CPU_ISA();
+
+		// "scalar", "sse4.2", "avx2", "avx512" or "neon" ("auto" for CPU_ISA_AUTO)
+		const char* Get_CPU_ISA_Name(CPU_ISA isa);
+
+		// inverse of Get_CPU_ISA_Name, CPU_ISA_AUTO for unknown names
+		CPU_ISA Parse_CPU_ISA(const char* name);
+
+		// Kernels for the requested instruction set and color space. CPU_ISA_AUTO
+		// picks the set named by the GSLICR_FORCE_ISA environment variable if
+		// set, or else the best available. An unavailable request falls back to
+		// the best available set below it, the isa field tells what was picked.
+		cpu_kernel_table Select_CPU_Kernels(CPU_ISA requested, COLOR_SPACE color_space);
+	}
+}
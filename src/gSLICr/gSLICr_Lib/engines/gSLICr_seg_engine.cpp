@@ -3,15 +3,39 @@
 #pragma once
 #include "gSLICr_seg_engine.h"
 
+#include <algorithm>
+#include <cmath>
+
 using namespace std;
 using namespace gSLICr;
 using namespace gSLICr::objects;
 using namespace gSLICr::engines;
 
 
+// coarsest superpixel size the pyramid may go down to
+static const int min_coarse_spixel_size = 8;
+
+// boundary band half-width once labels have settled
+static const int default_band_width = 2;
+
 seg_engine::seg_engine(const objects::settings& in_settings)
 {
 	gSLICr_settings = in_settings;
+	memory_type = MEMORYDEVICE_CUDA;
+
+	content_size = in_settings.img_size;
+	coarse_content_size = Vector2i(0, 0);
+
+	pyramid_levels = 0;
+	coarse_cvt_img = NULL;
+	coarse_idx_img = NULL;
+	active_tile_map = NULL;
+	use_active_tiles = false;
+	track_cluster_sums = false;
+	label_first_pos = NULL;
+	label_remap = NULL;
+	label_table = NULL;
+	no_labels = 0;
 }
 
 
@@ -21,12 +45,179 @@ seg_engine::~seg_engine()
 	if (cvt_img != NULL) delete cvt_img;
 	if (idx_img != NULL) delete idx_img;
 	if (spixel_map != NULL) delete spixel_map;
+	if (coarse_cvt_img != NULL) delete coarse_cvt_img;
+	if (coarse_idx_img != NULL) delete coarse_idx_img;
+	if (active_tile_map != NULL) delete active_tile_map;
+	if (label_first_pos != NULL) delete label_first_pos;
+	if (label_remap != NULL) delete label_remap;
+	if (label_table != NULL) delete label_table;
 }
 
-void seg_engine::Perform_Segmentation(UChar4Image* in_img)
+void seg_engine::Init_Spixel_Geometry()
+{
+	if (gSLICr_settings.seg_method == GIVEN_NUM)
+	{
+		float cluster_size = (float)(gSLICr_settings.img_size.x * gSLICr_settings.img_size.y) / (float)gSLICr_settings.no_segs;
+		spixel_size = (int)ceil(sqrtf(cluster_size));
+	}
+	else
+	{
+		spixel_size = gSLICr_settings.spixel_size;
+	}
+
+	pyramid_levels = Compute_Pyramid_Levels();
+
+	// normalizing factors
+	max_xy_dist = 1.0f / (1.4242f * spixel_size); // sqrt(2) * spixel_size
+	switch (gSLICr_settings.color_space)
+	{
+	case RGB:
+		max_color_dist = 5.0f / (1.7321f * 255);
+		break;
+	case XYZ:
+		max_color_dist = 5.0f / 1.7321f; 
+		break; 
+	case CIELAB:
+		max_color_dist = 15.0f / (1.7321f * 128);
+		break;
+	}
+
+	max_color_dist *= max_color_dist;
+	max_xy_dist *= max_xy_dist;
+}
+
+Vector2i seg_engine::Compute_Map_Size() const
+{
+	// partial superpixels at the right and bottom borders get their own
+	// centers, placed in the middle of the part inside the image
+	int spixel_per_col = (gSLICr_settings.img_size.x + spixel_size - 1) / spixel_size;
+	int spixel_per_row = (gSLICr_settings.img_size.y + spixel_size - 1) / spixel_size;
+
+	return Vector2i(spixel_per_col, spixel_per_row);
+}
+
+Vector2i seg_engine::Compute_Tile_Map_Size() const
+{
+	return Vector2i((gSLICr_settings.img_size.x + BLOCK_DIM - 1) / BLOCK_DIM, (gSLICr_settings.img_size.y + BLOCK_DIM - 1) / BLOCK_DIM);
+}
+
+Vector2i seg_engine::Compute_Coarse_Size() const
+{
+	int factor = 1 << pyramid_levels;
+	return Vector2i((gSLICr_settings.img_size.x + factor - 1) / factor, (gSLICr_settings.img_size.y + factor - 1) / factor);
+}
+
+void seg_engine::Reshape(Vector2i img_size)
+{
+	if (img_size == gSLICr_settings.img_size) return;
+
+	// spixel_size (for a given number of superpixels) and the levels follow the image size
+	gSLICr_settings.img_size = img_size;
+	Init_Spixel_Geometry();
+	Fit_Buffers();
+}
+
+void seg_engine::Reconfigure(const objects::settings& in_settings)
+{
+	Vector2i old_img_size = gSLICr_settings.img_size;
+	int old_spixel_size = spixel_size;
+	int old_pyramid_levels = pyramid_levels;
+
+	DEVICE_TYPE device_type = gSLICr_settings.device_type;
+	CPU_ISA cpu_isa = gSLICr_settings.cpu_isa;
+	gSLICr_settings = in_settings;
+	gSLICr_settings.device_type = device_type;
+	gSLICr_settings.cpu_isa = cpu_isa;
+
+	Init_Spixel_Geometry();
+
+	if (gSLICr_settings.img_size != old_img_size || spixel_size != old_spixel_size || pyramid_levels != old_pyramid_levels)
+		Fit_Buffers();
+}
+
+void seg_engine::Fit_Buffers()
+{
+	Vector2i img_size = gSLICr_settings.img_size;
+	source_img->ChangeDims(img_size);
+	cvt_img->ChangeDims(img_size);
+	idx_img->ChangeDims(img_size);
+
+	Vector2i map_size = Compute_Map_Size();
+	spixel_map->ChangeDims(map_size);
+	label_first_pos->ChangeDims(map_size);
+	label_remap->ChangeDims(map_size);
+	label_table->ChangeDims(map_size);
+	no_labels = 0;
+
+	active_tile_map->ChangeDims(Compute_Tile_Map_Size());
+
+	if (pyramid_levels > 0)
+	{
+		if (coarse_cvt_img == NULL)
+		{
+			bool allocate_CUDA = memory_type == MEMORYDEVICE_CUDA;
+			coarse_cvt_img = new Float4Image(Compute_Coarse_Size(), true, allocate_CUDA);
+			coarse_idx_img = new IntImage(Compute_Coarse_Size(), true, allocate_CUDA);
+		}
+		else
+		{
+			coarse_cvt_img->ChangeDims(Compute_Coarse_Size());
+			coarse_idx_img->ChangeDims(Compute_Coarse_Size());
+		}
+	}
+
+	Reshape_Engine_Buffers(map_size);
+}
+
+int seg_engine::Compute_Pyramid_Levels() const
+{
+	// the coarse grid must line up with the full resolution one, so
+	// spixel_size has to stay divisible by the downsampling factor
+	int levels = 0;
+	while (levels < gSLICr_settings.pyramid_levels
+		&& spixel_size % (1 << (levels + 1)) == 0
+		&& (spixel_size >> (levels + 1)) >= min_coarse_spixel_size)
+	{
+		levels++;
+	}
+	return levels;
+}
+
+void seg_engine::Enter_Coarse_Level()
+{
+	int factor = 1 << pyramid_levels;
+
+	std::swap(cvt_img, coarse_cvt_img);
+	std::swap(idx_img, coarse_idx_img);
+	std::swap(content_size, coarse_content_size);
+
+	// distances shrink with the image, keep them normalized the same way
+	spixel_size /= factor;
+	max_xy_dist *= (float)(factor * factor);
+}
+
+void seg_engine::Leave_Coarse_Level()
+{
+	int factor = 1 << pyramid_levels;
+
+	std::swap(cvt_img, coarse_cvt_img);
+	std::swap(idx_img, coarse_idx_img);
+	std::swap(content_size, coarse_content_size);
+
+	spixel_size *= factor;
+	max_xy_dist /= (float)(factor * factor);
+}
+
+void seg_engine::Perform_Pyramid_Segmentation()
 {
-	source_img->SetFrom(in_img, ORUtils::MemoryBlock<Vector4u>::CPU_TO_CUDA);
-	Cvt_Img_Space(source_img, cvt_img, gSLICr_settings.color_space);
+	int factor = 1 << pyramid_levels;
+	int band_width = gSLICr_settings.band_width > 0 ? gSLICr_settings.band_width : factor;
+
+	coarse_content_size = Vector2i((content_size.x + factor - 1) / factor, (content_size.y + factor - 1) / factor);
+	Downsample_Img(cvt_img, coarse_cvt_img, factor);
+
+	// regular SLIC on the coarse level
+	Enter_Coarse_Level();
 
 	Init_Cluster_Centers();
 	Find_Center_Association();
@@ -37,8 +228,131 @@ void seg_engine::Perform_Segmentation(UChar4Image* in_img)
 		Find_Center_Association();
 	}
 
+	Leave_Coarse_Level();
+
+	// carry the labels over to full resolution, they can only be off by
+	// about a coarse pixel so refining the boundary band is enough
+	Upsample_Labels(coarse_idx_img, idx_img, factor);
+	Perform_Band_Iterations(gSLICr_settings.refine_iters, band_width);
+}
+
+void seg_engine::Perform_Band_Iterations(int no_iters, int band_width)
+{
+	// from here on the cluster sums are kept up to date by the association
+	// step itself, which only sees the pixels close to a boundary. The centers
+	// are normalized after every association, so they match the labels even
+	// when no band iteration runs (after a pyramid they are still coarse).
+	Accumulate_Cluster_Sums();
+	Normalize_Cluster_Sums();
+
+	use_active_tiles = true;
+	track_cluster_sums = true;
+	for (int i = 0; i < no_iters; i++)
+	{
+		Mark_Active_Tiles(band_width);
+		Find_Center_Association();
+		Normalize_Cluster_Sums();
+	}
+	use_active_tiles = false;
+	track_cluster_sums = false;
+}
+
+void seg_engine::Relabel_Dense()
+{
+	Find_First_Label_Positions();
+	label_first_pos->UpdateHostFromDevice();
+
+	const int* first_pos = label_first_pos->GetData(MEMORYDEVICE_CPU);
+	int* remap = label_remap->GetData(MEMORYDEVICE_CPU);
+	int* table = label_table->GetData(MEMORYDEVICE_CPU);
+	int no_spixels = (int)label_first_pos->dataSize;
+
+	// the labels present, ordered by where they first appear (positions are unique)
+	no_labels = 0;
+	for (int i = 0; i < no_spixels; i++)
+	{
+		remap[i] = -1;
+		if (first_pos[i] != NO_LABEL_POSITION) table[no_labels++] = i;
+	}
+	std::sort(table, table + no_labels, [first_pos](int a, int b) { return first_pos[a] < first_pos[b]; });
+
+	for (int k = 0; k < no_labels; k++) remap[table[k]] = k;
+	label_remap->UpdateDeviceFromHost();
+
+	Remap_Labels();
+}
+
+void seg_engine::Perform_Segmentation(UChar4Image* in_img)
+{
+	Perform_Segmentation(in_img, in_img->noDims);
+}
+
+void seg_engine::Perform_Segmentation(UChar4Image* in_img, Vector2i in_content_size)
+{
+	Reshape(in_img->noDims);
+	source_img->SetFrom(in_img, memory_type == MEMORYDEVICE_CUDA ? ORUtils::MemoryBlock<Vector4u>::CPU_TO_CUDA : ORUtils::MemoryBlock<Vector4u>::CPU_TO_CPU);
+	Segment_Source_Img(in_content_size);
+}
+
+UChar4Image* seg_engine::Get_Source_Img(Vector2i img_size)
+{
+	Reshape(img_size);
+	return source_img;
+}
+
+void seg_engine::Perform_Segmentation()
+{
+	Perform_Segmentation(gSLICr_settings.img_size);
+}
+
+void seg_engine::Perform_Segmentation(Vector2i in_content_size)
+{
+	// the CPU engine segments the host pixels in place
+	if (memory_type == MEMORYDEVICE_CUDA) source_img->UpdateDeviceFromHost();
+	Segment_Source_Img(in_content_size);
+}
+
+void seg_engine::Segment_Source_Img(Vector2i in_content_size)
+{
+	// an empty or oversized content is the whole image
+	Vector2i img_size = gSLICr_settings.img_size;
+	if (in_content_size.x <= 0 || in_content_size.y <= 0) in_content_size = img_size;
+	content_size = Vector2i(min(in_content_size.x, img_size.x), min(in_content_size.y, img_size.y));
+	Fit_Content();
+
+	if (pyramid_levels > 0)
+	{
+		// the coarse level is downsampled from the whole converted image
+		Cvt_Img_Space(source_img, cvt_img, gSLICr_settings.color_space);
+		Perform_Pyramid_Segmentation();
+	}
+	else
+	{
+		// labels settle after a few iterations, later ones only move boundaries
+		int band_after_iters = gSLICr_settings.band_after_iters;
+		int full_iters = band_after_iters > 0 && band_after_iters < gSLICr_settings.no_iters ? band_after_iters : gSLICr_settings.no_iters;
+
+		// cvt_img is written by the first association, which reads each
+		// source pixel once instead of converting the image beforehand
+		Init_Cluster_Centers_From_Source(gSLICr_settings.color_space);
+		Cvt_And_Find_Center_Association(gSLICr_settings.color_space);
+
+		for (int i = 0; i < full_iters; i++)
+		{
+			Update_Cluster_Center();
+			Find_Center_Association();
+		}
+
+		if (full_iters < gSLICr_settings.no_iters)
+		{
+			int band_width = gSLICr_settings.band_width > 0 ? gSLICr_settings.band_width : default_band_width;
+			Perform_Band_Iterations(gSLICr_settings.no_iters - full_iters, band_width);
+		}
+	}
+
 	if(gSLICr_settings.do_enforce_connectivity) Enforce_Connectivity();
-	cudaThreadSynchronize();
+	if (gSLICr_settings.dense_labels) Relabel_Dense();
+	if (memory_type == MEMORYDEVICE_CUDA) cudaThreadSynchronize();
 }
 
 
@@ -5,6 +5,10 @@
 #include "../objects/gSLICr_settings.h"
 #include "../objects/gSLICr_spixel_info.h"
 
+// first position of a label absent from idx_img, byte-repeated so the
+// buffer can be memset to it
+#define NO_LABEL_POSITION 0x7f7f7f7f
+
 namespace gSLICr
 {
 	namespace engines
@@ -22,18 +26,100 @@ namespace gSLICr
 			Float4Image *cvt_img;
 			IntImage *idx_img;
 
+			// the top-left part of the images that holds pixels, the padded
+			// border past it takes no part in the clustering and keeps the
+			// label -1. Swapped with coarse_content_size on the coarse level.
+			Vector2i content_size;
+			Vector2i coarse_content_size;
+
 			// superpixel map
 			SpixelMap* spixel_map;
 			int spixel_size;
 
 			objects::settings gSLICr_settings;
 
+			// where the buffers the steps work on live
+			MemoryDeviceType memory_type;
+
+			// coarse-to-fine mode, the coarse level shares spixel_map
+			int pyramid_levels;
+			Float4Image *coarse_cvt_img;
+			IntImage *coarse_idx_img;
+
+			// one flag per BLOCK_DIM x BLOCK_DIM tile, association skips
+			// inactive tiles when use_active_tiles is set
+			IntImage *active_tile_map;
+			bool use_active_tiles;
+
+			// when set, association moves the pixels that change label
+			// between the running per-cluster sums
+			bool track_cluster_sums;
+
+			// dense relabeling, per spixel_map entry: raster position of its
+			// first pixel and its dense label; per dense label: the entry
+			IntImage *label_first_pos;
+			IntImage *label_remap;
+			IntImage *label_table;
+			int no_labels;
+
 			virtual void Cvt_Img_Space(UChar4Image* inimg, Float4Image* outimg, COLOR_SPACE color_space) = 0;
 			virtual void Init_Cluster_Centers() = 0;
 			virtual void Find_Center_Association() = 0;
 			virtual void Update_Cluster_Center() = 0;
 			virtual void Enforce_Connectivity() = 0;
 
+			// first pass without a separate conversion sweep: the centers are
+			// initialized from the source pixels under them, then source_img
+			// is converted into cvt_img and associated in the same sweep
+			virtual void Init_Cluster_Centers_From_Source(COLOR_SPACE color_space) = 0;
+			virtual void Cvt_And_Find_Center_Association(COLOR_SPACE color_space) = 0;
+
+			virtual void Downsample_Img(const Float4Image* inimg, Float4Image* outimg, int factor) = 0;
+			virtual void Upsample_Labels(const IntImage* inimg, IntImage* outimg, int factor) = 0;
+			virtual void Mark_Active_Tiles(int band_width) = 0;
+			virtual void Accumulate_Cluster_Sums() = 0;
+			virtual void Normalize_Cluster_Sums() = 0;
+
+			// called before each segmentation once content_size is set: sets
+			// the labels of the padded border to -1
+			virtual void Fit_Content() = 0;
+
+			// label_first_pos from idx_img, NO_LABEL_POSITION for absent labels
+			virtual void Find_First_Label_Positions() = 0;
+			// idx_img through label_remap
+			virtual void Remap_Labels() = 0;
+
+			// spixel_size, distance normalizers and pyramid levels from the settings
+			void Init_Spixel_Geometry();
+			Vector2i Compute_Map_Size() const;
+			Vector2i Compute_Tile_Map_Size() const;
+			Vector2i Compute_Coarse_Size() const;
+
+			// fits every buffer to the current image size and geometry, only
+			// growing ones are reallocated
+			void Fit_Buffers();
+
+			// fits the buffers only one backend has to the current image and
+			// map size, called by Fit_Buffers after the shared ones
+			virtual void Reshape_Engine_Buffers(Vector2i map_size) = 0;
+
+			// number of usable pyramid levels for the current spixel_size
+			int Compute_Pyramid_Levels() const;
+
+			// the steps above always work on cvt_img, idx_img and spixel_size,
+			// so the coarse level is processed by swapping its buffers in
+			void Enter_Coarse_Level();
+			void Leave_Coarse_Level();
+
+			void Perform_Pyramid_Segmentation();
+			void Perform_Band_Iterations(int no_iters, int band_width);
+
+			// renumbers idx_img to 0..no_labels-1 in raster order of first appearance
+			void Relabel_Dense();
+
+			// runs the segmentation on the (device) pixels of source_img
+			void Segment_Source_Img(Vector2i in_content_size);
+
 		public:
 
 			seg_engine(const objects::settings& in_settings );
@@ -49,9 +135,47 @@ namespace gSLICr
 				return spixel_map;
 			}
 
+			// spixel_map index of each of the Get_No_Labels() dense labels,
+			// NULL unless dense_labels is set
+			const IntImage* Get_Label_Table() const {
+				return gSLICr_settings.dense_labels ? label_table : NULL;
+			}
+			int Get_No_Labels() const { return no_labels; }
+
+			// switches to another image size, buffers are only reallocated
+			// when they have to grow (Perform_Segmentation does it as needed)
+			void Reshape(Vector2i img_size);
+
+			// takes new settings in place: the normalizers are recomputed and
+			// the buffers only refitted when the superpixel size, the image
+			// size or the pyramid levels change. The device and the CPU
+			// instruction set stay the ones the engine was built for.
+			void Reconfigure(const objects::settings& in_settings);
+			const objects::settings& Get_Settings() const { return gSLICr_settings; }
+
 			void Perform_Segmentation(UChar4Image* in_img);
+
+			// only the top-left content_size part of in_img holds pixels, the
+			// rest is a padded border (the image is letterboxed to a shared
+			// size): its labels are -1 and nothing is drawn on it
+			void Perform_Segmentation(UChar4Image* in_img, Vector2i content_size);
+
+			// source_img reshaped to img_size, for the caller to write the host
+			// pixels of the next image straight into (no input image copy)
+			UChar4Image* Get_Source_Img(Vector2i img_size);
+
+			// segments the host pixels written into Get_Source_Img()
+			void Perform_Segmentation();
+			void Perform_Segmentation(Vector2i content_size);
+
+			// the part of the last segmented image that held pixels
+			Vector2i Get_Content_Size() const { return content_size; }
+
 			virtual void Draw_Segmentation_Result(UChar4Image* out_img){};
 			virtual void Draw_Boundary_Only(UChar4Image* out_img){};
+
+			// which backend and kernels run the segmentation, for logs
+			virtual const char* Get_Backend_Name() const = 0;
 		};
 	}
 }
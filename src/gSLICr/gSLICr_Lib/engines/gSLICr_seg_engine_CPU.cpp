@@ -0,0 +1,541 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#include "gSLICr_seg_engine_CPU.h"
+#include "gSLICr_seg_engine_shared.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace gSLICr;
+using namespace gSLICr::objects;
+using namespace gSLICr::engines;
+
+// number of row bands the image is split into, fixed so that the
+// summation order does not depend on the number of threads
+static const int max_cpu_bands = 32;
+
+// ----------------------------------------------------
+//
+//	host function implementations
+//
+// ----------------------------------------------------
+
+seg_engine_CPU::seg_engine_CPU(const settings& in_settings) : seg_engine(in_settings)
+{
+	memory_type = MEMORYDEVICE_CPU;
+	kernels = Select_CPU_Kernels(in_settings.cpu_isa, in_settings.color_space);
+	backend_name = std::string("CPU (") + Get_CPU_ISA_Name(kernels.isa) + ")";
+
+	source_img = new UChar4Image(in_settings.img_size, true, false);
+	cvt_img = new Float4Image(in_settings.img_size, true, false);
+	idx_img = new IntImage(in_settings.img_size, true, false);
+	tmp_idx_img = new IntImage(in_settings.img_size, true, false);
+
+	Init_Spixel_Geometry();
+
+	Vector2i map_size = Compute_Map_Size();
+	spixel_map = new SpixelMap(map_size, true, false);
+	cluster_sums = new SpixelMap(map_size, true, false);
+	label_first_pos = new IntImage(map_size, true, false);
+	label_remap = new IntImage(map_size, true, false);
+	label_table = new IntImage(map_size, true, false);
+
+	// a band spans at least one row of superpixels
+	no_bands = std::max(1, std::min(max_cpu_bands, in_settings.img_size.y / spixel_size));
+	band_sums.resize((size_t)no_bands * spixel_map->dataSize);
+
+	active_tile_map = new IntImage(Compute_Tile_Map_Size(), true, false);
+
+	if (pyramid_levels > 0)
+	{
+		coarse_cvt_img = new Float4Image(Compute_Coarse_Size(), true, false);
+		coarse_idx_img = new IntImage(Compute_Coarse_Size(), true, false);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Reshape_Engine_Buffers(Vector2i map_size)
+{
+	tmp_idx_img->ChangeDims(gSLICr_settings.img_size);
+	cluster_sums->ChangeDims(map_size);
+
+	// the band split only depends on the image size, as in the constructor
+	no_bands = std::max(1, std::min(max_cpu_bands, gSLICr_settings.img_size.y / spixel_size));
+	band_sums.resize((size_t)no_bands * spixel_map->dataSize);
+}
+
+void gSLICr::engines::seg_engine_CPU::Fit_Content()
+{
+	// the bands only cover the content, split as for an image of its size
+	no_bands = std::max(1, std::min(max_cpu_bands, content_size.y / spixel_size));
+	band_sums.resize((size_t)no_bands * spixel_map->dataSize);
+
+	if (content_size == idx_img->noDims) return;
+
+	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	Vector2i img_size = idx_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 0; y < img_size.y; y++)
+	{
+		int x_start = y < content_size.y ? content_size.x : 0;
+		std::fill(idx_ptr + y * img_size.x + x_start, idx_ptr + (y + 1) * img_size.x, -1);
+	}
+}
+
+gSLICr::engines::seg_engine_CPU::~seg_engine_CPU()
+{
+	delete cluster_sums;
+	delete tmp_idx_img;
+}
+
+void gSLICr::engines::seg_engine_CPU::Get_Band_Rows(int band, int& band_start, int& band_end) const
+{
+	// content_size is the coarse one on a pyramid level, the split follows it
+	int height = content_size.y;
+	band_start = (int)((long long)height * band / no_bands);
+	band_end = (int)((long long)height * (band + 1) / no_bands);
+}
+
+void gSLICr::engines::seg_engine_CPU::Clear_Band_Sums()
+{
+	spixel_info empty;
+	empty.center = Vector2f(0, 0);
+	empty.color_info = Vector4f(0, 0, 0, 0);
+	empty.id = -1;
+	empty.no_pixels = 0;
+
+	std::fill(band_sums.begin(), band_sums.end(), empty);
+}
+
+void gSLICr::engines::seg_engine_CPU::Cvt_Img_Space(UChar4Image* inimg, Float4Image* outimg, COLOR_SPACE color_space)
+{
+	const Vector4u* inimg_ptr = inimg->GetData(MEMORYDEVICE_CPU);
+	Vector4f* outimg_ptr = outimg->GetData(MEMORYDEVICE_CPU);
+	Vector2i img_size = inimg->noDims;
+
+	// the conversion kernel is specialized for the color space of the settings
+	if (color_space != kernels.color_space) kernels = Select_CPU_Kernels(kernels.isa, color_space);
+
+#pragma omp parallel for
+	for (int y = 0; y < img_size.y; y++)
+	{
+		kernels.cvt_img_row(inimg_ptr + y * img_size.x, outimg_ptr + y * img_size.x, 0, img_size.x);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Init_Cluster_Centers()
+{
+	spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
+	const Vector4f* img_ptr = cvt_img->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i map_size = spixel_map->noDims;
+	Vector2i img_size = cvt_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 0; y < map_size.y; y++) for (int x = 0; x < map_size.x; x++)
+	{
+		init_cluster_centers_shared(img_ptr, spixel_list, map_size, img_size, content_size, spixel_size, gSLICr_settings.low_gradient_init, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Init_Cluster_Centers_From_Source(COLOR_SPACE color_space)
+{
+	spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
+	const Vector4u* source_ptr = source_img->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i map_size = spixel_map->noDims;
+	Vector2i img_size = source_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 0; y < map_size.y; y++) for (int x = 0; x < map_size.x; x++)
+	{
+		init_cluster_centers_from_source_shared(source_ptr, spixel_list, map_size, img_size, content_size, spixel_size, color_space, gSLICr_settings.low_gradient_init, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Associate_Band(int band, bool convert)
+{
+	const spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CPU);
+	const Vector4u* source_ptr = source_img->GetData(MEMORYDEVICE_CPU);
+	Vector4f* img_ptr = cvt_img->GetData(MEMORYDEVICE_CPU);
+	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	const int* tile_ptr = active_tile_map->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i map_size = spixel_map->noDims;
+	Vector2i img_size = cvt_img->noDims;
+	int tile_map_width = active_tile_map->noDims.x;
+	float weight = gSLICr_settings.coh_weight;
+
+	// pixels changing label are moved between the clusters in the band's own sums
+	spixel_info* sums = &band_sums[(size_t)band * spixel_map->dataSize];
+	int width = content_size.x;
+	std::vector<int> old_labels(track_cluster_sums ? width : 0);
+
+	int band_start, band_end;
+	Get_Band_Rows(band, band_start, band_end);
+
+	for (int y = band_start; y < band_end; y++)
+	{
+		const Vector4f* img_row = img_ptr + y * img_size.x;
+		int* idx_row = idx_ptr + y * img_size.x;
+		const int* tile_row = tile_ptr + (y / BLOCK_DIM) * tile_map_width;
+
+		// the converted row is still in cache when it is associated
+		if (convert) kernels.cvt_img_row(source_ptr + y * img_size.x, img_ptr + y * img_size.x, 0, width);
+
+		if (track_cluster_sums) std::copy(idx_row, idx_row + width, old_labels.begin());
+
+		int ctr_y = y / spixel_size;
+		for (int ctr_x = 0; ctr_x * spixel_size < width; ctr_x++)
+		{
+			// every pixel of the cell compares against the same 3x3 centers,
+			// in the order find_center_association_shared visits them
+			spixel_info candidates[9];
+			int no_candidates = 0;
+			for (int i = -1; i <= 1; i++) for (int j = -1; j <= 1; j++)
+			{
+				int ctr_x_check = ctr_x + j;
+				int ctr_y_check = ctr_y + i;
+				if (ctr_x_check >= 0 && ctr_y_check >= 0 && ctr_x_check < map_size.x && ctr_y_check < map_size.y
+					&& spixel_list[ctr_y_check * map_size.x + ctr_x_check].id >= 0)
+				{
+					candidates[no_candidates++] = spixel_list[ctr_y_check * map_size.x + ctr_x_check];
+				}
+			}
+
+			int cell_start = ctr_x * spixel_size;
+			int cell_end = std::min(cell_start + spixel_size, width);
+
+			if (!use_active_tiles)
+			{
+				kernels.find_center_association_row(img_row, idx_row, cell_start, cell_end, y, candidates, no_candidates, weight, max_xy_dist, max_color_dist);
+				continue;
+			}
+
+			// runs of consecutive active tiles within the cell
+			int x = cell_start;
+			while (x < cell_end)
+			{
+				int run_end = std::min((x / BLOCK_DIM + 1) * BLOCK_DIM, cell_end);
+				if (tile_row[x / BLOCK_DIM] == 0) { x = run_end; continue; }
+
+				while (run_end < cell_end && tile_row[run_end / BLOCK_DIM] != 0)
+				{
+					run_end = std::min(run_end + BLOCK_DIM, cell_end);
+				}
+
+				kernels.find_center_association_row(img_row, idx_row, x, run_end, y, candidates, no_candidates, weight, max_xy_dist, max_color_dist);
+				x = run_end;
+			}
+		}
+
+		if (!track_cluster_sums) continue;
+
+		for (int x = 0; x < width; x++)
+		{
+			int old_label = old_labels[x];
+			int new_label = idx_row[x];
+			if (new_label == old_label) continue;
+
+			const Vector4f& pix = img_row[x];
+
+			sums[new_label].center.x += (float)x;
+			sums[new_label].center.y += (float)y;
+			sums[new_label].color_info += pix;
+			sums[new_label].no_pixels++;
+
+			sums[old_label].center.x -= (float)x;
+			sums[old_label].center.y -= (float)y;
+			sums[old_label].color_info -= pix;
+			sums[old_label].no_pixels--;
+		}
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Find_Center_Association()
+{
+	if (track_cluster_sums) Clear_Band_Sums();
+
+#pragma omp parallel for schedule(dynamic)
+	for (int band = 0; band < no_bands; band++)
+	{
+		Associate_Band(band, false);
+	}
+
+	if (track_cluster_sums) Reduce_Band_Sums(cluster_sums, true);
+}
+
+void gSLICr::engines::seg_engine_CPU::Cvt_And_Find_Center_Association(COLOR_SPACE color_space)
+{
+	if (color_space != kernels.color_space) kernels = Select_CPU_Kernels(kernels.isa, color_space);
+	if (track_cluster_sums) Clear_Band_Sums();
+
+#pragma omp parallel for schedule(dynamic)
+	for (int band = 0; band < no_bands; band++)
+	{
+		Associate_Band(band, true);
+	}
+
+	if (track_cluster_sums) Reduce_Band_Sums(cluster_sums, true);
+}
+
+void gSLICr::engines::seg_engine_CPU::Update_Cluster_Center()
+{
+	Accumulate_Cluster_Sums();
+	Normalize_Cluster_Sums();
+}
+
+void gSLICr::engines::seg_engine_CPU::Accumulate_Cluster_Sums()
+{
+	const Vector4f* img_ptr = cvt_img->GetData(MEMORYDEVICE_CPU);
+	const int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	Vector2i img_size = cvt_img->noDims;
+	int no_spixels = (int)spixel_map->dataSize;
+
+	Clear_Band_Sums();
+
+	// a single pass over the image, each band only writes its own sums
+#pragma omp parallel for schedule(dynamic)
+	for (int band = 0; band < no_bands; band++)
+	{
+		spixel_info* sums = &band_sums[(size_t)band * no_spixels];
+
+		int band_start, band_end;
+		Get_Band_Rows(band, band_start, band_end);
+
+		for (int y = band_start; y < band_end; y++)
+		{
+			kernels.accumulate_cluster_row(img_ptr + y * img_size.x, idx_ptr + y * img_size.x, content_size.x, y, sums, no_spixels);
+		}
+	}
+
+	Reduce_Band_Sums(cluster_sums, false);
+}
+
+void gSLICr::engines::seg_engine_CPU::Reduce_Band_Sums(SpixelMap* out_map, bool accumulate)
+{
+	spixel_info* out_ptr = out_map->GetData(MEMORYDEVICE_CPU);
+	int no_spixels = (int)out_map->dataSize;
+
+	// pairwise tree over the bands, in the same order for every cluster
+#pragma omp parallel for
+	for (int i = 0; i < no_spixels; i++)
+	{
+		for (int stride = 1; stride < no_bands; stride *= 2)
+		{
+			for (int band = 0; band + stride < no_bands; band += 2 * stride)
+			{
+				spixel_info& dst = band_sums[(size_t)band * no_spixels + i];
+				const spixel_info& src = band_sums[(size_t)(band + stride) * no_spixels + i];
+
+				dst.center += src.center;
+				dst.color_info += src.color_info;
+				dst.no_pixels += src.no_pixels;
+			}
+		}
+
+		const spixel_info& total = band_sums[i];
+		if (accumulate)
+		{
+			out_ptr[i].center += total.center;
+			out_ptr[i].color_info += total.color_info;
+			out_ptr[i].no_pixels += total.no_pixels;
+		}
+		else
+		{
+			out_ptr[i].center = total.center;
+			out_ptr[i].color_info = total.color_info;
+			out_ptr[i].no_pixels = total.no_pixels;
+		}
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Normalize_Cluster_Sums()
+{
+	const spixel_info* sums_ptr = cluster_sums->GetData(MEMORYDEVICE_CPU);
+	spixel_info* spixel_list_ptr = spixel_map->GetData(MEMORYDEVICE_CPU);
+	Vector2i map_size = spixel_map->noDims;
+
+	for (int y = 0; y < map_size.y; y++) for (int x = 0; x < map_size.x; x++)
+	{
+		normalize_cluster_sums_shared(sums_ptr, spixel_list_ptr, map_size, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Enforce_Connectivity()
+{
+	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	int* tmp_idx_ptr = tmp_idx_img->GetData(MEMORYDEVICE_CPU);
+	Vector2i img_size = idx_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 0; y < content_size.y; y++) for (int x = 0; x < content_size.x; x++)
+	{
+		supress_local_lable(idx_ptr, tmp_idx_ptr, img_size, content_size, x, y);
+	}
+
+#pragma omp parallel for
+	for (int y = 0; y < content_size.y; y++) for (int x = 0; x < content_size.x; x++)
+	{
+		supress_local_lable(tmp_idx_ptr, idx_ptr, img_size, content_size, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Downsample_Img(const Float4Image* inimg, Float4Image* outimg, int factor)
+{
+	const Vector4f* inimg_ptr = inimg->GetData(MEMORYDEVICE_CPU);
+	Vector4f* outimg_ptr = outimg->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i in_size = inimg->noDims;
+	Vector2i out_size = outimg->noDims;
+
+	// only the content is downsampled, the coarse level never reads past it
+#pragma omp parallel for
+	for (int y = 0; y < coarse_content_size.y; y++) for (int x = 0; x < coarse_content_size.x; x++)
+	{
+		downsample_img_shared(inimg_ptr, outimg_ptr, in_size, content_size, out_size, factor, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Upsample_Labels(const IntImage* inimg, IntImage* outimg, int factor)
+{
+	const int* in_idx_ptr = inimg->GetData(MEMORYDEVICE_CPU);
+	int* out_idx_ptr = outimg->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i in_size = inimg->noDims;
+	Vector2i out_size = outimg->noDims;
+
+#pragma omp parallel for
+	for (int y = 0; y < out_size.y; y++) for (int x = 0; x < out_size.x; x++)
+	{
+		upsample_labels_shared(in_idx_ptr, out_idx_ptr, in_size, coarse_content_size, out_size, content_size, factor, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Mark_Active_Tiles(int band_width)
+{
+	const int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	int* tile_ptr = active_tile_map->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i img_size = idx_img->noDims;
+	Vector2i tile_map_size = active_tile_map->noDims;
+
+	// gathered per tile rather than scattered from the boundary pixels,
+	// so that every tile flag has a single writer
+#pragma omp parallel for
+	for (int tile_y = 0; tile_y < tile_map_size.y; tile_y++) for (int tile_x = 0; tile_x < tile_map_size.x; tile_x++)
+	{
+		int x_start = std::max(tile_x * BLOCK_DIM - band_width, 0);
+		int y_start = std::max(tile_y * BLOCK_DIM - band_width, 0);
+		int x_end = std::min((tile_x + 1) * BLOCK_DIM + band_width, content_size.x);
+		int y_end = std::min((tile_y + 1) * BLOCK_DIM + band_width, content_size.y);
+
+		int active = 0;
+		for (int y = y_start; y < y_end && !active; y++) for (int x = x_start; x < x_end; x++)
+		{
+			if (is_label_boundary_shared(idx_ptr, img_size, content_size, x, y)) { active = 1; break; }
+		}
+
+		tile_ptr[tile_y * tile_map_size.x + tile_x] = active;
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Find_First_Label_Positions()
+{
+	const int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	int* first_pos = label_first_pos->GetData(MEMORYDEVICE_CPU);
+	Vector2i img_size = idx_img->noDims;
+	int no_spixels = (int)label_first_pos->dataSize;
+
+	band_first_pos.assign((size_t)no_bands * no_spixels, NO_LABEL_POSITION);
+
+	// bands are in raster order, the first band holding a label has its first position
+#pragma omp parallel for schedule(dynamic)
+	for (int band = 0; band < no_bands; band++)
+	{
+		int* band_pos = &band_first_pos[(size_t)band * no_spixels];
+
+		int band_start, band_end;
+		Get_Band_Rows(band, band_start, band_end);
+
+		for (int y = band_start; y < band_end; y++) for (int x = 0; x < content_size.x; x++)
+		{
+			if (!is_label_run_start_shared(idx_ptr, img_size, x, y)) continue;
+
+			int label = idx_ptr[y * img_size.x + x];
+			if (label >= 0 && label < no_spixels && band_pos[label] == NO_LABEL_POSITION) band_pos[label] = y * img_size.x + x;
+		}
+	}
+
+#pragma omp parallel for
+	for (int i = 0; i < no_spixels; i++)
+	{
+		first_pos[i] = NO_LABEL_POSITION;
+		for (int band = 0; band < no_bands && first_pos[i] == NO_LABEL_POSITION; band++)
+		{
+			first_pos[i] = band_first_pos[(size_t)band * no_spixels + i];
+		}
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Remap_Labels()
+{
+	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+	const int* remap_ptr = label_remap->GetData(MEMORYDEVICE_CPU);
+	Vector2i img_size = idx_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 0; y < content_size.y; y++) for (int x = 0; x < content_size.x; x++)
+	{
+		remap_label_shared(idx_ptr, remap_ptr, img_size, x, y);
+	}
+}
+
+void gSLICr::engines::seg_engine_CPU::Draw_Segmentation_Result(UChar4Image* out_img)
+{
+	const Vector4u* inimg_ptr = source_img->GetData(MEMORYDEVICE_CPU);
+	Vector4u* outimg_ptr = out_img->GetData(MEMORYDEVICE_CPU);
+	const int* idx_img_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i img_size = idx_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 1; y < content_size.y - 1; y++)
+	{
+		kernels.draw_boundary_row(idx_img_ptr, inimg_ptr, outimg_ptr, img_size, y, 1, content_size.x - 1, Vector4u(0, 0, 255, 0), Vector4u(0, 0, 0, 0));
+	}
+
+	Draw_Content_Frame(inimg_ptr, outimg_ptr, Vector4u(0, 0, 0, 0));
+}
+
+void gSLICr::engines::seg_engine_CPU::Draw_Boundary_Only(UChar4Image* out_img)
+{
+	Vector4u* outimg_ptr = out_img->GetData(MEMORYDEVICE_CPU);
+	const int* idx_img_ptr = idx_img->GetData(MEMORYDEVICE_CPU);
+
+	Vector2i img_size = idx_img->noDims;
+
+#pragma omp parallel for
+	for (int y = 1; y < content_size.y - 1; y++)
+	{
+		kernels.draw_boundary_row(idx_img_ptr, NULL, outimg_ptr, img_size, y, 1, content_size.x - 1, Vector4u(255, 255, 255, 0), Vector4u(0, 0, 0, 0));
+	}
+
+	Draw_Content_Frame(NULL, outimg_ptr, Vector4u(0, 0, 0, 0));
+}
+
+void gSLICr::engines::seg_engine_CPU::Draw_Content_Frame(const Vector4u* src_img, Vector4u* out_img, Vector4u fill_color)
+{
+	// out_img may be a recycled buffer, so every pixel of the content is written
+	Vector2i img_size = idx_img->noDims;
+
+	for (int y = 0; y < content_size.y; y++)
+	{
+		int step = (y == 0 || y == content_size.y - 1) ? 1 : max(content_size.x - 1, 1);
+		for (int x = 0; x < content_size.x; x += step)
+		{
+			int idx = y * img_size.x + x;
+			out_img[idx] = src_img != NULL ? src_img[idx] : fill_color;
+		}
+	}
+}
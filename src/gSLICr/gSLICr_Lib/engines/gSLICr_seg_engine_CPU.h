@@ -0,0 +1,79 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#pragma once
+#include "gSLICr_seg_engine.h"
+#include "gSLICr_cpu_dispatch.h"
+
+#include <string>
+
+#include <vector>
+
+namespace gSLICr
+{
+	namespace engines
+	{
+		// Runs every step on the host. The image is split into a fixed set of
+		// row bands that only depends on its size, each band accumulates its
+		// own cluster sums and the bands are merged in a fixed order, so the
+		// labels are the same whatever the number of threads.
+		class seg_engine_CPU : public seg_engine
+		{
+		private:
+
+			int no_bands;
+			std::vector<objects::spixel_info> band_sums;
+			std::vector<int> band_first_pos;
+			IntImage* tmp_idx_img;
+			SpixelMap* cluster_sums;
+
+			// row kernels for the instruction set picked at construction
+			cpu_kernel_table kernels;
+			std::string backend_name;
+
+			// rows [band_start, band_end) of the content for the given band
+			void Get_Band_Rows(int band, int& band_start, int& band_end) const;
+
+			void Clear_Band_Sums();
+
+			// adds the band sums up into out_map, on top of its content if accumulate is set
+			void Reduce_Band_Sums(SpixelMap* out_map, bool accumulate);
+			// also converts the rows of source_img into cvt_img first when convert is set
+			void Associate_Band(int band, bool convert);
+
+			// the outermost rows and columns of the content, where the boundary
+			// kernels have no neighbours to compare, show src_img (or fill_color)
+			void Draw_Content_Frame(const Vector4u* src_img, Vector4u* out_img, Vector4u fill_color);
+
+		protected:
+			void Cvt_Img_Space(UChar4Image* inimg, Float4Image* outimg, COLOR_SPACE color_space);
+			void Init_Cluster_Centers();
+			void Find_Center_Association();
+			void Update_Cluster_Center();
+			void Enforce_Connectivity();
+			void Init_Cluster_Centers_From_Source(COLOR_SPACE color_space);
+			void Cvt_And_Find_Center_Association(COLOR_SPACE color_space);
+
+			void Downsample_Img(const Float4Image* inimg, Float4Image* outimg, int factor);
+			void Upsample_Labels(const IntImage* inimg, IntImage* outimg, int factor);
+			void Mark_Active_Tiles(int band_width);
+			void Accumulate_Cluster_Sums();
+			void Normalize_Cluster_Sums();
+			void Find_First_Label_Positions();
+			void Remap_Labels();
+			void Reshape_Engine_Buffers(Vector2i map_size);
+			void Fit_Content();
+
+		public:
+
+			seg_engine_CPU(const objects::settings& in_settings);
+			~seg_engine_CPU();
+
+			void Draw_Segmentation_Result(UChar4Image* out_img);
+			void Draw_Boundary_Only(UChar4Image* out_img);
+
+			const char* Get_Backend_Name() const { return backend_name.c_str(); }
+			CPU_ISA Get_CPU_ISA() const { return kernels.isa; }
+		};
+	}
+}
+
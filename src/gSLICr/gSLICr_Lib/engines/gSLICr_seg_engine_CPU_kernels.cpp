@@ -0,0 +1,93 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#include "gSLICr_seg_engine_CPU_kernels.h"
+#include "gSLICr_seg_engine_shared.h"
+
+using namespace gSLICr;
+using namespace gSLICr::objects;
+using namespace gSLICr::engines;
+
+// same starting distance as find_center_association_shared
+static const float max_slic_distance = 999999.9999f;
+
+template <COLOR_SPACE color_space>
+void gSLICr::engines::Cvt_Img_Row_Scalar(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end)
+{
+	for (int x = x_start; x < x_end; x++)
+	{
+		cvt_pixel_shared<color_space>(in_row[x], out_row[x]);
+	}
+}
+
+template void gSLICr::engines::Cvt_Img_Row_Scalar<CIELAB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template void gSLICr::engines::Cvt_Img_Row_Scalar<XYZ>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template void gSLICr::engines::Cvt_Img_Row_Scalar<RGB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+
+void gSLICr::engines::Find_Center_Association_Row_Scalar(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+	const spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist)
+{
+	for (int x = x_start; x < x_end; x++)
+	{
+		int minidx = -1;
+		float dist = max_slic_distance;
+
+		for (int i = 0; i < no_candidates; i++)
+		{
+			float cdist = compute_slic_sq_distance(img_row[x], x, y, candidates[i], weight, max_xy_dist, max_color_dist);
+			if (cdist < dist)
+			{
+				dist = cdist;
+				minidx = candidates[i].id;
+			}
+		}
+
+		if (minidx >= 0) idx_row[x] = minidx;
+	}
+}
+
+void gSLICr::engines::Accumulate_Cluster_Row_Scalar(const Vector4f* img_row, const int* idx_row, int width, int y,
+	spixel_info* sums, int no_spixels)
+{
+	int x = 0;
+	while (x < width)
+	{
+		int label = idx_row[x];
+		int run_start = x;
+
+		Vector4f run_color = img_row[x];
+		for (x++; x < width && idx_row[x] == label; x++)
+		{
+			run_color += img_row[x];
+		}
+
+		if (label < 0 || label >= no_spixels) continue;
+
+		// positions are summed exactly in integers
+		long long run_length = x - run_start;
+		sums[label].color_info += run_color;
+		sums[label].center.x += (float)((run_start + x - 1) * run_length / 2);
+		sums[label].center.y += (float)(y * run_length);
+		sums[label].no_pixels += (int)run_length;
+	}
+}
+
+void gSLICr::engines::Draw_Boundary_Row_Scalar(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+	Vector4u boundary_color, Vector4u fill_color)
+{
+	for (int x = x_start; x < x_end; x++)
+	{
+		int idx = y * img_size.x + x;
+
+		if (idx_img[idx] != idx_img[idx + 1]
+		 || idx_img[idx] != idx_img[idx - 1]
+		 || idx_img[idx] != idx_img[idx - img_size.x]
+		 || idx_img[idx] != idx_img[idx + img_size.x])
+		{
+			out_img[idx] = boundary_color;
+		}
+		else
+		{
+			out_img[idx] = src_img != NULL ? src_img[idx] : fill_color;
+		}
+	}
+}
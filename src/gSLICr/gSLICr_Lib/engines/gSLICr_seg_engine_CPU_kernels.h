@@ -0,0 +1,95 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#pragma once
+#include "../gSLICr_defines.h"
+#include "../objects/gSLICr_spixel_info.h"
+
+// Row kernels of the CPU engine, one variant per instruction set. Every
+// variant performs the same float operations in the same order (the files
+// are built without FP contraction), so the labels do not depend on the
+// variant the dispatcher picks.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GSLICR_WITH_X86_KERNELS
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GSLICR_WITH_NEON_KERNELS
+#endif
+
+namespace gSLICr
+{
+	namespace engines
+	{
+		// Converts the pixels [x_start, x_end) of a row. The kernels are
+		// instantiated once per COLOR_SPACE, the dispatcher picks the one of
+		// the settings.
+		typedef void (*Cvt_Img_Row_Fn)(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+
+		// Associates the pixels [x_start, x_end) of row y to the closest of the
+		// given candidate centers. All the pixels of a row that fall in the same
+		// superpixel cell share the same 3x3 candidates, so the caller gathers
+		// them once per cell. Candidates are compared by squared distance.
+		typedef void (*Find_Center_Association_Row_Fn)(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+			const objects::spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist);
+
+		// Adds the pixels of row y to the sums of the clusters they belong to,
+		// one run of equal labels at a time
+		typedef void (*Accumulate_Cluster_Row_Fn)(const Vector4f* img_row, const int* idx_row, int width, int y,
+			objects::spixel_info* sums, int no_spixels);
+
+		// Writes boundary_color on the label boundaries among the pixels
+		// [x_start, x_end) of row y, and either the source pixel or fill_color
+		// (when src_img is NULL) everywhere else. The pixels must not lie on
+		// the image border.
+		typedef void (*Draw_Boundary_Row_Fn)(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+			Vector4u boundary_color, Vector4u fill_color);
+
+		template <COLOR_SPACE color_space>
+		void Cvt_Img_Row_Scalar(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+		void Find_Center_Association_Row_Scalar(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+			const objects::spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist);
+		void Accumulate_Cluster_Row_Scalar(const Vector4f* img_row, const int* idx_row, int width, int y,
+			objects::spixel_info* sums, int no_spixels);
+		void Draw_Boundary_Row_Scalar(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+			Vector4u boundary_color, Vector4u fill_color);
+
+#ifdef GSLICR_WITH_X86_KERNELS
+		// 4 pixels at a time
+		template <COLOR_SPACE color_space>
+		void Cvt_Img_Row_SSE42(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+		void Find_Center_Association_Row_SSE42(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+			const objects::spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist);
+		void Accumulate_Cluster_Row_SSE42(const Vector4f* img_row, const int* idx_row, int width, int y,
+			objects::spixel_info* sums, int no_spixels);
+		void Draw_Boundary_Row_SSE42(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+			Vector4u boundary_color, Vector4u fill_color);
+
+		// 8 pixels at a time
+		template <COLOR_SPACE color_space>
+		void Cvt_Img_Row_AVX2(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+		void Find_Center_Association_Row_AVX2(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+			const objects::spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist);
+		void Draw_Boundary_Row_AVX2(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+			Vector4u boundary_color, Vector4u fill_color);
+
+		// 16 pixels at a time
+		void Find_Center_Association_Row_AVX512(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+			const objects::spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist);
+		void Draw_Boundary_Row_AVX512(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+			Vector4u boundary_color, Vector4u fill_color);
+#endif
+
+#ifdef GSLICR_WITH_NEON_KERNELS
+		// 4 pixels at a time
+		template <COLOR_SPACE color_space>
+		void Cvt_Img_Row_NEON(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+		void Find_Center_Association_Row_NEON(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+			const objects::spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist);
+		void Accumulate_Cluster_Row_NEON(const Vector4f* img_row, const int* idx_row, int width, int y,
+			objects::spixel_info* sums, int no_spixels);
+		void Draw_Boundary_Row_NEON(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+			Vector4u boundary_color, Vector4u fill_color);
+#endif
+	}
+}
@@ -0,0 +1,172 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#include "gSLICr_seg_engine_CPU_kernels.h"
+
+#ifdef GSLICR_WITH_NEON_KERNELS
+
+#include <arm_neon.h>
+#include <string.h>
+
+using namespace gSLICr;
+using namespace gSLICr::objects;
+using namespace gSLICr::engines;
+
+// same starting distance as find_center_association_shared
+static const float max_slic_distance = 999999.9999f;
+
+// NOTE: multiplies and adds are kept separate (no vmla/vfma) and evaluated in
+// the same order as the scalar code in gSLICr_seg_engine_shared.h
+
+static inline uint32_t Pack_Pixel(const Vector4u& pix)
+{
+	uint32_t packed;
+	memcpy(&packed, &pix, sizeof(uint32_t));
+	return packed;
+}
+
+template <COLOR_SPACE color_space>
+void gSLICr::engines::Cvt_Img_Row_NEON(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end)
+{
+	int x = x_start;
+
+	// CIELAB needs powf, which has no bit-exact vector counterpart
+	if (color_space != CIELAB)
+	{
+		const uint32x4_t byte_mask = vdupq_n_u32(0xff);
+		const float32x4_t to_unit = vdupq_n_f32(0.0039216f);
+
+		for (; x + 4 <= x_end; x += 4)
+		{
+			uint32x4_t pix = vld1q_u32((const uint32_t*)(in_row + x));
+
+			float32x4x4_t out;
+			out.val[0] = vcvtq_f32_u32(vandq_u32(pix, byte_mask));
+			out.val[1] = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(pix, 8), byte_mask));
+			out.val[2] = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(pix, 16), byte_mask));
+			out.val[3] = vdupq_n_f32(0.0f);
+
+			if (color_space == XYZ)
+			{
+				float32x4_t b = vmulq_f32(out.val[0], to_unit);
+				float32x4_t g = vmulq_f32(out.val[1], to_unit);
+				float32x4_t r = vmulq_f32(out.val[2], to_unit);
+
+				out.val[0] = vaddq_f32(vaddq_f32(vmulq_n_f32(r, 0.412453f), vmulq_n_f32(g, 0.357580f)), vmulq_n_f32(b, 0.180423f));
+				out.val[1] = vaddq_f32(vaddq_f32(vmulq_n_f32(r, 0.212671f), vmulq_n_f32(g, 0.715160f)), vmulq_n_f32(b, 0.072169f));
+				out.val[2] = vaddq_f32(vaddq_f32(vmulq_n_f32(r, 0.019334f), vmulq_n_f32(g, 0.119193f)), vmulq_n_f32(b, 0.950227f));
+			}
+
+			vst4q_f32((float*)(out_row + x), out);
+		}
+	}
+
+	Cvt_Img_Row_Scalar<color_space>(in_row, out_row, x, x_end);
+}
+
+template void gSLICr::engines::Cvt_Img_Row_NEON<CIELAB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template void gSLICr::engines::Cvt_Img_Row_NEON<XYZ>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template void gSLICr::engines::Cvt_Img_Row_NEON<RGB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+
+void gSLICr::engines::Find_Center_Association_Row_NEON(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+	const spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist)
+{
+	const float32x4_t v_weight = vdupq_n_f32(weight);
+	const float32x4_t v_max_xy_dist = vdupq_n_f32(max_xy_dist);
+	const float32x4_t v_max_color_dist = vdupq_n_f32(max_color_dist);
+	const float32x4_t v_y = vdupq_n_f32((float)y);
+	const int32_t lanes[4] = { 0, 1, 2, 3 };
+	const int32x4_t v_lane = vld1q_s32(lanes);
+
+	int x = x_start;
+	for (; x + 4 <= x_end; x += 4)
+	{
+		// deinterleaves the xyzw pixels while loading
+		float32x4x4_t pix = vld4q_f32((const float*)(img_row + x));
+
+		float32x4_t v_x = vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(x), v_lane));
+
+		float32x4_t best_dist = vdupq_n_f32(max_slic_distance);
+		int32x4_t best_idx = vdupq_n_s32(-1);
+
+		for (int i = 0; i < no_candidates; i++)
+		{
+			const spixel_info& ctr = candidates[i];
+
+			float32x4_t dr = vsubq_f32(pix.val[0], vdupq_n_f32(ctr.color_info.x));
+			float32x4_t dg = vsubq_f32(pix.val[1], vdupq_n_f32(ctr.color_info.y));
+			float32x4_t db = vsubq_f32(pix.val[2], vdupq_n_f32(ctr.color_info.z));
+			float32x4_t dcolor = vaddq_f32(vaddq_f32(vmulq_f32(dr, dr), vmulq_f32(dg, dg)), vmulq_f32(db, db));
+
+			float32x4_t dx = vsubq_f32(v_x, vdupq_n_f32(ctr.center.x));
+			float32x4_t dy = vsubq_f32(v_y, vdupq_n_f32(ctr.center.y));
+			float32x4_t dxy = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy));
+
+			float32x4_t dist = vaddq_f32(vmulq_f32(dcolor, v_max_color_dist), vmulq_f32(vmulq_f32(v_weight, dxy), v_max_xy_dist));
+
+			uint32x4_t closer = vcltq_f32(dist, best_dist);
+			best_dist = vbslq_f32(closer, dist, best_dist);
+			best_idx = vbslq_s32(closer, vdupq_n_s32(ctr.id), best_idx);
+		}
+
+		// pixels without any close enough center keep their label
+		int32x4_t old_idx = vld1q_s32(idx_row + x);
+		uint32x4_t unset = vceqq_s32(best_idx, vdupq_n_s32(-1));
+		vst1q_s32(idx_row + x, vbslq_s32(unset, old_idx, best_idx));
+	}
+
+	Find_Center_Association_Row_Scalar(img_row, idx_row, x, x_end, y, candidates, no_candidates, weight, max_xy_dist, max_color_dist);
+}
+
+void gSLICr::engines::Accumulate_Cluster_Row_NEON(const Vector4f* img_row, const int* idx_row, int width, int y,
+	spixel_info* sums, int no_spixels)
+{
+	// a pixel is already 4 floats wide, adding it in one register does the
+	// same additions as Accumulate_Cluster_Row_Scalar
+	int x = 0;
+	while (x < width)
+	{
+		int label = idx_row[x];
+		int run_start = x;
+
+		float32x4_t run_color = vld1q_f32((const float*)(img_row + x));
+		for (x++; x < width && idx_row[x] == label; x++)
+		{
+			run_color = vaddq_f32(run_color, vld1q_f32((const float*)(img_row + x)));
+		}
+
+		if (label < 0 || label >= no_spixels) continue;
+
+		long long run_length = x - run_start;
+		float* sum_color = (float*)&sums[label].color_info;
+		vst1q_f32(sum_color, vaddq_f32(vld1q_f32(sum_color), run_color));
+		sums[label].center.x += (float)((run_start + x - 1) * run_length / 2);
+		sums[label].center.y += (float)(y * run_length);
+		sums[label].no_pixels += (int)run_length;
+	}
+}
+
+void gSLICr::engines::Draw_Boundary_Row_NEON(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+	Vector4u boundary_color, Vector4u fill_color)
+{
+	const uint32x4_t v_boundary = vdupq_n_u32(Pack_Pixel(boundary_color));
+	const uint32x4_t v_fill = vdupq_n_u32(Pack_Pixel(fill_color));
+
+	int x = x_start;
+	for (; x + 4 <= x_end; x += 4)
+	{
+		int idx = y * img_size.x + x;
+
+		// one 32 bit lane is both a label and an rgba pixel
+		int32x4_t label = vld1q_s32(idx_img + idx);
+		uint32x4_t same = vandq_u32(
+			vandq_u32(vceqq_s32(label, vld1q_s32(idx_img + idx + 1)), vceqq_s32(label, vld1q_s32(idx_img + idx - 1))),
+			vandq_u32(vceqq_s32(label, vld1q_s32(idx_img + idx - img_size.x)), vceqq_s32(label, vld1q_s32(idx_img + idx + img_size.x))));
+
+		uint32x4_t inside = src_img != NULL ? vld1q_u32((const uint32_t*)(src_img + idx)) : v_fill;
+		vst1q_u32((uint32_t*)(out_img + idx), vbslq_u32(same, inside, v_boundary));
+	}
+
+	Draw_Boundary_Row_Scalar(idx_img, src_img, out_img, img_size, y, x, x_end, boundary_color, fill_color);
+}
+
+#endif
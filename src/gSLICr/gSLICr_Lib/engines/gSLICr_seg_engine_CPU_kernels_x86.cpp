@@ -0,0 +1,445 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of gSLICr
+
+#include "gSLICr_seg_engine_CPU_kernels.h"
+
+#ifdef GSLICR_WITH_X86_KERNELS
+
+#include <immintrin.h>
+#include <string.h>
+
+using namespace gSLICr;
+using namespace gSLICr::objects;
+using namespace gSLICr::engines;
+
+// same starting distance as find_center_association_shared
+static const float max_slic_distance = 999999.9999f;
+
+// NOTE: the variants are built without FMA and evaluate every expression in
+// the same order as the scalar code in gSLICr_seg_engine_shared.h
+
+static inline int Pack_Pixel(const Vector4u& pix)
+{
+	int packed;
+	memcpy(&packed, &pix, sizeof(int));
+	return packed;
+}
+
+// ----------------------------------------------------
+//
+//	SSE4.2
+//
+// ----------------------------------------------------
+
+template <COLOR_SPACE color_space>
+__attribute__((target("sse4.2")))
+void gSLICr::engines::Cvt_Img_Row_SSE42(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end)
+{
+	int x = x_start;
+
+	// CIELAB needs powf, which has no bit-exact vector counterpart
+	if (color_space != CIELAB)
+	{
+		const __m128i byte_mask = _mm_set1_epi32(0xff);
+		const __m128 to_unit = _mm_set1_ps(0.0039216f);
+
+		for (; x + 4 <= x_end; x += 4)
+		{
+			__m128i pix = _mm_loadu_si128((const __m128i*)(in_row + x));
+			__m128 c0 = _mm_cvtepi32_ps(_mm_and_si128(pix, byte_mask));
+			__m128 c1 = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pix, 8), byte_mask));
+			__m128 c2 = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pix, 16), byte_mask));
+			__m128 c3 = _mm_setzero_ps();
+
+			if (color_space == XYZ)
+			{
+				__m128 b = _mm_mul_ps(c0, to_unit);
+				__m128 g = _mm_mul_ps(c1, to_unit);
+				__m128 r = _mm_mul_ps(c2, to_unit);
+
+				c0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.412453f)), _mm_mul_ps(g, _mm_set1_ps(0.357580f))), _mm_mul_ps(b, _mm_set1_ps(0.180423f)));
+				c1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.212671f)), _mm_mul_ps(g, _mm_set1_ps(0.715160f))), _mm_mul_ps(b, _mm_set1_ps(0.072169f)));
+				c2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.019334f)), _mm_mul_ps(g, _mm_set1_ps(0.119193f))), _mm_mul_ps(b, _mm_set1_ps(0.950227f)));
+			}
+
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			_mm_storeu_ps((float*)(out_row + x), c0);
+			_mm_storeu_ps((float*)(out_row + x + 1), c1);
+			_mm_storeu_ps((float*)(out_row + x + 2), c2);
+			_mm_storeu_ps((float*)(out_row + x + 3), c3);
+		}
+	}
+
+	Cvt_Img_Row_Scalar<color_space>(in_row, out_row, x, x_end);
+}
+
+// GCC only applies the target attribute to instantiations that repeat it
+template __attribute__((target("sse4.2"))) void gSLICr::engines::Cvt_Img_Row_SSE42<CIELAB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template __attribute__((target("sse4.2"))) void gSLICr::engines::Cvt_Img_Row_SSE42<XYZ>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template __attribute__((target("sse4.2"))) void gSLICr::engines::Cvt_Img_Row_SSE42<RGB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+
+__attribute__((target("sse4.2")))
+void gSLICr::engines::Find_Center_Association_Row_SSE42(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+	const spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist)
+{
+	const __m128 v_weight = _mm_set1_ps(weight);
+	const __m128 v_max_xy_dist = _mm_set1_ps(max_xy_dist);
+	const __m128 v_max_color_dist = _mm_set1_ps(max_color_dist);
+	const __m128 v_y = _mm_set1_ps((float)y);
+	const __m128i v_lane = _mm_setr_epi32(0, 1, 2, 3);
+
+	int x = x_start;
+	for (; x + 4 <= x_end; x += 4)
+	{
+		const float* src = (const float*)(img_row + x);
+		__m128 pix_x = _mm_loadu_ps(src);
+		__m128 pix_y = _mm_loadu_ps(src + 4);
+		__m128 pix_z = _mm_loadu_ps(src + 8);
+		__m128 pix_w = _mm_loadu_ps(src + 12);
+		_MM_TRANSPOSE4_PS(pix_x, pix_y, pix_z, pix_w);
+
+		__m128 v_x = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), v_lane));
+
+		__m128 best_dist = _mm_set1_ps(max_slic_distance);
+		__m128 best_idx = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (int i = 0; i < no_candidates; i++)
+		{
+			const spixel_info& ctr = candidates[i];
+
+			__m128 dr = _mm_sub_ps(pix_x, _mm_set1_ps(ctr.color_info.x));
+			__m128 dg = _mm_sub_ps(pix_y, _mm_set1_ps(ctr.color_info.y));
+			__m128 db = _mm_sub_ps(pix_z, _mm_set1_ps(ctr.color_info.z));
+			__m128 dcolor = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+			__m128 dx = _mm_sub_ps(v_x, _mm_set1_ps(ctr.center.x));
+			__m128 dy = _mm_sub_ps(v_y, _mm_set1_ps(ctr.center.y));
+			__m128 dxy = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+			__m128 dist = _mm_add_ps(_mm_mul_ps(dcolor, v_max_color_dist), _mm_mul_ps(_mm_mul_ps(v_weight, dxy), v_max_xy_dist));
+
+			__m128 closer = _mm_cmplt_ps(dist, best_dist);
+			best_dist = _mm_blendv_ps(best_dist, dist, closer);
+			best_idx = _mm_blendv_ps(best_idx, _mm_castsi128_ps(_mm_set1_epi32(ctr.id)), closer);
+		}
+
+		// pixels without any close enough center keep their label
+		__m128i old_idx = _mm_loadu_si128((const __m128i*)(idx_row + x));
+		__m128i new_idx = _mm_castps_si128(best_idx);
+		__m128i unset = _mm_cmpeq_epi32(new_idx, _mm_set1_epi32(-1));
+		_mm_storeu_si128((__m128i*)(idx_row + x), _mm_blendv_epi8(new_idx, old_idx, unset));
+	}
+
+	Find_Center_Association_Row_Scalar(img_row, idx_row, x, x_end, y, candidates, no_candidates, weight, max_xy_dist, max_color_dist);
+}
+
+__attribute__((target("sse4.2")))
+void gSLICr::engines::Accumulate_Cluster_Row_SSE42(const Vector4f* img_row, const int* idx_row, int width, int y,
+	spixel_info* sums, int no_spixels)
+{
+	// a pixel is already 4 floats wide, adding it in one register does the
+	// same additions as Accumulate_Cluster_Row_Scalar
+	int x = 0;
+	while (x < width)
+	{
+		int label = idx_row[x];
+		int run_start = x;
+
+		__m128 run_color = _mm_loadu_ps((const float*)(img_row + x));
+		for (x++; x < width && idx_row[x] == label; x++)
+		{
+			run_color = _mm_add_ps(run_color, _mm_loadu_ps((const float*)(img_row + x)));
+		}
+
+		if (label < 0 || label >= no_spixels) continue;
+
+		long long run_length = x - run_start;
+		float* sum_color = (float*)&sums[label].color_info;
+		_mm_storeu_ps(sum_color, _mm_add_ps(_mm_loadu_ps(sum_color), run_color));
+		sums[label].center.x += (float)((run_start + x - 1) * run_length / 2);
+		sums[label].center.y += (float)(y * run_length);
+		sums[label].no_pixels += (int)run_length;
+	}
+}
+
+__attribute__((target("sse4.2")))
+void gSLICr::engines::Draw_Boundary_Row_SSE42(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+	Vector4u boundary_color, Vector4u fill_color)
+{
+	const __m128i v_boundary = _mm_set1_epi32(Pack_Pixel(boundary_color));
+	const __m128i v_fill = _mm_set1_epi32(Pack_Pixel(fill_color));
+
+	int x = x_start;
+	for (; x + 4 <= x_end; x += 4)
+	{
+		int idx = y * img_size.x + x;
+
+		// one 32 bit lane is both a label and an rgba pixel
+		__m128i label = _mm_loadu_si128((const __m128i*)(idx_img + idx));
+		__m128i same = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi32(label, _mm_loadu_si128((const __m128i*)(idx_img + idx + 1))),
+				_mm_cmpeq_epi32(label, _mm_loadu_si128((const __m128i*)(idx_img + idx - 1)))),
+			_mm_and_si128(_mm_cmpeq_epi32(label, _mm_loadu_si128((const __m128i*)(idx_img + idx - img_size.x))),
+				_mm_cmpeq_epi32(label, _mm_loadu_si128((const __m128i*)(idx_img + idx + img_size.x)))));
+
+		__m128i inside = src_img != NULL ? _mm_loadu_si128((const __m128i*)(src_img + idx)) : v_fill;
+		_mm_storeu_si128((__m128i*)(out_img + idx), _mm_blendv_epi8(v_boundary, inside, same));
+	}
+
+	Draw_Boundary_Row_Scalar(idx_img, src_img, out_img, img_size, y, x, x_end, boundary_color, fill_color);
+}
+
+// ----------------------------------------------------
+//
+//	AVX2
+//
+// ----------------------------------------------------
+
+template <COLOR_SPACE color_space>
+__attribute__((target("avx2")))
+void gSLICr::engines::Cvt_Img_Row_AVX2(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end)
+{
+	int x = x_start;
+
+	if (color_space != CIELAB)
+	{
+		const __m256i byte_mask = _mm256_set1_epi32(0xff);
+		const __m256 to_unit = _mm256_set1_ps(0.0039216f);
+
+		for (; x + 8 <= x_end; x += 8)
+		{
+			__m256i pix = _mm256_loadu_si256((const __m256i*)(in_row + x));
+			__m256 c0 = _mm256_cvtepi32_ps(_mm256_and_si256(pix, byte_mask));
+			__m256 c1 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pix, 8), byte_mask));
+			__m256 c2 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pix, 16), byte_mask));
+
+			if (color_space == XYZ)
+			{
+				__m256 b = _mm256_mul_ps(c0, to_unit);
+				__m256 g = _mm256_mul_ps(c1, to_unit);
+				__m256 r = _mm256_mul_ps(c2, to_unit);
+
+				c0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(0.412453f)), _mm256_mul_ps(g, _mm256_set1_ps(0.357580f))), _mm256_mul_ps(b, _mm256_set1_ps(0.180423f)));
+				c1 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(0.212671f)), _mm256_mul_ps(g, _mm256_set1_ps(0.715160f))), _mm256_mul_ps(b, _mm256_set1_ps(0.072169f)));
+				c2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(0.019334f)), _mm256_mul_ps(g, _mm256_set1_ps(0.119193f))), _mm256_mul_ps(b, _mm256_set1_ps(0.950227f)));
+			}
+
+			// back to xyzw pixels, one 128 bit half at a time
+			for (int half = 0; half < 2; half++)
+			{
+				__m128 r0 = half == 0 ? _mm256_castps256_ps128(c0) : _mm256_extractf128_ps(c0, 1);
+				__m128 r1 = half == 0 ? _mm256_castps256_ps128(c1) : _mm256_extractf128_ps(c1, 1);
+				__m128 r2 = half == 0 ? _mm256_castps256_ps128(c2) : _mm256_extractf128_ps(c2, 1);
+				__m128 r3 = _mm_setzero_ps();
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+				float* dst = (float*)(out_row + x + 4 * half);
+				_mm_storeu_ps(dst, r0);
+				_mm_storeu_ps(dst + 4, r1);
+				_mm_storeu_ps(dst + 8, r2);
+				_mm_storeu_ps(dst + 12, r3);
+			}
+		}
+	}
+
+	Cvt_Img_Row_Scalar<color_space>(in_row, out_row, x, x_end);
+}
+
+// GCC only applies the target attribute to instantiations that repeat it
+template __attribute__((target("avx2"))) void gSLICr::engines::Cvt_Img_Row_AVX2<CIELAB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template __attribute__((target("avx2"))) void gSLICr::engines::Cvt_Img_Row_AVX2<XYZ>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+template __attribute__((target("avx2"))) void gSLICr::engines::Cvt_Img_Row_AVX2<RGB>(const Vector4u* in_row, Vector4f* out_row, int x_start, int x_end);
+
+__attribute__((target("avx2")))
+void gSLICr::engines::Find_Center_Association_Row_AVX2(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+	const spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist)
+{
+	const __m256 v_weight = _mm256_set1_ps(weight);
+	const __m256 v_max_xy_dist = _mm256_set1_ps(max_xy_dist);
+	const __m256 v_max_color_dist = _mm256_set1_ps(max_color_dist);
+	const __m256 v_y = _mm256_set1_ps((float)y);
+	const __m256i v_lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	int x = x_start;
+	for (; x + 8 <= x_end; x += 8)
+	{
+		// deinterleave 8 xyzw pixels into one register per channel
+		const float* src = (const float*)(img_row + x);
+		__m256 p01 = _mm256_loadu_ps(src);
+		__m256 p23 = _mm256_loadu_ps(src + 8);
+		__m256 p45 = _mm256_loadu_ps(src + 16);
+		__m256 p67 = _mm256_loadu_ps(src + 24);
+
+		__m256 r0 = _mm256_permute2f128_ps(p01, p45, 0x20);
+		__m256 r1 = _mm256_permute2f128_ps(p01, p45, 0x31);
+		__m256 r2 = _mm256_permute2f128_ps(p23, p67, 0x20);
+		__m256 r3 = _mm256_permute2f128_ps(p23, p67, 0x31);
+
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t2 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+		__m256 pix_x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 pix_y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 pix_z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+
+		__m256 v_x = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x), v_lane));
+
+		__m256 best_dist = _mm256_set1_ps(max_slic_distance);
+		__m256 best_idx = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (int i = 0; i < no_candidates; i++)
+		{
+			const spixel_info& ctr = candidates[i];
+
+			__m256 dr = _mm256_sub_ps(pix_x, _mm256_set1_ps(ctr.color_info.x));
+			__m256 dg = _mm256_sub_ps(pix_y, _mm256_set1_ps(ctr.color_info.y));
+			__m256 db = _mm256_sub_ps(pix_z, _mm256_set1_ps(ctr.color_info.z));
+			__m256 dcolor = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dr, dr), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(db, db));
+
+			__m256 dx = _mm256_sub_ps(v_x, _mm256_set1_ps(ctr.center.x));
+			__m256 dy = _mm256_sub_ps(v_y, _mm256_set1_ps(ctr.center.y));
+			__m256 dxy = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+			__m256 dist = _mm256_add_ps(_mm256_mul_ps(dcolor, v_max_color_dist), _mm256_mul_ps(_mm256_mul_ps(v_weight, dxy), v_max_xy_dist));
+
+			__m256 closer = _mm256_cmp_ps(dist, best_dist, _CMP_LT_OQ);
+			best_dist = _mm256_blendv_ps(best_dist, dist, closer);
+			best_idx = _mm256_blendv_ps(best_idx, _mm256_castsi256_ps(_mm256_set1_epi32(ctr.id)), closer);
+		}
+
+		// pixels without any close enough center keep their label
+		__m256i old_idx = _mm256_loadu_si256((const __m256i*)(idx_row + x));
+		__m256i new_idx = _mm256_castps_si256(best_idx);
+		__m256i unset = _mm256_cmpeq_epi32(new_idx, _mm256_set1_epi32(-1));
+		_mm256_storeu_si256((__m256i*)(idx_row + x), _mm256_blendv_epi8(new_idx, old_idx, unset));
+	}
+
+	Find_Center_Association_Row_Scalar(img_row, idx_row, x, x_end, y, candidates, no_candidates, weight, max_xy_dist, max_color_dist);
+}
+
+__attribute__((target("avx2")))
+void gSLICr::engines::Draw_Boundary_Row_AVX2(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+	Vector4u boundary_color, Vector4u fill_color)
+{
+	const __m256i v_boundary = _mm256_set1_epi32(Pack_Pixel(boundary_color));
+	const __m256i v_fill = _mm256_set1_epi32(Pack_Pixel(fill_color));
+
+	int x = x_start;
+	for (; x + 8 <= x_end; x += 8)
+	{
+		int idx = y * img_size.x + x;
+
+		__m256i label = _mm256_loadu_si256((const __m256i*)(idx_img + idx));
+		__m256i same = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpeq_epi32(label, _mm256_loadu_si256((const __m256i*)(idx_img + idx + 1))),
+				_mm256_cmpeq_epi32(label, _mm256_loadu_si256((const __m256i*)(idx_img + idx - 1)))),
+			_mm256_and_si256(_mm256_cmpeq_epi32(label, _mm256_loadu_si256((const __m256i*)(idx_img + idx - img_size.x))),
+				_mm256_cmpeq_epi32(label, _mm256_loadu_si256((const __m256i*)(idx_img + idx + img_size.x)))));
+
+		__m256i inside = src_img != NULL ? _mm256_loadu_si256((const __m256i*)(src_img + idx)) : v_fill;
+		_mm256_storeu_si256((__m256i*)(out_img + idx), _mm256_blendv_epi8(v_boundary, inside, same));
+	}
+
+	Draw_Boundary_Row_Scalar(idx_img, src_img, out_img, img_size, y, x, x_end, boundary_color, fill_color);
+}
+
+// ----------------------------------------------------
+//
+//	AVX-512
+//
+// ----------------------------------------------------
+
+__attribute__((target("avx512f")))
+void gSLICr::engines::Find_Center_Association_Row_AVX512(const Vector4f* img_row, int* idx_row, int x_start, int x_end, int y,
+	const spixel_info* candidates, int no_candidates, float weight, float max_xy_dist, float max_color_dist)
+{
+	const __m512 v_weight = _mm512_set1_ps(weight);
+	const __m512 v_max_xy_dist = _mm512_set1_ps(max_xy_dist);
+	const __m512 v_max_color_dist = _mm512_set1_ps(max_color_dist);
+	const __m512 v_y = _mm512_set1_ps((float)y);
+	const __m512i v_lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+	// two rounds of permutes deinterleave 16 xyzw pixels
+	const __m512i sel_xy = _mm512_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28, 1, 5, 9, 13, 17, 21, 25, 29);
+	const __m512i sel_zw = _mm512_setr_epi32(2, 6, 10, 14, 18, 22, 26, 30, 3, 7, 11, 15, 19, 23, 27, 31);
+	const __m512i sel_lo = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23);
+	const __m512i sel_hi = _mm512_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15, 24, 25, 26, 27, 28, 29, 30, 31);
+
+	int x = x_start;
+	for (; x + 16 <= x_end; x += 16)
+	{
+		const float* src = (const float*)(img_row + x);
+		__m512 p0 = _mm512_loadu_ps(src);
+		__m512 p1 = _mm512_loadu_ps(src + 16);
+		__m512 p2 = _mm512_loadu_ps(src + 32);
+		__m512 p3 = _mm512_loadu_ps(src + 48);
+
+		__m512 xy01 = _mm512_permutex2var_ps(p0, sel_xy, p1);
+		__m512 zw01 = _mm512_permutex2var_ps(p0, sel_zw, p1);
+		__m512 xy23 = _mm512_permutex2var_ps(p2, sel_xy, p3);
+		__m512 zw23 = _mm512_permutex2var_ps(p2, sel_zw, p3);
+
+		__m512 pix_x = _mm512_permutex2var_ps(xy01, sel_lo, xy23);
+		__m512 pix_y = _mm512_permutex2var_ps(xy01, sel_hi, xy23);
+		__m512 pix_z = _mm512_permutex2var_ps(zw01, sel_lo, zw23);
+
+		__m512 v_x = _mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(x), v_lane));
+
+		__m512 best_dist = _mm512_set1_ps(max_slic_distance);
+		__m512i best_idx = _mm512_set1_epi32(-1);
+
+		for (int i = 0; i < no_candidates; i++)
+		{
+			const spixel_info& ctr = candidates[i];
+
+			__m512 dr = _mm512_sub_ps(pix_x, _mm512_set1_ps(ctr.color_info.x));
+			__m512 dg = _mm512_sub_ps(pix_y, _mm512_set1_ps(ctr.color_info.y));
+			__m512 db = _mm512_sub_ps(pix_z, _mm512_set1_ps(ctr.color_info.z));
+			__m512 dcolor = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dr, dr), _mm512_mul_ps(dg, dg)), _mm512_mul_ps(db, db));
+
+			__m512 dx = _mm512_sub_ps(v_x, _mm512_set1_ps(ctr.center.x));
+			__m512 dy = _mm512_sub_ps(v_y, _mm512_set1_ps(ctr.center.y));
+			__m512 dxy = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+
+			__m512 dist = _mm512_add_ps(_mm512_mul_ps(dcolor, v_max_color_dist), _mm512_mul_ps(_mm512_mul_ps(v_weight, dxy), v_max_xy_dist));
+
+			__mmask16 closer = _mm512_cmp_ps_mask(dist, best_dist, _CMP_LT_OQ);
+			best_dist = _mm512_mask_blend_ps(closer, best_dist, dist);
+			best_idx = _mm512_mask_blend_epi32(closer, best_idx, _mm512_set1_epi32(ctr.id));
+		}
+
+		// pixels without any close enough center keep their label
+		__mmask16 found = _mm512_cmpneq_epi32_mask(best_idx, _mm512_set1_epi32(-1));
+		_mm512_mask_storeu_epi32(idx_row + x, found, best_idx);
+	}
+
+	Find_Center_Association_Row_Scalar(img_row, idx_row, x, x_end, y, candidates, no_candidates, weight, max_xy_dist, max_color_dist);
+}
+
+__attribute__((target("avx512f")))
+void gSLICr::engines::Draw_Boundary_Row_AVX512(const int* idx_img, const Vector4u* src_img, Vector4u* out_img, Vector2i img_size, int y, int x_start, int x_end,
+	Vector4u boundary_color, Vector4u fill_color)
+{
+	const __m512i v_boundary = _mm512_set1_epi32(Pack_Pixel(boundary_color));
+	const __m512i v_fill = _mm512_set1_epi32(Pack_Pixel(fill_color));
+
+	int x = x_start;
+	for (; x + 16 <= x_end; x += 16)
+	{
+		int idx = y * img_size.x + x;
+
+		__m512i label = _mm512_loadu_si512(idx_img + idx);
+		__mmask16 same = _mm512_cmpeq_epi32_mask(label, _mm512_loadu_si512(idx_img + idx + 1))
+			& _mm512_cmpeq_epi32_mask(label, _mm512_loadu_si512(idx_img + idx - 1))
+			& _mm512_cmpeq_epi32_mask(label, _mm512_loadu_si512(idx_img + idx - img_size.x))
+			& _mm512_cmpeq_epi32_mask(label, _mm512_loadu_si512(idx_img + idx + img_size.x));
+
+		__m512i inside = src_img != NULL ? _mm512_loadu_si512(src_img + idx) : v_fill;
+		_mm512_storeu_si512(out_img + idx, _mm512_mask_blend_epi32(same, v_boundary, inside));
+	}
+
+	Draw_Boundary_Row_Scalar(idx_img, src_img, out_img, img_size, y, x, x_end, boundary_color, fill_color);
+}
+
+#endif
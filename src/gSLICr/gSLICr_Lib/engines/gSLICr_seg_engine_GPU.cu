@@ -14,21 +14,95 @@ using namespace gSLICr::engines;
 //
 // ----------------------------------------------------
 
-__global__ void Cvt_Img_Space_device(const Vector4u* inimg, Vector4f* outimg, Vector2i img_size, COLOR_SPACE color_space);
+template <COLOR_SPACE color_space>
+__global__ void Cvt_Img_Space_device(const Vector4u* inimg, Vector4f* outimg, Vector2i img_size);
 
-__global__ void Enforce_Connectivity_device(const int* in_idx_img, int* out_idx_img, Vector2i img_size);
+__global__ void Enforce_Connectivity_device(const int* in_idx_img, int* out_idx_img, Vector2i img_size, Vector2i content_size);
 
-__global__ void Init_Cluster_Centers_device(const Vector4f* inimg, spixel_info* out_spixel, Vector2i map_size, Vector2i img_size, int spixel_size);
+__global__ void Init_Cluster_Centers_device(const Vector4f* inimg, spixel_info* out_spixel, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, bool low_gradient_init);
 
-__global__ void Find_Center_Association_device(const Vector4f* inimg, const spixel_info* in_spixel_map, int* out_idx_img, Vector2i map_size, Vector2i img_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist);
+__global__ void Init_Cluster_Centers_From_Source_device(const Vector4u* sourceimg, spixel_info* out_spixel, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, COLOR_SPACE color_space, bool low_gradient_init);
 
+template <COLOR_SPACE color_space, SPIXEL_SIZE_BUCKET spixel_bucket>
+__global__ void Cvt_And_Find_Center_Association_device(const Vector4u* sourceimg, Vector4f* outimg, const spixel_info* in_spixel_map, int* out_idx_img, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist);
+
+template <SPIXEL_SIZE_BUCKET spixel_bucket>
+__global__ void Find_Center_Association_device(const Vector4f* inimg, const spixel_info* in_spixel_map, int* out_idx_img, const int* active_tile_map, spixel_info* cluster_sums, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist);
+
+template <SPIXEL_SIZE_BUCKET spixel_bucket>
 __global__ void Update_Cluster_Center_device(const Vector4f* inimg, const int* in_idx_img, spixel_info* accum_map, Vector2i map_size, Vector2i img_size, int spixel_size, int no_blocks_per_line);
 
-__global__ void Finalize_Reduction_Result_device(const spixel_info* accum_map, spixel_info* spixel_list, Vector2i map_size, int no_blocks_per_spixel);
+__global__ void Finalize_Reduction_Result_device(const spixel_info* accum_map, spixel_info* spixel_list, Vector2i map_size, int no_blocks_per_spixel, bool do_normalize);
+
+__global__ void Normalize_Cluster_Sums_device(const spixel_info* cluster_sums, spixel_info* spixel_list, Vector2i map_size);
+
+__global__ void Draw_Segmentation_Result_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size, Vector2i content_size);
+
+__global__ void Downsample_Img_device(const Vector4f* inimg, Vector4f* outimg, Vector2i in_size, Vector2i in_content, Vector2i out_size, Vector2i out_content, int factor);
+
+__global__ void Upsample_Labels_device(const int* in_idx_img, int* out_idx_img, Vector2i in_size, Vector2i in_content, Vector2i out_size, Vector2i out_content, int factor);
+
+__global__ void Mark_Active_Tiles_device(const int* idx_img, int* tile_map, Vector2i img_size, Vector2i content_size, Vector2i tile_map_size, int band_width);
 
-__global__ void Draw_Segmentation_Result_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size);
+__global__ void Draw_Boundary_Only_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size, Vector2i content_size);
 
-__global__ void Draw_Boundary_Only_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size);
+__global__ void Mask_Border_device(int* idx_img, Vector2i img_size, Vector2i content_size);
+
+__global__ void Find_First_Label_Positions_device(const int* idx_img, int* first_pos, Vector2i img_size, int no_spixels);
+
+__global__ void Remap_Labels_device(int* idx_img, const int* label_remap, Vector2i img_size);
+
+// ----------------------------------------------------
+//
+//	kernel dispatch tables
+//
+// ----------------------------------------------------
+
+typedef void (*Cvt_Img_Space_Kernel)(const Vector4u* inimg, Vector4f* outimg, Vector2i img_size);
+
+typedef void (*Find_Center_Association_Kernel)(const Vector4f* inimg, const spixel_info* in_spixel_map, int* out_idx_img, const int* active_tile_map, spixel_info* cluster_sums, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist);
+
+typedef void (*Update_Cluster_Center_Kernel)(const Vector4f* inimg, const int* in_idx_img, spixel_info* accum_map, Vector2i map_size, Vector2i img_size, int spixel_size, int no_blocks_per_line);
+
+typedef void (*Cvt_And_Find_Center_Association_Kernel)(const Vector4u* sourceimg, Vector4f* outimg, const spixel_info* in_spixel_map, int* out_idx_img, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist);
+
+// indexed by COLOR_SPACE
+static const Cvt_Img_Space_Kernel cvt_img_space_kernels[] =
+{
+	Cvt_Img_Space_device<CIELAB>,
+	Cvt_Img_Space_device<XYZ>,
+	Cvt_Img_Space_device<RGB>
+};
+
+struct spixel_size_kernels
+{
+	SPIXEL_SIZE_BUCKET spixel_bucket;
+	Find_Center_Association_Kernel find_center_association;
+	Update_Cluster_Center_Kernel update_cluster_center;
+	// indexed by COLOR_SPACE
+	Cvt_And_Find_Center_Association_Kernel cvt_and_find_center_association[3];
+};
+
+// the last entry matches any size
+static const spixel_size_kernels spixel_size_kernel_table[] =
+{
+	{ SPIXEL_SIZE_8, Find_Center_Association_device<SPIXEL_SIZE_8>, Update_Cluster_Center_device<SPIXEL_SIZE_8>,
+		{ Cvt_And_Find_Center_Association_device<CIELAB, SPIXEL_SIZE_8>, Cvt_And_Find_Center_Association_device<XYZ, SPIXEL_SIZE_8>, Cvt_And_Find_Center_Association_device<RGB, SPIXEL_SIZE_8> } },
+	{ SPIXEL_SIZE_16, Find_Center_Association_device<SPIXEL_SIZE_16>, Update_Cluster_Center_device<SPIXEL_SIZE_16>,
+		{ Cvt_And_Find_Center_Association_device<CIELAB, SPIXEL_SIZE_16>, Cvt_And_Find_Center_Association_device<XYZ, SPIXEL_SIZE_16>, Cvt_And_Find_Center_Association_device<RGB, SPIXEL_SIZE_16> } },
+	{ SPIXEL_SIZE_32, Find_Center_Association_device<SPIXEL_SIZE_32>, Update_Cluster_Center_device<SPIXEL_SIZE_32>,
+		{ Cvt_And_Find_Center_Association_device<CIELAB, SPIXEL_SIZE_32>, Cvt_And_Find_Center_Association_device<XYZ, SPIXEL_SIZE_32>, Cvt_And_Find_Center_Association_device<RGB, SPIXEL_SIZE_32> } },
+	{ SPIXEL_SIZE_ANY, Find_Center_Association_device<SPIXEL_SIZE_ANY>, Update_Cluster_Center_device<SPIXEL_SIZE_ANY>,
+		{ Cvt_And_Find_Center_Association_device<CIELAB, SPIXEL_SIZE_ANY>, Cvt_And_Find_Center_Association_device<XYZ, SPIXEL_SIZE_ANY>, Cvt_And_Find_Center_Association_device<RGB, SPIXEL_SIZE_ANY> } }
+};
+
+// spixel_size shrinks on the coarse pyramid levels, so this is looked up per launch
+static const spixel_size_kernels& Select_Spixel_Size_Kernels(int spixel_size)
+{
+	int i = 0;
+	while (spixel_size_kernel_table[i].spixel_bucket != SPIXEL_SIZE_ANY && spixel_size_kernel_table[i].spixel_bucket != spixel_size) i++;
+	return spixel_size_kernel_table[i];
+}
 
 // ----------------------------------------------------
 //
@@ -43,53 +117,62 @@ seg_engine_GPU::seg_engine_GPU(const settings& in_settings) : seg_engine(in_sett
 	idx_img = new IntImage(in_settings.img_size, true, true);
 	tmp_idx_img = new IntImage(in_settings.img_size, true, true);
 
-	if (in_settings.seg_method == GIVEN_NUM)
-	{
-		float cluster_size = (float)(in_settings.img_size.x * in_settings.img_size.y) / (float)in_settings.no_segs;
-		spixel_size = (int)ceil(sqrtf(cluster_size));
-	}
-	else
-	{
-		spixel_size = in_settings.spixel_size;
-	}
-	
-	int spixel_per_col = (int)ceil(in_settings.img_size.x / spixel_size);
-	int spixel_per_row = (int)ceil(in_settings.img_size.y / spixel_size);
-	
-	Vector2i map_size = Vector2i(spixel_per_col, spixel_per_row);
+	Init_Spixel_Geometry();
+
+	Vector2i map_size = Compute_Map_Size();
 	spixel_map = new SpixelMap(map_size, true, true);
+	cluster_sums = new SpixelMap(map_size, true, true);
+	label_first_pos = new IntImage(map_size, true, true);
+	label_remap = new IntImage(map_size, true, true);
+	label_table = new IntImage(map_size, true, false);
 
-	float total_pixel_to_search = (float)(spixel_size * spixel_size * 9);
-	no_grid_per_center = (int)ceil(total_pixel_to_search / (float)(BLOCK_DIM * BLOCK_DIM));
+	// the 3x3 superpixel search window is covered by whole blocks
+	int no_blocks_per_line = (int)ceil((float)(spixel_size * 3) / (float)BLOCK_DIM);
+	no_grid_per_center = no_blocks_per_line * no_blocks_per_line;
 
 	map_size.x *= no_grid_per_center;
 	accum_map = new ORUtils::Image<spixel_info>(map_size, true, true);
 
-	// normalizing factors
-	max_xy_dist = 1.0f / (1.4242f * spixel_size); // sqrt(2) * spixel_size
-	switch (in_settings.color_space)
+	active_tile_map = new IntImage(Compute_Tile_Map_Size(), true, true);
+
+	if (pyramid_levels > 0)
 	{
-	case RGB:
-		max_color_dist = 5.0f / (1.7321f * 255);
-		break;
-	case XYZ:
-		max_color_dist = 5.0f / 1.7321f; 
-		break; 
-	case CIELAB:
-		max_color_dist = 15.0f / (1.7321f * 128);
-		break;
+		coarse_cvt_img = new Float4Image(Compute_Coarse_Size(), true, true);
+		coarse_idx_img = new IntImage(Compute_Coarse_Size(), true, true);
 	}
-
-	max_color_dist *= max_color_dist;
-	max_xy_dist *= max_xy_dist;
 }
 
 gSLICr::engines::seg_engine_GPU::~seg_engine_GPU()
 {
 	delete accum_map;
+	delete cluster_sums;
 	delete tmp_idx_img;
 }
 
+void gSLICr::engines::seg_engine_GPU::Reshape_Engine_Buffers(Vector2i map_size)
+{
+	tmp_idx_img->ChangeDims(gSLICr_settings.img_size);
+	cluster_sums->ChangeDims(map_size);
+
+	// spixel_size may have changed with the image size
+	int no_blocks_per_line = (int)ceil((float)(spixel_size * 3) / (float)BLOCK_DIM);
+	no_grid_per_center = no_blocks_per_line * no_blocks_per_line;
+
+	map_size.x *= no_grid_per_center;
+	accum_map->ChangeDims(map_size);
+}
+
+void gSLICr::engines::seg_engine_GPU::Fit_Content()
+{
+	Vector2i img_size = idx_img->noDims;
+	if (content_size == img_size) return;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
+
+	Mask_Border_device << <gridSize, blockSize >> >(idx_img->GetData(MEMORYDEVICE_CUDA), img_size, content_size);
+}
+
 
 void gSLICr::engines::seg_engine_GPU::Cvt_Img_Space(UChar4Image* inimg, Float4Image* outimg, COLOR_SPACE color_space)
 {
@@ -100,7 +183,7 @@ void gSLICr::engines::seg_engine_GPU::Cvt_Img_Space(UChar4Image* inimg, Float4Im
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
 	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
 
-	Cvt_Img_Space_device << <gridSize, blockSize >> >(inimg_ptr, outimg_ptr, img_size, color_space);
+	cvt_img_space_kernels[color_space] << <gridSize, blockSize >> >(inimg_ptr, outimg_ptr, img_size);
 
 }
 
@@ -115,7 +198,7 @@ void gSLICr::engines::seg_engine_GPU::Init_Cluster_Centers()
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
 	dim3 gridSize((int)ceil((float)map_size.x / (float)blockSize.x), (int)ceil((float)map_size.y / (float)blockSize.y));
 
-	Init_Cluster_Centers_device << <gridSize, blockSize >> >(img_ptr, spixel_list, map_size, img_size, spixel_size);
+	Init_Cluster_Centers_device << <gridSize, blockSize >> >(img_ptr, spixel_list, map_size, img_size, content_size, spixel_size, gSLICr_settings.low_gradient_init);
 }
 
 void gSLICr::engines::seg_engine_GPU::Find_Center_Association()
@@ -130,29 +213,89 @@ void gSLICr::engines::seg_engine_GPU::Find_Center_Association()
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
 	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
 
-	Find_Center_Association_device << <gridSize, blockSize >> >(img_ptr, spixel_list, idx_ptr, map_size, img_size, spixel_size, gSLICr_settings.coh_weight,max_xy_dist,max_color_dist);
+	const int* tile_ptr = use_active_tiles ? active_tile_map->GetData(MEMORYDEVICE_CUDA) : NULL;
+	spixel_info* sums_ptr = track_cluster_sums ? cluster_sums->GetData(MEMORYDEVICE_CUDA) : NULL;
+
+	Find_Center_Association_Kernel find_center_association = Select_Spixel_Size_Kernels(spixel_size).find_center_association;
+	find_center_association << <gridSize, blockSize >> >(img_ptr, spixel_list, idx_ptr, tile_ptr, sums_ptr, map_size, img_size, content_size, spixel_size, gSLICr_settings.coh_weight,max_xy_dist,max_color_dist);
+}
+
+void gSLICr::engines::seg_engine_GPU::Init_Cluster_Centers_From_Source(COLOR_SPACE color_space)
+{
+	spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CUDA);
+	const Vector4u* source_ptr = source_img->GetData(MEMORYDEVICE_CUDA);
+
+	Vector2i map_size = spixel_map->noDims;
+	Vector2i img_size = source_img->noDims;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)map_size.x / (float)blockSize.x), (int)ceil((float)map_size.y / (float)blockSize.y));
+
+	Init_Cluster_Centers_From_Source_device << <gridSize, blockSize >> >(source_ptr, spixel_list, map_size, img_size, content_size, spixel_size, color_space, gSLICr_settings.low_gradient_init);
+}
+
+void gSLICr::engines::seg_engine_GPU::Cvt_And_Find_Center_Association(COLOR_SPACE color_space)
+{
+	const spixel_info* spixel_list = spixel_map->GetData(MEMORYDEVICE_CUDA);
+	const Vector4u* source_ptr = source_img->GetData(MEMORYDEVICE_CUDA);
+	Vector4f* img_ptr = cvt_img->GetData(MEMORYDEVICE_CUDA);
+	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CUDA);
+
+	Vector2i map_size = spixel_map->noDims;
+	Vector2i img_size = cvt_img->noDims;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
+
+	Cvt_And_Find_Center_Association_Kernel cvt_and_find_center_association = Select_Spixel_Size_Kernels(spixel_size).cvt_and_find_center_association[color_space];
+	cvt_and_find_center_association << <gridSize, blockSize >> >(source_ptr, img_ptr, spixel_list, idx_ptr, map_size, img_size, content_size, spixel_size, gSLICr_settings.coh_weight, max_xy_dist, max_color_dist);
 }
 
 void gSLICr::engines::seg_engine_GPU::Update_Cluster_Center()
 {
-	spixel_info* accum_map_ptr = accum_map->GetData(MEMORYDEVICE_CUDA);
+	Reduce_Cluster_Info(spixel_map, true);
+}
+
+void gSLICr::engines::seg_engine_GPU::Accumulate_Cluster_Sums()
+{
+	Reduce_Cluster_Info(cluster_sums, false);
+}
+
+void gSLICr::engines::seg_engine_GPU::Normalize_Cluster_Sums()
+{
+	const spixel_info* sums_ptr = cluster_sums->GetData(MEMORYDEVICE_CUDA);
 	spixel_info* spixel_list_ptr = spixel_map->GetData(MEMORYDEVICE_CUDA);
+	Vector2i map_size = spixel_map->noDims;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)map_size.x / (float)blockSize.x), (int)ceil((float)map_size.y / (float)blockSize.y));
+
+	Normalize_Cluster_Sums_device << <gridSize, blockSize >> >(sums_ptr, spixel_list_ptr, map_size);
+}
+
+void gSLICr::engines::seg_engine_GPU::Reduce_Cluster_Info(SpixelMap* out_map, bool do_normalize)
+{
+	spixel_info* accum_map_ptr = accum_map->GetData(MEMORYDEVICE_CUDA);
+	spixel_info* spixel_list_ptr = out_map->GetData(MEMORYDEVICE_CUDA);
 	Vector4f* img_ptr = cvt_img->GetData(MEMORYDEVICE_CUDA);
 	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CUDA);
 
 	Vector2i map_size = spixel_map->noDims;
 	Vector2i img_size = cvt_img->noDims;
 
-	int no_blocks_per_line = spixel_size * 3 / BLOCK_DIM;
+	// spixel_size is smaller on a coarse pyramid level, which needs fewer blocks
+	int no_blocks_per_line = (int)ceil((float)(spixel_size * 3) / (float)BLOCK_DIM);
+	int no_blocks_per_spixel = no_blocks_per_line * no_blocks_per_line;
 
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
-	dim3 gridSize(map_size.x, map_size.y, no_grid_per_center);
+	dim3 gridSize(map_size.x, map_size.y, no_blocks_per_spixel);
 
-	Update_Cluster_Center_device<<<gridSize,blockSize>>>(img_ptr, idx_ptr, accum_map_ptr, map_size, img_size, spixel_size, no_blocks_per_line);
+	Update_Cluster_Center_Kernel update_cluster_center = Select_Spixel_Size_Kernels(spixel_size).update_cluster_center;
+	update_cluster_center<<<gridSize,blockSize>>>(img_ptr, idx_ptr, accum_map_ptr, map_size, img_size, spixel_size, no_blocks_per_line);
 
 	dim3 gridSize2(map_size.x, map_size.y);
 
-	Finalize_Reduction_Result_device<<<gridSize2,blockSize>>>(accum_map_ptr, spixel_list_ptr, map_size, no_grid_per_center);
+	Finalize_Reduction_Result_device<<<gridSize2,blockSize>>>(accum_map_ptr, spixel_list_ptr, map_size, no_blocks_per_spixel, do_normalize);
 }
 
 void gSLICr::engines::seg_engine_GPU::Enforce_Connectivity()
@@ -164,8 +307,78 @@ void gSLICr::engines::seg_engine_GPU::Enforce_Connectivity()
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
 	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
 
-	Enforce_Connectivity_device << <gridSize, blockSize >> >(idx_ptr, tmp_idx_ptr, img_size);
-	Enforce_Connectivity_device << <gridSize, blockSize >> >(tmp_idx_ptr, idx_ptr, img_size);
+	Enforce_Connectivity_device << <gridSize, blockSize >> >(idx_ptr, tmp_idx_ptr, img_size, content_size);
+	Enforce_Connectivity_device << <gridSize, blockSize >> >(tmp_idx_ptr, idx_ptr, img_size, content_size);
+}
+
+void gSLICr::engines::seg_engine_GPU::Downsample_Img(const Float4Image* inimg, Float4Image* outimg, int factor)
+{
+	const Vector4f* inimg_ptr = inimg->GetData(MEMORYDEVICE_CUDA);
+	Vector4f* outimg_ptr = outimg->GetData(MEMORYDEVICE_CUDA);
+
+	Vector2i in_size = inimg->noDims;
+	Vector2i out_size = outimg->noDims;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)out_size.x / (float)blockSize.x), (int)ceil((float)out_size.y / (float)blockSize.y));
+
+	Downsample_Img_device << <gridSize, blockSize >> >(inimg_ptr, outimg_ptr, in_size, content_size, out_size, coarse_content_size, factor);
+}
+
+void gSLICr::engines::seg_engine_GPU::Upsample_Labels(const IntImage* inimg, IntImage* outimg, int factor)
+{
+	const int* in_idx_ptr = inimg->GetData(MEMORYDEVICE_CUDA);
+	int* out_idx_ptr = outimg->GetData(MEMORYDEVICE_CUDA);
+
+	Vector2i in_size = inimg->noDims;
+	Vector2i out_size = outimg->noDims;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)out_size.x / (float)blockSize.x), (int)ceil((float)out_size.y / (float)blockSize.y));
+
+	Upsample_Labels_device << <gridSize, blockSize >> >(in_idx_ptr, out_idx_ptr, in_size, coarse_content_size, out_size, content_size, factor);
+}
+
+void gSLICr::engines::seg_engine_GPU::Mark_Active_Tiles(int band_width)
+{
+	const int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CUDA);
+	int* tile_ptr = active_tile_map->GetData(MEMORYDEVICE_CUDA);
+
+	Vector2i img_size = idx_img->noDims;
+	Vector2i tile_map_size = active_tile_map->noDims;
+
+	ORcudaSafeCall(cudaMemset(tile_ptr, 0, active_tile_map->dataSize * sizeof(int)));
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
+
+	Mark_Active_Tiles_device << <gridSize, blockSize >> >(idx_ptr, tile_ptr, img_size, content_size, tile_map_size, band_width);
+}
+
+void gSLICr::engines::seg_engine_GPU::Find_First_Label_Positions()
+{
+	const int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CUDA);
+	int* first_pos_ptr = label_first_pos->GetData(MEMORYDEVICE_CUDA);
+	Vector2i img_size = idx_img->noDims;
+
+	ORcudaSafeCall(cudaMemset(first_pos_ptr, NO_LABEL_POSITION & 0xff, label_first_pos->dataSize * sizeof(int)));
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
+
+	Find_First_Label_Positions_device << <gridSize, blockSize >> >(idx_ptr, first_pos_ptr, img_size, (int)label_first_pos->dataSize);
+}
+
+void gSLICr::engines::seg_engine_GPU::Remap_Labels()
+{
+	int* idx_ptr = idx_img->GetData(MEMORYDEVICE_CUDA);
+	const int* remap_ptr = label_remap->GetData(MEMORYDEVICE_CUDA);
+	Vector2i img_size = idx_img->noDims;
+
+	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
+	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
+
+	Remap_Labels_device << <gridSize, blockSize >> >(idx_ptr, remap_ptr, img_size);
 }
 
 void gSLICr::engines::seg_engine_GPU::Draw_Segmentation_Result(UChar4Image* out_img)
@@ -179,7 +392,7 @@ void gSLICr::engines::seg_engine_GPU::Draw_Segmentation_Result(UChar4Image* out_
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
 	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
 
-	Draw_Segmentation_Result_device<<<gridSize,blockSize>>>(idx_img_ptr, inimg_ptr, outimg_ptr, img_size);
+	Draw_Segmentation_Result_device<<<gridSize,blockSize>>>(idx_img_ptr, inimg_ptr, outimg_ptr, img_size, content_size);
 	out_img->UpdateHostFromDevice();
 }
 
@@ -194,7 +407,7 @@ void gSLICr::engines::seg_engine_GPU::Draw_Boundary_Only(UChar4Image* out_img)
 	dim3 blockSize(BLOCK_DIM, BLOCK_DIM);
 	dim3 gridSize((int)ceil((float)img_size.x / (float)blockSize.x), (int)ceil((float)img_size.y / (float)blockSize.y));
 
-	Draw_Boundary_Only_device<<<gridSize,blockSize>>>(idx_img_ptr, inimg_ptr, outimg_ptr, img_size);
+	Draw_Boundary_Only_device<<<gridSize,blockSize>>>(idx_img_ptr, inimg_ptr, outimg_ptr, img_size, content_size);
 	out_img->UpdateHostFromDevice();
 }
 
@@ -206,49 +419,118 @@ void gSLICr::engines::seg_engine_GPU::Draw_Boundary_Only(UChar4Image* out_img)
 //
 // ----------------------------------------------------
 
-__global__ void Cvt_Img_Space_device(const Vector4u* inimg, Vector4f* outimg, Vector2i img_size, COLOR_SPACE color_space)
+template <COLOR_SPACE color_space>
+__global__ void Cvt_Img_Space_device(const Vector4u* inimg, Vector4f* outimg, Vector2i img_size)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
 	if (x > img_size.x - 1 || y > img_size.y - 1) return;
 
-	cvt_img_space_shared(inimg, outimg, img_size, x, y, color_space);
+	cvt_img_space_shared<color_space>(inimg, outimg, img_size, x, y);
 
 }
 
-__global__ void Draw_Segmentation_Result_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size)
+__global__ void Draw_Segmentation_Result_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size, Vector2i content_size)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
-	if (x == 0 || y == 0 || x > img_size.x - 2 || y > img_size.y - 2) return;
+	if (x > content_size.x - 1 || y > content_size.y - 1) return;
+
+	// the content frame has no neighbours to compare, but outimg may be a recycled buffer
+	if (x == 0 || y == 0 || x == content_size.x - 1 || y == content_size.y - 1)
+	{
+		int idx = y * img_size.x + x;
+		outimg[idx] = sourceimg[idx];
+		return;
+	}
 
 	draw_superpixel_boundry_shared(idx_img, sourceimg, outimg, img_size, x, y);
 }
 
-__global__ void Draw_Boundary_Only_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size)
+__global__ void Draw_Boundary_Only_device(const int* idx_img, Vector4u* sourceimg, Vector4u* outimg, Vector2i img_size, Vector2i content_size)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
-	if (x == 0 || y == 0 || x > img_size.x - 2 || y > img_size.y - 2) return;
+	if (x > content_size.x - 1 || y > content_size.y - 1) return;
+
+	// the content frame has no neighbours to compare, but outimg may be a recycled buffer
+	if (x == 0 || y == 0 || x == content_size.x - 1 || y == content_size.y - 1)
+	{
+		int idx = y * img_size.x + x;
+		outimg[idx] = Vector4u(0,0,0,0);
+		return;
+	}
 
 	draw_boundary_only_shared(idx_img, sourceimg, outimg, img_size, x, y);
 }
 
-__global__ void Init_Cluster_Centers_device(const Vector4f* inimg, spixel_info* out_spixel, Vector2i map_size, Vector2i img_size, int spixel_size)
+__global__ void Init_Cluster_Centers_device(const Vector4f* inimg, spixel_info* out_spixel, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, bool low_gradient_init)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
 	if (x > map_size.x - 1 || y > map_size.y - 1) return;
 
-	init_cluster_centers_shared(inimg, out_spixel, map_size, img_size, spixel_size, x, y);
+	init_cluster_centers_shared(inimg, out_spixel, map_size, img_size, content_size, spixel_size, low_gradient_init, x, y);
 }
 
-__global__ void Find_Center_Association_device(const Vector4f* inimg, const spixel_info* in_spixel_map, int* out_idx_img, Vector2i map_size, Vector2i img_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist)
+__global__ void Init_Cluster_Centers_From_Source_device(const Vector4u* sourceimg, spixel_info* out_spixel, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, COLOR_SPACE color_space, bool low_gradient_init)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
-	if (x > img_size.x - 1 || y > img_size.y - 1) return;
+	if (x > map_size.x - 1 || y > map_size.y - 1) return;
+
+	init_cluster_centers_from_source_shared(sourceimg, out_spixel, map_size, img_size, content_size, spixel_size, color_space, low_gradient_init, x, y);
+}
+
+template <COLOR_SPACE color_space, SPIXEL_SIZE_BUCKET spixel_bucket>
+__global__ void Cvt_And_Find_Center_Association_device(const Vector4u* sourceimg, Vector4f* outimg, const spixel_info* in_spixel_map, int* out_idx_img, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist)
+{
+	// the padded border keeps its -1 labels
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > content_size.x - 1 || y > content_size.y - 1) return;
+
+	cvt_and_find_center_association_shared<color_space, spixel_bucket>(sourceimg, outimg, in_spixel_map, out_idx_img, map_size, img_size, spixel_size, weight, x, y, max_xy_dist, max_color_dist);
+}
 
-	find_center_association_shared(inimg, in_spixel_map, out_idx_img, map_size, img_size, spixel_size, weight, x, y,max_xy_dist,max_color_dist);
+template <SPIXEL_SIZE_BUCKET spixel_bucket>
+__global__ void Find_Center_Association_device(const Vector4f* inimg, const spixel_info* in_spixel_map, int* out_idx_img, const int* active_tile_map, spixel_info* cluster_sums, Vector2i map_size, Vector2i img_size, Vector2i content_size, int spixel_size, float weight, float max_xy_dist, float max_color_dist)
+{
+	// a block is exactly one tile, so inactive tiles are skipped as a whole
+	if (active_tile_map != NULL && active_tile_map[blockIdx.y * gridDim.x + blockIdx.x] == 0) return;
+
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > content_size.x - 1 || y > content_size.y - 1) return;
+
+	int idx = y * img_size.x + x;
+	int old_label = out_idx_img[idx];
+
+	find_center_association_shared<spixel_bucket>(inimg, in_spixel_map, out_idx_img, map_size, img_size, spixel_size, weight, x, y,max_xy_dist,max_color_dist);
+
+	// move the pixel between the running sums of its old and new cluster,
+	// float atomics add in scheduling order so band mode is not bit-reproducible
+	int new_label = out_idx_img[idx];
+	if (cluster_sums != NULL && new_label != old_label)
+	{
+		Vector4f pix = inimg[idx];
+
+		atomicAdd(&cluster_sums[new_label].center.x, (float)x);
+		atomicAdd(&cluster_sums[new_label].center.y, (float)y);
+		atomicAdd(&cluster_sums[new_label].color_info.x, pix.x);
+		atomicAdd(&cluster_sums[new_label].color_info.y, pix.y);
+		atomicAdd(&cluster_sums[new_label].color_info.z, pix.z);
+		atomicAdd(&cluster_sums[new_label].no_pixels, 1);
+
+		atomicAdd(&cluster_sums[old_label].center.x, -(float)x);
+		atomicAdd(&cluster_sums[old_label].center.y, -(float)y);
+		atomicAdd(&cluster_sums[old_label].color_info.x, -pix.x);
+		atomicAdd(&cluster_sums[old_label].color_info.y, -pix.y);
+		atomicAdd(&cluster_sums[old_label].color_info.z, -pix.z);
+		atomicAdd(&cluster_sums[old_label].no_pixels, -1);
+	}
 }
 
+template <SPIXEL_SIZE_BUCKET spixel_bucket>
 __global__ void Update_Cluster_Center_device(const Vector4f* inimg, const int* in_idx_img, spixel_info* accum_map, Vector2i map_size, Vector2i img_size, int spixel_size, int no_blocks_per_line)
 {
+	// compile time window geometry for the specialized sizes
+	const int cell_size = spixel_bucket == SPIXEL_SIZE_ANY ? spixel_size : (int)spixel_bucket;
+	const int blocks_per_line = spixel_bucket == SPIXEL_SIZE_ANY ? no_blocks_per_line : (3 * (int)spixel_bucket + BLOCK_DIM - 1) / BLOCK_DIM;
+
 	int local_id = threadIdx.y * blockDim.x + threadIdx.x;
 
 	__shared__ Vector4f color_shared[BLOCK_DIM*BLOCK_DIM];
@@ -267,17 +549,17 @@ __global__ void Update_Cluster_Center_device(const Vector4f* inimg, const int* i
 	int spixel_id = blockIdx.y * map_size.x + blockIdx.x;
 
 	// compute the relative position in the search window
-	int block_x = blockIdx.z % no_blocks_per_line;
-	int block_y = blockIdx.z / no_blocks_per_line;
+	int block_x = blockIdx.z % blocks_per_line;
+	int block_y = blockIdx.z / blocks_per_line;
 
 	int x_offset = block_x * BLOCK_DIM + threadIdx.x;
 	int y_offset = block_y * BLOCK_DIM + threadIdx.y;
 
-	if (x_offset < spixel_size * 3 && y_offset < spixel_size * 3)
+	if (x_offset < cell_size * 3 && y_offset < cell_size * 3)
 	{
 		// compute the start of the search window
-		int x_start = blockIdx.x * spixel_size - spixel_size;	
-		int y_start = blockIdx.y * spixel_size - spixel_size;
+		int x_start = blockIdx.x * cell_size - cell_size;	
+		int y_start = blockIdx.y * cell_size - cell_size;
 
 		int x_img = x_start + x_offset;
 		int y_img = y_start + y_offset;
@@ -351,19 +633,79 @@ __global__ void Update_Cluster_Center_device(const Vector4f* inimg, const int* i
 
 }
 
-__global__ void Finalize_Reduction_Result_device(const spixel_info* accum_map, spixel_info* spixel_list, Vector2i map_size, int no_blocks_per_spixel)
+__global__ void Finalize_Reduction_Result_device(const spixel_info* accum_map, spixel_info* spixel_list, Vector2i map_size, int no_blocks_per_spixel, bool do_normalize)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > map_size.x - 1 || y > map_size.y - 1) return;
+
+	finalize_reduction_result_shared(accum_map, spixel_list, map_size, no_blocks_per_spixel, do_normalize, x, y);
+}
+
+__global__ void Normalize_Cluster_Sums_device(const spixel_info* cluster_sums, spixel_info* spixel_list, Vector2i map_size)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
 	if (x > map_size.x - 1 || y > map_size.y - 1) return;
 
-	finalize_reduction_result_shared(accum_map, spixel_list, map_size, no_blocks_per_spixel, x, y);
+	normalize_cluster_sums_shared(cluster_sums, spixel_list, map_size, x, y);
+}
+
+__global__ void Downsample_Img_device(const Vector4f* inimg, Vector4f* outimg, Vector2i in_size, Vector2i in_content, Vector2i out_size, Vector2i out_content, int factor)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > out_content.x - 1 || y > out_content.y - 1) return;
+
+	downsample_img_shared(inimg, outimg, in_size, in_content, out_size, factor, x, y);
+}
+
+__global__ void Upsample_Labels_device(const int* in_idx_img, int* out_idx_img, Vector2i in_size, Vector2i in_content, Vector2i out_size, Vector2i out_content, int factor)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > out_size.x - 1 || y > out_size.y - 1) return;
+
+	upsample_labels_shared(in_idx_img, out_idx_img, in_size, in_content, out_size, out_content, factor, x, y);
+}
+
+__global__ void Mark_Active_Tiles_device(const int* idx_img, int* tile_map, Vector2i img_size, Vector2i content_size, Vector2i tile_map_size, int band_width)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > content_size.x - 1 || y > content_size.y - 1) return;
+
+	mark_active_tiles_shared(idx_img, tile_map, img_size, content_size, tile_map_size, BLOCK_DIM, band_width, x, y);
+}
+
+__global__ void Mask_Border_device(int* idx_img, Vector2i img_size, Vector2i content_size)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > img_size.x - 1 || y > img_size.y - 1) return;
+
+	if (x >= content_size.x || y >= content_size.y) idx_img[y * img_size.x + x] = -1;
 }
 
-__global__ void Enforce_Connectivity_device(const int* in_idx_img, int* out_idx_img, Vector2i img_size)
+__global__ void Find_First_Label_Positions_device(const int* idx_img, int* first_pos, Vector2i img_size, int no_spixels)
 {
 	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
 	if (x > img_size.x - 1 || y > img_size.y - 1) return;
 
-	supress_local_lable(in_idx_img, out_idx_img, img_size, x, y);
+	// one atomic per run of equal labels rather than per pixel
+	if (!is_label_run_start_shared(idx_img, img_size, x, y)) return;
+
+	int label = idx_img[y * img_size.x + x];
+	if (label >= 0 && label < no_spixels) atomicMin(&first_pos[label], y * img_size.x + x);
+}
+
+__global__ void Remap_Labels_device(int* idx_img, const int* label_remap, Vector2i img_size)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > img_size.x - 1 || y > img_size.y - 1) return;
+
+	remap_label_shared(idx_img, label_remap, img_size, x, y);
+}
+
+__global__ void Enforce_Connectivity_device(const int* in_idx_img, int* out_idx_img, Vector2i img_size, Vector2i content_size)
+{
+	int x = threadIdx.x + blockIdx.x * blockDim.x, y = threadIdx.y + blockIdx.y * blockDim.y;
+	if (x > content_size.x - 1 || y > content_size.y - 1) return;
+
+	supress_local_lable(in_idx_img, out_idx_img, img_size, content_size, x, y);
 }
 
@@ -7,20 +7,42 @@ namespace gSLICr
 {
 	namespace engines
 	{
+		// Runs every step on the device. Cluster sums are reduced per superpixel
+		// in a fixed order, except in band mode: the running sums that boundary
+		// pixels move between are updated with float atomicAdd, whose order
+		// depends on the scheduling, so after band_after_iters the centers and
+		// labels are not bit-reproducible between runs (nor equal to the CPU
+		// engine, which merges its band sums in a fixed order).
 		class seg_engine_GPU : public seg_engine
 		{
 		private:
 
 			int no_grid_per_center;
 			ORUtils::Image<objects::spixel_info>* accum_map;
+			SpixelMap* cluster_sums;
 			IntImage* tmp_idx_img;
 
+			// sums of the pixels associated to each cluster, written to out_map
+			void Reduce_Cluster_Info(SpixelMap* out_map, bool do_normalize);
+
 		protected:
 			void Cvt_Img_Space(UChar4Image* inimg, Float4Image* outimg, COLOR_SPACE color_space);
 			void Init_Cluster_Centers();
 			void Find_Center_Association();
 			void Update_Cluster_Center();
 			void Enforce_Connectivity();
+			void Init_Cluster_Centers_From_Source(COLOR_SPACE color_space);
+			void Cvt_And_Find_Center_Association(COLOR_SPACE color_space);
+
+			void Downsample_Img(const Float4Image* inimg, Float4Image* outimg, int factor);
+			void Upsample_Labels(const IntImage* inimg, IntImage* outimg, int factor);
+			void Mark_Active_Tiles(int band_width);
+			void Accumulate_Cluster_Sums();
+			void Normalize_Cluster_Sums();
+			void Find_First_Label_Positions();
+			void Remap_Labels();
+			void Reshape_Engine_Buffers(Vector2i map_size);
+			void Fit_Content();
 
 		public:
 
@@ -29,6 +51,8 @@ namespace gSLICr
 
 			void Draw_Segmentation_Result(UChar4Image* out_img);
 			void Draw_Boundary_Only(UChar4Image* out_img);
+
+			const char* Get_Backend_Name() const { return "GPU (cuda)"; }
 		};
 	}
 }
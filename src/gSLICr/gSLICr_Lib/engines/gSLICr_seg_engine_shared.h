@@ -50,46 +50,184 @@ _CPU_AND_GPU_CODE_ inline void rgb2CIELab(const gSLICr::Vector4u& pix_in, gSLICr
 	pix_out.z = 200.0f*(fy - fz);
 }
 
-_CPU_AND_GPU_CODE_ inline void cvt_img_space_shared(const gSLICr::Vector4u* inimg, gSLICr::Vector4f* outimg, const gSLICr::Vector2i& img_size, int x, int y, const gSLICr::COLOR_SPACE& color_space)
+// color_space is a compile time constant, only one of the branches is kept
+template <gSLICr::COLOR_SPACE color_space>
+_CPU_AND_GPU_CODE_ inline void cvt_pixel_shared(const gSLICr::Vector4u& pix_in, gSLICr::Vector4f& pix_out)
+{
+	if (color_space == gSLICr::RGB)
+	{
+		pix_out.x = pix_in.x;
+		pix_out.y = pix_in.y;
+		pix_out.z = pix_in.z;
+	}
+	else if (color_space == gSLICr::XYZ)
+	{
+		rgb2xyz(pix_in, pix_out);
+	}
+	else
+	{
+		rgb2CIELab(pix_in, pix_out);
+	}
+}
+
+template <gSLICr::COLOR_SPACE color_space>
+_CPU_AND_GPU_CODE_ inline void cvt_img_space_shared(const gSLICr::Vector4u* inimg, gSLICr::Vector4f* outimg, const gSLICr::Vector2i& img_size, int x, int y)
 {
 	int idx = y * img_size.x + x;
+	cvt_pixel_shared<color_space>(inimg[idx], outimg[idx]);
+}
 
+_CPU_AND_GPU_CODE_ inline void cvt_pixel_shared(const gSLICr::Vector4u& pix_in, gSLICr::Vector4f& pix_out, const gSLICr::COLOR_SPACE& color_space)
+{
 	switch (color_space)
 	{
 	case gSLICr::RGB:
-		outimg[idx].x = inimg[idx].x;
-		outimg[idx].y = inimg[idx].y;
-		outimg[idx].z = inimg[idx].z;
+		cvt_pixel_shared<gSLICr::RGB>(pix_in, pix_out);
 		break;
 	case gSLICr::XYZ:
-		rgb2xyz(inimg[idx], outimg[idx]);
+		cvt_pixel_shared<gSLICr::XYZ>(pix_in, pix_out);
 		break;
 	case gSLICr::CIELAB:
-		rgb2CIELab(inimg[idx], outimg[idx]);
+		cvt_pixel_shared<gSLICr::CIELAB>(pix_in, pix_out);
 		break;
 	}
 }
 
-_CPU_AND_GPU_CODE_ inline void init_cluster_centers_shared(const gSLICr::Vector4f* inimg, gSLICr::objects::spixel_info* out_spixel, gSLICr::Vector2i map_size, gSLICr::Vector2i img_size, int spixel_size, int x, int y)
+_CPU_AND_GPU_CODE_ inline void cvt_img_space_shared(const gSLICr::Vector4u* inimg, gSLICr::Vector4f* outimg, const gSLICr::Vector2i& img_size, int x, int y, const gSLICr::COLOR_SPACE& color_space)
 {
-	int cluster_idx = y * map_size.x + x;
+	int idx = y * img_size.x + x;
+	cvt_pixel_shared(inimg[idx], outimg[idx], color_space);
+}
 
+// image position of the center of grid cell (x, y)
+_CPU_AND_GPU_CODE_ inline gSLICr::Vector2i grid_center_position_shared(gSLICr::Vector2i img_size, int spixel_size, int x, int y)
+{
 	int img_x = x * spixel_size + spixel_size / 2;
 	int img_y = y * spixel_size + spixel_size / 2;
 
 	img_x = img_x >= img_size.x ? (x * spixel_size + img_size.x) / 2 : img_x;
 	img_y = img_y >= img_size.y ? (y * spixel_size + img_size.y) / 2 : img_y;
 
-	// TODO: go one step towards gradients direction
+	return gSLICr::Vector2i(img_x, img_y);
+}
+
+// the 5x5 patch around img_pos covers the central differences of its 3x3 window
+#define GRADIENT_PATCH_DIM 5
+
+_CPU_AND_GPU_CODE_ inline int clamp_coordinate_shared(int v, int size)
+{
+	return v < 0 ? 0 : (v > size - 1 ? size - 1 : v);
+}
+
+_CPU_AND_GPU_CODE_ inline float sq_color_difference_shared(const gSLICr::Vector4f& a, const gSLICr::Vector4f& b)
+{
+	return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z);
+}
+
+// offset in the 3x3 window around img_pos to the pixel of lowest color
+// gradient, given the patch of colors around img_pos (clamped at the image
+// border). The center wins ties, then the first in raster order.
+_CPU_AND_GPU_CODE_ inline gSLICr::Vector2i lowest_gradient_offset_shared(const gSLICr::Vector4f* patch, gSLICr::Vector2i img_size, gSLICr::Vector2i img_pos)
+{
+	const int c = GRADIENT_PATCH_DIM / 2;
+
+	gSLICr::Vector2i best(0, 0);
+	float best_gradient = -1.0f;
+
+	for (int dy = -1; dy <= 1; dy++) for (int dx = -1; dx <= 1; dx++)
+	{
+		int px = img_pos.x + dx, py = img_pos.y + dy;
+		if (px < 0 || py < 0 || px >= img_size.x || py >= img_size.y) continue;
+
+		int i = (c + dy) * GRADIENT_PATCH_DIM + (c + dx);
+		float gradient = sq_color_difference_shared(patch[i + 1], patch[i - 1])
+					   + sq_color_difference_shared(patch[i + GRADIENT_PATCH_DIM], patch[i - GRADIENT_PATCH_DIM]);
+
+		if (best_gradient < 0.0f || gradient < best_gradient || (gradient == best_gradient && dx == 0 && dy == 0))
+		{
+			best_gradient = gradient;
+			best = gSLICr::Vector2i(dx, dy);
+		}
+	}
+
+	return best;
+}
+
+// cells of a padded border (past content_size) hold no pixels, their id of
+// -1 keeps them out of every association
+_CPU_AND_GPU_CODE_ inline bool init_border_cluster_shared(gSLICr::objects::spixel_info* out_spixel, gSLICr::Vector2i map_size, gSLICr::Vector2i content_size, int spixel_size, int x, int y)
+{
+	if (x * spixel_size < content_size.x && y * spixel_size < content_size.y) return false;
+
+	int cluster_idx = y * map_size.x + x;
+	out_spixel[cluster_idx].id = -1;
+	out_spixel[cluster_idx].center = gSLICr::Vector2f((float)(x * spixel_size), (float)(y * spixel_size));
+	out_spixel[cluster_idx].color_info = gSLICr::Vector4f(0, 0, 0, 0);
+	out_spixel[cluster_idx].no_pixels = 0;
+	return true;
+}
+
+// the image rows are img_size.x pixels apart, only its top-left content_size part holds pixels
+_CPU_AND_GPU_CODE_ inline void init_cluster_centers_shared(const gSLICr::Vector4f* inimg, gSLICr::objects::spixel_info* out_spixel, gSLICr::Vector2i map_size, gSLICr::Vector2i img_size, gSLICr::Vector2i content_size, int spixel_size, bool low_gradient_init, int x, int y)
+{
+	if (init_border_cluster_shared(out_spixel, map_size, content_size, spixel_size, x, y)) return;
+
+	int cluster_idx = y * map_size.x + x;
+
+	gSLICr::Vector2i img_pos = grid_center_position_shared(content_size, spixel_size, x, y);
+
+	// step away from edges and noise onto the flattest pixel nearby
+	if (low_gradient_init)
+	{
+		gSLICr::Vector4f patch[GRADIENT_PATCH_DIM * GRADIENT_PATCH_DIM];
+		for (int j = 0; j < GRADIENT_PATCH_DIM; j++) for (int i = 0; i < GRADIENT_PATCH_DIM; i++)
+		{
+			int px = clamp_coordinate_shared(img_pos.x + i - GRADIENT_PATCH_DIM / 2, content_size.x);
+			int py = clamp_coordinate_shared(img_pos.y + j - GRADIENT_PATCH_DIM / 2, content_size.y);
+			patch[j * GRADIENT_PATCH_DIM + i] = inimg[py * img_size.x + px];
+		}
+		img_pos += lowest_gradient_offset_shared(patch, content_size, img_pos);
+	}
 
 	out_spixel[cluster_idx].id = cluster_idx;
-	out_spixel[cluster_idx].center = gSLICr::Vector2f((float)img_x, (float)img_y);
-	out_spixel[cluster_idx].color_info = inimg[img_y*img_size.x + img_x];
+	out_spixel[cluster_idx].center = gSLICr::Vector2f((float)img_pos.x, (float)img_pos.y);
+	out_spixel[cluster_idx].color_info = inimg[img_pos.y*img_size.x + img_pos.x];
 	
 	out_spixel[cluster_idx].no_pixels = 0;
 }
 
-_CPU_AND_GPU_CODE_ inline float compute_slic_distance(const gSLICr::Vector4f& pix, int x, int y, const gSLICr::objects::spixel_info& center_info, float weight, float normalizer_xy, float normalizer_color)
+// same centers as init_cluster_centers_shared, converting the source
+// pixels under them instead of reading the converted image
+_CPU_AND_GPU_CODE_ inline void init_cluster_centers_from_source_shared(const gSLICr::Vector4u* sourceimg, gSLICr::objects::spixel_info* out_spixel, gSLICr::Vector2i map_size, gSLICr::Vector2i img_size, gSLICr::Vector2i content_size, int spixel_size, const gSLICr::COLOR_SPACE& color_space, bool low_gradient_init, int x, int y)
+{
+	if (init_border_cluster_shared(out_spixel, map_size, content_size, spixel_size, x, y)) return;
+
+	int cluster_idx = y * map_size.x + x;
+
+	gSLICr::Vector2i img_pos = grid_center_position_shared(content_size, spixel_size, x, y);
+
+	// the patch is converted on the fly, cvt_img is not written yet
+	if (low_gradient_init)
+	{
+		gSLICr::Vector4f patch[GRADIENT_PATCH_DIM * GRADIENT_PATCH_DIM];
+		for (int j = 0; j < GRADIENT_PATCH_DIM; j++) for (int i = 0; i < GRADIENT_PATCH_DIM; i++)
+		{
+			int px = clamp_coordinate_shared(img_pos.x + i - GRADIENT_PATCH_DIM / 2, content_size.x);
+			int py = clamp_coordinate_shared(img_pos.y + j - GRADIENT_PATCH_DIM / 2, content_size.y);
+			cvt_pixel_shared(sourceimg[py * img_size.x + px], patch[j * GRADIENT_PATCH_DIM + i], color_space);
+		}
+		img_pos += lowest_gradient_offset_shared(patch, content_size, img_pos);
+	}
+
+	out_spixel[cluster_idx].id = cluster_idx;
+	out_spixel[cluster_idx].center = gSLICr::Vector2f((float)img_pos.x, (float)img_pos.y);
+	cvt_pixel_shared(sourceimg[img_pos.y*img_size.x + img_pos.x], out_spixel[cluster_idx].color_info, color_space);
+
+	out_spixel[cluster_idx].no_pixels = 0;
+}
+
+// squared distance, enough to compare candidates since sqrt is monotonic
+_CPU_AND_GPU_CODE_ inline float compute_slic_sq_distance(const gSLICr::Vector4f& pix, int x, int y, const gSLICr::objects::spixel_info& center_info, float weight, float normalizer_xy, float normalizer_color)
 {
 	float dcolor = (pix.x - center_info.color_info.x)*(pix.x - center_info.color_info.x)
 				 + (pix.y - center_info.color_info.y)*(pix.y - center_info.color_info.y)
@@ -99,16 +237,25 @@ _CPU_AND_GPU_CODE_ inline float compute_slic_distance(const gSLICr::Vector4f& pi
 			  + (y - center_info.center.y) * (y - center_info.center.y);
 
 
-	float retval = dcolor * normalizer_color + weight * dxy * normalizer_xy;
-	return sqrtf(retval);
+	return dcolor * normalizer_color + weight * dxy * normalizer_xy;
 }
 
-_CPU_AND_GPU_CODE_ inline void find_center_association_shared(const gSLICr::Vector4f* inimg, const gSLICr::objects::spixel_info* in_spixel_map, int* out_idx_img, gSLICr::Vector2i map_size, gSLICr::Vector2i img_size, int spixel_size, float weight, int x, int y, float max_xy_dist, float max_color_dist)
+_CPU_AND_GPU_CODE_ inline float compute_slic_distance(const gSLICr::Vector4f& pix, int x, int y, const gSLICr::objects::spixel_info& center_info, float weight, float normalizer_xy, float normalizer_color)
 {
-	int idx_img = y * img_size.x + x;
+	return sqrtf(compute_slic_sq_distance(pix, x, y, center_info, weight, normalizer_xy, normalizer_color));
+}
+
+// id of the closest of the 3x3 centers around pixel (x, y), -1 if there is none
+// (cells of a padded border are skipped).
+// spixel_size is only read for SPIXEL_SIZE_ANY, the other buckets divide by a
+// compile time constant.
+template <gSLICr::SPIXEL_SIZE_BUCKET spixel_bucket>
+_CPU_AND_GPU_CODE_ inline int find_closest_center_shared(const gSLICr::Vector4f& pix, const gSLICr::objects::spixel_info* in_spixel_map, gSLICr::Vector2i map_size, int spixel_size, float weight, int x, int y, float max_xy_dist, float max_color_dist)
+{
+	const int cell_size = spixel_bucket == gSLICr::SPIXEL_SIZE_ANY ? spixel_size : (int)spixel_bucket;
 
-	int ctr_x = x / spixel_size;
-	int ctr_y = y / spixel_size;
+	int ctr_x = x / cell_size;
+	int ctr_y = y / cell_size;
 
 	int minidx = -1;
 	float dist = 999999.9999f;
@@ -121,7 +268,9 @@ _CPU_AND_GPU_CODE_ inline void find_center_association_shared(const gSLICr::Vect
 		if (ctr_x_check >= 0 && ctr_y_check >= 0 && ctr_x_check < map_size.x && ctr_y_check < map_size.y)
 		{
 			int ctr_idx = ctr_y_check*map_size.x + ctr_x_check;
-			float cdist = compute_slic_distance(inimg[idx_img], x, y, in_spixel_map[ctr_idx], weight, max_xy_dist, max_color_dist);
+			if (in_spixel_map[ctr_idx].id < 0) continue;
+
+			float cdist = compute_slic_distance(pix, x, y, in_spixel_map[ctr_idx], weight, max_xy_dist, max_color_dist);
 			if (cdist < dist)
 			{
 				dist = cdist;
@@ -130,6 +279,31 @@ _CPU_AND_GPU_CODE_ inline void find_center_association_shared(const gSLICr::Vect
 		}
 	}
 
+	return minidx;
+}
+
+template <gSLICr::SPIXEL_SIZE_BUCKET spixel_bucket>
+_CPU_AND_GPU_CODE_ inline void find_center_association_shared(const gSLICr::Vector4f* inimg, const gSLICr::objects::spixel_info* in_spixel_map, int* out_idx_img, gSLICr::Vector2i map_size, gSLICr::Vector2i img_size, int spixel_size, float weight, int x, int y, float max_xy_dist, float max_color_dist)
+{
+	int idx_img = y * img_size.x + x;
+
+	int minidx = find_closest_center_shared<spixel_bucket>(inimg[idx_img], in_spixel_map, map_size, spixel_size, weight, x, y, max_xy_dist, max_color_dist);
+	if (minidx >= 0) out_idx_img[idx_img] = minidx;
+}
+
+// converts pixel (x, y) into outimg and associates it in the same pass,
+// without reading the converted pixel back
+template <gSLICr::COLOR_SPACE color_space, gSLICr::SPIXEL_SIZE_BUCKET spixel_bucket>
+_CPU_AND_GPU_CODE_ inline void cvt_and_find_center_association_shared(const gSLICr::Vector4u* sourceimg, gSLICr::Vector4f* outimg, const gSLICr::objects::spixel_info* in_spixel_map, int* out_idx_img, gSLICr::Vector2i map_size, gSLICr::Vector2i img_size, int spixel_size, float weight, int x, int y, float max_xy_dist, float max_color_dist)
+{
+	int idx_img = y * img_size.x + x;
+
+	gSLICr::Vector4f pix;
+	cvt_pixel_shared<color_space>(sourceimg[idx_img], pix);
+	pix.w = 0;
+	outimg[idx_img] = pix;
+
+	int minidx = find_closest_center_shared<spixel_bucket>(pix, in_spixel_map, map_size, spixel_size, weight, x, y, max_xy_dist, max_color_dist);
 	if (minidx >= 0) out_idx_img[idx_img] = minidx;
 }
 
@@ -167,7 +341,7 @@ _CPU_AND_GPU_CODE_ inline void draw_boundary_only_shared(const int* idx_img, gSL
 	}
 }
 
-_CPU_AND_GPU_CODE_ inline void finalize_reduction_result_shared(const gSLICr::objects::spixel_info* accum_map, gSLICr::objects::spixel_info* spixel_list, gSLICr::Vector2i map_size, int no_blocks_per_spixel, int x, int y)
+_CPU_AND_GPU_CODE_ inline void finalize_reduction_result_shared(const gSLICr::objects::spixel_info* accum_map, gSLICr::objects::spixel_info* spixel_list, gSLICr::Vector2i map_size, int no_blocks_per_spixel, bool do_normalize, int x, int y)
 {
 	int spixel_idx = y * map_size.x + x;
 
@@ -184,19 +358,106 @@ _CPU_AND_GPU_CODE_ inline void finalize_reduction_result_shared(const gSLICr::ob
 		spixel_list[spixel_idx].no_pixels += accum_map[accum_list_idx].no_pixels;
 	}
 
-	if (spixel_list[spixel_idx].no_pixels != 0)
+	if (do_normalize && spixel_list[spixel_idx].no_pixels != 0)
 	{
 		spixel_list[spixel_idx].center /= (float)spixel_list[spixel_idx].no_pixels;
 		spixel_list[spixel_idx].color_info /= (float)spixel_list[spixel_idx].no_pixels;
 	}
 }
 
-_CPU_AND_GPU_CODE_ inline void supress_local_lable(const int* in_idx_img, int* out_idx_img, gSLICr::Vector2i img_size, int x, int y)
+_CPU_AND_GPU_CODE_ inline void normalize_cluster_sums_shared(const gSLICr::objects::spixel_info* cluster_sums, gSLICr::objects::spixel_info* spixel_list, gSLICr::Vector2i map_size, int x, int y)
+{
+	int spixel_idx = y * map_size.x + x;
+
+	spixel_list[spixel_idx].center = cluster_sums[spixel_idx].center;
+	spixel_list[spixel_idx].color_info = cluster_sums[spixel_idx].color_info;
+	spixel_list[spixel_idx].no_pixels = cluster_sums[spixel_idx].no_pixels;
+
+	if (spixel_list[spixel_idx].no_pixels > 0)
+	{
+		spixel_list[spixel_idx].center /= (float)spixel_list[spixel_idx].no_pixels;
+		spixel_list[spixel_idx].color_info /= (float)spixel_list[spixel_idx].no_pixels;
+	}
+}
+
+_CPU_AND_GPU_CODE_ inline void downsample_img_shared(const gSLICr::Vector4f* inimg, gSLICr::Vector4f* outimg, gSLICr::Vector2i in_size, gSLICr::Vector2i in_content, gSLICr::Vector2i out_size, int factor, int x, int y)
+{
+	// box filter, partial boxes at the right and bottom borders of the content average the pixels they have
+	gSLICr::Vector4f sum(0, 0, 0, 0);
+	int count = 0;
+
+	for (int j = y * factor; j < (y + 1) * factor && j < in_content.y; j++) for (int i = x * factor; i < (x + 1) * factor && i < in_content.x; i++)
+	{
+		sum += inimg[j * in_size.x + i];
+		count++;
+	}
+
+	sum /= (float)count;
+	outimg[y * out_size.x + x] = sum;
+}
+
+_CPU_AND_GPU_CODE_ inline void upsample_labels_shared(const int* in_idx_img, int* out_idx_img, gSLICr::Vector2i in_size, gSLICr::Vector2i in_content, gSLICr::Vector2i out_size, gSLICr::Vector2i out_content, int factor, int x, int y)
+{
+	// the padded border keeps no label
+	if (x >= out_content.x || y >= out_content.y)
+	{
+		out_idx_img[y * out_size.x + x] = -1;
+		return;
+	}
+
+	int in_x = x / factor < in_content.x - 1 ? x / factor : in_content.x - 1;
+	int in_y = y / factor < in_content.y - 1 ? y / factor : in_content.y - 1;
+
+	out_idx_img[y * out_size.x + x] = in_idx_img[in_y * in_size.x + in_x];
+}
+
+// the edge of the content is not a boundary, the padded border past it has no labels
+_CPU_AND_GPU_CODE_ inline bool is_label_boundary_shared(const int* idx_img, gSLICr::Vector2i img_size, gSLICr::Vector2i content_size, int x, int y)
+{
+	int idx = y * img_size.x + x;
+
+	return (x > 0 && idx_img[idx] != idx_img[idx - 1])
+		|| (x < content_size.x - 1 && idx_img[idx] != idx_img[idx + 1])
+		|| (y > 0 && idx_img[idx] != idx_img[idx - img_size.x])
+		|| (y < content_size.y - 1 && idx_img[idx] != idx_img[idx + img_size.x]);
+}
+
+_CPU_AND_GPU_CODE_ inline void mark_active_tiles_shared(const int* idx_img, int* tile_map, gSLICr::Vector2i img_size, gSLICr::Vector2i content_size, gSLICr::Vector2i tile_map_size, int tile_size, int band_width, int x, int y)
+{
+	if (!is_label_boundary_shared(idx_img, img_size, content_size, x, y)) return;
+
+	// every tile within band_width of a boundary pixel gets re-evaluated
+	int tile_x_start = (x - band_width) > 0 ? (x - band_width) / tile_size : 0;
+	int tile_y_start = (y - band_width) > 0 ? (y - band_width) / tile_size : 0;
+	int tile_x_end = (x + band_width) / tile_size < tile_map_size.x - 1 ? (x + band_width) / tile_size : tile_map_size.x - 1;
+	int tile_y_end = (y + band_width) / tile_size < tile_map_size.y - 1 ? (y + band_width) / tile_size : tile_map_size.y - 1;
+
+	for (int j = tile_y_start; j <= tile_y_end; j++) for (int i = tile_x_start; i <= tile_x_end; i++)
+	{
+		tile_map[j * tile_map_size.x + i] = 1;
+	}
+}
+
+// only the first pixel of a run of equal labels along a row can be the
+// first appearance of its label
+_CPU_AND_GPU_CODE_ inline bool is_label_run_start_shared(const int* idx_img, gSLICr::Vector2i img_size, int x, int y)
+{
+	int idx = y * img_size.x + x;
+	return x == 0 || idx_img[idx] != idx_img[idx - 1];
+}
+
+_CPU_AND_GPU_CODE_ inline void remap_label_shared(int* idx_img, const int* label_remap, gSLICr::Vector2i img_size, int x, int y)
+{
+	int idx = y * img_size.x + x;
+	if (idx_img[idx] >= 0) idx_img[idx] = label_remap[idx_img[idx]];
+}
+
+_CPU_AND_GPU_CODE_ inline void supress_local_lable(const int* in_idx_img, int* out_idx_img, gSLICr::Vector2i img_size, gSLICr::Vector2i content_size, int x, int y)
 {
 	int clable = in_idx_img[y*img_size.x + x];
 
-	// don't suppress boundary
-	if (x <= 1 || y <= 1 || x >= img_size.x - 2 || y >= img_size.y - 2)
+	// don't suppress boundary (of the content)
+	if (x <= 1 || y <= 1 || x >= content_size.x - 2 || y >= content_size.y - 2)
 	{ 
 		out_idx_img[y*img_size.x + x] = clable;
 		return; 
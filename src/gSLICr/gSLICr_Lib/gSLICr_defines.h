@@ -75,6 +75,16 @@ namespace gSLICr
 		RGB
 	} COLOR_SPACE;
 
+	// superpixel sizes the GPU kernels are specialized for at compile time,
+	// any other size runs the SPIXEL_SIZE_ANY kernels
+	typedef enum
+	{
+		SPIXEL_SIZE_ANY = 0,
+		SPIXEL_SIZE_8 = 8,
+		SPIXEL_SIZE_16 = 16,
+		SPIXEL_SIZE_32 = 32
+	} SPIXEL_SIZE_BUCKET;
+
 	typedef enum
 	{
 		GIVEN_NUM = 0,
@@ -82,6 +92,22 @@ namespace gSLICr
 
 	} SEG_METHOD;
 
+	typedef enum
+	{
+		DEVICE_GPU = 0,
+		DEVICE_CPU
+	} DEVICE_TYPE;
+
+	typedef enum
+	{
+		CPU_ISA_AUTO = 0,
+		CPU_ISA_SCALAR,
+		CPU_ISA_SSE42,
+		CPU_ISA_AVX2,
+		CPU_ISA_AVX512,
+		CPU_ISA_NEON
+	} CPU_ISA;
+
 
 }
 
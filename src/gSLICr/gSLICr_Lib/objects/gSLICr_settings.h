@@ -9,15 +9,41 @@ namespace gSLICr
 	{
 		struct settings
 		{
-			Vector2i img_size;
-			int no_segs;
-			int spixel_size;
-			int no_iters;
-			float coh_weight;			
-			bool do_enforce_connectivity;
+			Vector2i img_size = Vector2i(0, 0);
+			int no_segs = 2000;
+			int spixel_size = 16;
+			int no_iters = 5;
+			float coh_weight = 0.6f;
+			bool do_enforce_connectivity = true;
 
-			COLOR_SPACE color_space;
-			SEG_METHOD seg_method;
+			COLOR_SPACE color_space = XYZ;
+			SEG_METHOD seg_method = GIVEN_SIZE;
+
+			// where the segmentation runs, the CPU engine gives the same
+			// labels whatever the number of threads
+			DEVICE_TYPE device_type = DEVICE_GPU;
+			// instruction set of the CPU kernels, the best one the CPU
+			// supports when left to auto (GSLICR_FORCE_ISA overrides it)
+			CPU_ISA cpu_isa = CPU_ISA_AUTO;
+
+			// coarse-to-fine mode: number of 2x downsamplings the
+			// clustering starts from (0 disables it)
+			int pyramid_levels = 0;
+			// full resolution iterations after the coarse level
+			int refine_iters = 2;
+			// only pixels this close to a superpixel boundary are
+			// re-associated during refinement (0: automatic)
+			int band_width = 0;
+			// full iterations after which association is restricted
+			// to the boundary band (0 disables it), on the GPU the
+			// results then vary slightly from run to run
+			int band_after_iters = 0;
+			// move the initial centers to the lowest color gradient of
+			// their 3x3 neighborhood, off edges and noisy pixels
+			bool low_gradient_init = false;
+			// renumber the labels to 0..K-1 in raster order of first
+			// appearance, the label table maps them back to spixel_map
+			bool dense_labels = false;
 		};
 	}
 }
\ No newline at end of file
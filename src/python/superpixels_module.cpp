@@ -0,0 +1,567 @@
+// Python extension module over gSLICr::engines::core_engine
+//
+//   import superpixels
+//   engine = superpixels.Engine(spixel_size=16, device="CPU")
+//   labels, spixels = engine.process(image)	# HxWx3 uint8, RGB unless bgr=True
+//   centers = spixels["center"][labels]
+//   centers = spixels["center"][engine.label_table()[labels]]	# with dense_labels
+//
+// The image is read in place through its strides and packed straight into
+// the engine input, the results are read-only views of engine buffers.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "../gSLICr/gSLICr_Lib/gSLICr.h"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#if PY_MAJOR_VERSION >= 3
+#define STRING_AS_UTF8 PyUnicode_AsUTF8
+#else
+#define STRING_AS_UTF8 PyString_AsString
+#endif
+
+namespace
+{
+	// Everything but the Python object header, built and torn down with new/delete
+	struct EngineState
+	{
+		gSLICr::objects::settings settings;
+		std::unique_ptr<gSLICr::engines::core_engine> engine;
+		std::unique_ptr<gSLICr::UChar4Image> in_img;
+
+		// held while the engine runs or its buffers are handed out, never with the GIL
+		std::mutex mutex;
+
+		// live ViewsObjects, the engine buffers must not move while there are any
+		std::atomic<long> exports;
+
+		EngineState() : exports(0) {}
+	};
+
+	typedef struct
+	{
+		PyObject_HEAD
+		EngineState *state;
+	} EngineObject;
+
+	// Base object of the arrays viewing engine buffers, keeps the engine alive
+	typedef struct
+	{
+		PyObject_HEAD
+		EngineObject *engine;
+	} ViewsObject;
+
+	PyTypeObject EngineType;
+	PyTypeObject ViewsType;
+
+	// dtype of gSLICr::objects::spixel_info
+	PyArray_Descr *spixel_descr = NULL;
+
+	bool Get_Int(PyObject *value, int &out)
+	{
+		long v = PyLong_AsLong(value);
+		if (v == -1 && PyErr_Occurred()) return false;
+		out = (int)v;
+		return true;
+	}
+
+	bool Get_Count(PyObject *value, const char *name, int &out)
+	{
+		int v;
+		if (!Get_Int(value, v)) return false;
+		if (v < 0)
+		{
+			PyErr_Format(PyExc_ValueError, "%s cannot be negative", name);
+			return false;
+		}
+		out = v;
+		return true;
+	}
+
+	// Settings are named like the command line options
+	bool Apply_Setting(gSLICr::objects::settings &settings, const std::string &name, PyObject *value)
+	{
+		if (name == "num_segs") return Get_Int(value, settings.no_segs);
+		if (name == "spixel_size") return Get_Int(value, settings.spixel_size);
+		if (name == "num_iters") return Get_Int(value, settings.no_iters);
+		if (name == "pyramid_levels") return Get_Count(value, "pyramid_levels", settings.pyramid_levels);
+		if (name == "refine_iters") return Get_Count(value, "refine_iters", settings.refine_iters);
+		if (name == "band_width") return Get_Int(value, settings.band_width);
+		if (name == "band_after_iters") return Get_Int(value, settings.band_after_iters);
+
+		if (name == "coh_weight")
+		{
+			double v = PyFloat_AsDouble(value);
+			if (v == -1.0 && PyErr_Occurred()) return false;
+			settings.coh_weight = (float)v;
+			return true;
+		}
+
+		if (name == "enforce_connectivity" || name == "low_gradient_init" || name == "dense_labels")
+		{
+			int v = PyObject_IsTrue(value);
+			if (v < 0) return false;
+			if (name == "enforce_connectivity") settings.do_enforce_connectivity = v != 0;
+			else if (name == "low_gradient_init") settings.low_gradient_init = v != 0;
+			else settings.dense_labels = v != 0;
+			return true;
+		}
+
+		if (name == "color_space" || name == "seg_method" || name == "device" || name == "cpu_isa")
+		{
+			const char *v = STRING_AS_UTF8(value);
+			if (v == NULL) return false;
+			const std::string s(v);
+			if (name == "color_space")
+			{
+				if (s == "XYZ") settings.color_space = gSLICr::XYZ;
+				else if (s == "RGB") settings.color_space = gSLICr::RGB;
+				else if (s == "CIELAB") settings.color_space = gSLICr::CIELAB;
+				else
+				{
+					PyErr_Format(PyExc_ValueError, "color_space must be XYZ, RGB or CIELAB, not '%s'", v);
+					return false;
+				}
+			}
+			else if (name == "seg_method")
+			{
+				if (s == "GIVEN_SIZE") settings.seg_method = gSLICr::GIVEN_SIZE;
+				else if (s == "GIVEN_NUM") settings.seg_method = gSLICr::GIVEN_NUM;
+				else
+				{
+					PyErr_Format(PyExc_ValueError, "seg_method must be GIVEN_SIZE or GIVEN_NUM, not '%s'", v);
+					return false;
+				}
+			}
+			else if (name == "device")
+			{
+				if (s == "CPU") settings.device_type = gSLICr::DEVICE_CPU;
+				else if (s == "GPU") settings.device_type = gSLICr::DEVICE_GPU;
+				else
+				{
+					PyErr_Format(PyExc_ValueError, "device must be CPU or GPU, not '%s'", v);
+					return false;
+				}
+			}
+			else
+			{
+				settings.cpu_isa = gSLICr::engines::Parse_CPU_ISA(v);
+			}
+			return true;
+		}
+
+		PyErr_Format(PyExc_TypeError, "unknown setting '%s'", name.c_str());
+		return false;
+	}
+
+	bool Apply_Settings(gSLICr::objects::settings &settings, PyObject *kwargs)
+	{
+		if (kwargs == NULL) return true;
+
+		PyObject *key, *value;
+		Py_ssize_t pos = 0;
+		while (PyDict_Next(kwargs, &pos, &key, &value))
+		{
+			const char *name = STRING_AS_UTF8(key);
+			if (name == NULL || !Apply_Setting(settings, name, value)) return false;
+		}
+		return true;
+	}
+
+	// Whether going from one to the other may reallocate the engine buffers
+	bool Changes_Geometry(const gSLICr::objects::settings &a, const gSLICr::objects::settings &b)
+	{
+		return a.no_segs != b.no_segs || a.spixel_size != b.spixel_size || a.seg_method != b.seg_method
+			|| a.pyramid_levels != b.pyramid_levels || a.device_type != b.device_type || a.cpu_isa != b.cpu_isa;
+	}
+
+	ViewsObject* New_Views(EngineObject *engine)
+	{
+		ViewsObject *views = PyObject_New(ViewsObject, &ViewsType);
+		if (views == NULL) return NULL;
+		Py_INCREF(engine);
+		views->engine = engine;
+		engine->state->exports++;
+		return views;
+	}
+
+	void Views_Dealloc(ViewsObject *self)
+	{
+		self->engine->state->exports--;
+		Py_DECREF(self->engine);
+		PyObject_Del(self);
+	}
+
+	// Read-only array over engine memory, kept valid by views
+	PyObject* New_View(ViewsObject *views, PyArray_Descr *descr, int ndim, npy_intp *dims, const void *data)
+	{
+		PyObject *array = PyArray_NewFromDescr(&PyArray_Type, descr, ndim, dims, NULL, const_cast<void*>(data), NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED, NULL);
+		if (array == NULL) return NULL;
+
+		Py_INCREF(views);
+		if (PyArray_SetBaseObject((PyArrayObject*)array, (PyObject*)views) < 0)
+		{
+			Py_DECREF(array);
+			return NULL;
+		}
+		return array;
+	}
+
+	PyObject* Engine_New(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+	{
+		if (PyTuple_GET_SIZE(args) != 0)
+		{
+			PyErr_SetString(PyExc_TypeError, "Engine() only takes keyword settings");
+			return NULL;
+		}
+
+		// The gSLICr defaults, overridden by the keywords
+		std::unique_ptr<EngineState> state(new EngineState());
+		if (!Apply_Settings(state->settings, kwargs)) return NULL;
+
+		EngineObject *self = (EngineObject*)type->tp_alloc(type, 0);
+		if (self == NULL) return NULL;
+		self->state = state.release();
+		return (PyObject*)self;
+	}
+
+	void Engine_Dealloc(EngineObject *self)
+	{
+		delete self->state;
+		Py_TYPE(self)->tp_free((PyObject*)self);
+	}
+
+	// Pack an HxWx3 array, through its strides, into the engine input
+	void Pack_Image(const unsigned char *data, const npy_intp *strides, bool bgr, gSLICr::UChar4Image *out_img)
+	{
+		gSLICr::Vector4u *out_ptr = out_img->GetData(MEMORYDEVICE_CPU);
+		const npy_intp blue = bgr ? 0 : 2 * strides[2];
+		const npy_intp red = bgr ? 2 * strides[2] : 0;
+
+		for (int y = 0; y < out_img->noDims.y; y++)
+		{
+			const unsigned char *row = data + y * strides[0];
+			for (int x = 0; x < out_img->noDims.x; x++)
+			{
+				const unsigned char *pixel = row + x * strides[1];
+				gSLICr::Vector4u &out = out_ptr[x + y * out_img->noDims.x];
+				out.b = pixel[blue];
+				out.g = pixel[strides[2]];
+				out.r = pixel[red];
+			}
+		}
+	}
+
+	PyObject* Engine_Process(EngineObject *self, PyObject *args, PyObject *kwargs)
+	{
+		static const char *keywords[] = { "image", "bgr", NULL };
+		PyObject *image_obj;
+		int bgr = 0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i:process", const_cast<char**>(keywords), &image_obj, &bgr)) return NULL;
+
+		// No copy for uint8 arrays, whatever their strides
+		PyArrayObject *image = (PyArrayObject*)PyArray_FROM_OTF(image_obj, NPY_UINT8, NPY_ARRAY_ALIGNED);
+		if (image == NULL) return NULL;
+		if (PyArray_NDIM(image) != 3 || PyArray_DIM(image, 2) != 3 || PyArray_DIM(image, 0) <= 0 || PyArray_DIM(image, 1) <= 0)
+		{
+			Py_DECREF(image);
+			PyErr_SetString(PyExc_ValueError, "image must be a non-empty HxWx3 uint8 array");
+			return NULL;
+		}
+
+		EngineState &state = *self->state;
+		const gSLICr::Vector2i img_size((int)PyArray_DIM(image, 1), (int)PyArray_DIM(image, 0));
+		const unsigned char *data = (const unsigned char*)PyArray_DATA(image);
+		const npy_intp *strides = PyArray_STRIDES(image);
+
+		const gSLICr::IntImage *labels = NULL;
+		const gSLICr::SpixelMap *spixel_map = NULL;
+		std::string error;
+		bool views_alive = false;
+
+		PyThreadState *thread_state = PyEval_SaveThread();
+		std::unique_lock<std::mutex> lock(state.mutex);
+		try
+		{
+			if (state.engine && img_size != state.settings.img_size && state.exports > 0)
+			{
+				views_alive = true;
+			}
+			else
+			{
+				state.settings.img_size = img_size;
+				if (!state.engine)
+				{
+					state.engine.reset(new gSLICr::engines::core_engine(state.settings));
+					state.in_img.reset(new gSLICr::UChar4Image(img_size, true, state.settings.device_type == gSLICr::DEVICE_GPU));
+				}
+				else
+				{
+					state.engine->Reshape(img_size);
+					state.in_img->ChangeDims(img_size);
+				}
+
+				Pack_Image(data, strides, bgr != 0, state.in_img.get());
+				state.engine->Process_Frame(state.in_img.get());
+
+				labels = state.engine->Get_Seg_Res();
+				spixel_map = state.engine->Get_Spixel_Map();
+			}
+		}
+		catch (const std::exception &e)
+		{
+			error = e.what();
+		}
+		PyEval_RestoreThread(thread_state);
+		Py_DECREF(image);
+
+		// The buffers are handed out before another thread can take the engine
+		if (views_alive)
+		{
+			PyErr_SetString(PyExc_BufferError, "cannot change the image size while views of earlier results are alive");
+			return NULL;
+		}
+		if (labels == NULL)
+		{
+			PyErr_Format(PyExc_RuntimeError, "segmentation failed: %s", error.c_str());
+			return NULL;
+		}
+
+		ViewsObject *views = New_Views(self);
+		if (views == NULL) return NULL;
+
+		npy_intp label_dims[2] = { labels->noDims.y, labels->noDims.x };
+		npy_intp spixel_dims[1] = { (npy_intp)spixel_map->dataSize };
+		PyObject *label_array = New_View(views, PyArray_DescrFromType(NPY_INT32), 2, label_dims, labels->GetData(MEMORYDEVICE_CPU));
+		Py_INCREF(spixel_descr);
+		PyObject *spixel_array = label_array == NULL ? NULL : New_View(views, spixel_descr, 1, spixel_dims, spixel_map->GetData(MEMORYDEVICE_CPU));
+		Py_DECREF(views);
+
+		if (spixel_array == NULL)
+		{
+			Py_XDECREF(label_array);
+			return NULL;
+		}
+		return Py_BuildValue("(NN)", label_array, spixel_array);
+	}
+
+	PyObject* Engine_Label_Table(EngineObject *self, PyObject *)
+	{
+		EngineState &state = *self->state;
+
+		const gSLICr::IntImage *label_table = NULL;
+		int no_labels = 0;
+
+		PyThreadState *thread_state = PyEval_SaveThread();
+		std::unique_lock<std::mutex> lock(state.mutex);
+		if (state.engine)
+		{
+			label_table = state.engine->Get_Label_Table();
+			no_labels = state.engine->Get_No_Labels();
+		}
+		PyEval_RestoreThread(thread_state);
+
+		if (label_table == NULL) Py_RETURN_NONE;
+
+		ViewsObject *views = New_Views(self);
+		if (views == NULL) return NULL;
+
+		npy_intp dims[1] = { no_labels };
+		PyObject *array = New_View(views, PyArray_DescrFromType(NPY_INT32), 1, dims, label_table->GetData(MEMORYDEVICE_CPU));
+		Py_DECREF(views);
+		return array;
+	}
+
+	PyObject* Engine_Configure(EngineObject *self, PyObject *args, PyObject *kwargs)
+	{
+		if (PyTuple_GET_SIZE(args) != 0)
+		{
+			PyErr_SetString(PyExc_TypeError, "configure() only takes keyword settings");
+			return NULL;
+		}
+
+		EngineState &state = *self->state;
+		gSLICr::objects::settings settings = state.settings;
+		if (!Apply_Settings(settings, kwargs)) return NULL;
+
+		bool views_alive = false;
+		std::string error;
+
+		PyThreadState *thread_state = PyEval_SaveThread();
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (state.engine && state.exports > 0 && Changes_Geometry(state.settings, settings))
+			{
+				views_alive = true;
+			}
+			else
+			{
+				// the image size stays the one of the last frame
+				settings.img_size = state.settings.img_size;
+				try
+				{
+					if (state.engine)
+					{
+						state.engine->Reconfigure(settings);
+						if (settings.device_type != state.settings.device_type)
+						{
+							state.in_img.reset(new gSLICr::UChar4Image(settings.img_size, true, settings.device_type == gSLICr::DEVICE_GPU));
+						}
+					}
+					state.settings = settings;
+				}
+				catch (const std::exception &e)
+				{
+					error = e.what();
+				}
+			}
+		}
+		PyEval_RestoreThread(thread_state);
+
+		if (views_alive)
+		{
+			PyErr_SetString(PyExc_BufferError, "cannot change the superpixel geometry while views of earlier results are alive");
+			return NULL;
+		}
+		if (!error.empty())
+		{
+			PyErr_Format(PyExc_RuntimeError, "reconfiguration failed: %s", error.c_str());
+			return NULL;
+		}
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Engine_Get_Backend(EngineObject *self, void *)
+	{
+		EngineState &state = *self->state;
+		const char *backend = NULL;
+
+		PyThreadState *thread_state = PyEval_SaveThread();
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (state.engine) backend = state.engine->Get_Backend_Name();
+		}
+		PyEval_RestoreThread(thread_state);
+
+		if (backend == NULL) Py_RETURN_NONE;
+		return Py_BuildValue("s", backend);
+	}
+
+	PyMethodDef Engine_Methods[] =
+	{
+		{ "process", (PyCFunction)Engine_Process, METH_VARARGS | METH_KEYWORDS,
+			"process(image, bgr=False) -> (labels, spixels)\n\n"
+			"Segment an HxWx3 uint8 array (RGB, or BGR with bgr=True) without holding the GIL.\n"
+			"labels is an HxW int32 array and spixels a structured array (center, color, id,\n"
+			"no_pixels) indexed by label, both read-only views of engine memory that the next\n"
+			"process() call overwrites: copy them to keep them. With dense_labels the labels\n"
+			"are positions in label_table() instead, so spixels is indexed by\n"
+			"label_table()[labels]. Frames of another size can only be processed once the\n"
+			"views of earlier results are gone." },
+		{ "label_table", (PyCFunction)Engine_Label_Table, METH_NOARGS,
+			"label_table() -> array or None\n\n"
+			"With dense_labels, the spixels index of each label of the last result." },
+		{ "configure", (PyCFunction)Engine_Configure, METH_VARARGS | METH_KEYWORDS,
+			"configure(**settings)\n\n"
+			"Change settings in place, the engine buffers are only rebuilt for a new\n"
+			"superpixel geometry." },
+		{ NULL, NULL, 0, NULL }
+	};
+
+	PyGetSetDef Engine_GetSet[] =
+	{
+		{ const_cast<char*>("backend"), (getter)Engine_Get_Backend, NULL, const_cast<char*>("Backend running the segmentation, None before the first frame"), NULL },
+		{ NULL, NULL, NULL, NULL, NULL }
+	};
+
+	PyMethodDef Module_Methods[] =
+	{
+		{ NULL, NULL, 0, NULL }
+	};
+
+	const char *Engine_Doc =
+		"Engine(**settings)\n\n"
+		"A gSLICr engine, built on the first frame and reused for the next ones. One\n"
+		"engine runs one frame at a time, use an engine per thread to segment in parallel.\n\n"
+		"Settings, as on the command line: num_segs, spixel_size, coh_weight, num_iters,\n"
+		"color_space (XYZ, RGB, CIELAB), seg_method (GIVEN_SIZE, GIVEN_NUM),\n"
+		"enforce_connectivity, pyramid_levels, refine_iters, band_width, band_after_iters,\n"
+		"low_gradient_init, dense_labels, device (CPU, GPU) and cpu_isa.";
+
+	// Fills the types and the spixel dtype, false with a Python error set
+	bool Init_Types()
+	{
+		ViewsType.tp_name = "superpixels._Views";
+		ViewsType.tp_basicsize = sizeof(ViewsObject);
+		ViewsType.tp_flags = Py_TPFLAGS_DEFAULT;
+		ViewsType.tp_dealloc = (destructor)Views_Dealloc;
+		if (PyType_Ready(&ViewsType) < 0) return false;
+
+		EngineType.tp_name = "superpixels.Engine";
+		EngineType.tp_basicsize = sizeof(EngineObject);
+		EngineType.tp_flags = Py_TPFLAGS_DEFAULT;
+		EngineType.tp_doc = Engine_Doc;
+		EngineType.tp_new = Engine_New;
+		EngineType.tp_dealloc = (destructor)Engine_Dealloc;
+		EngineType.tp_methods = Engine_Methods;
+		EngineType.tp_getset = Engine_GetSet;
+		if (PyType_Ready(&EngineType) < 0) return false;
+
+		PyObject *spec = Py_BuildValue("{s:[ssss],s:[(si)(si)ss],s:[nnnn],s:n}",
+			"names", "center", "color", "id", "no_pixels",
+			"formats", "<f4", 2, "<f4", 4, "<i4", "<i4",
+			"offsets", (Py_ssize_t)offsetof(gSLICr::objects::spixel_info, center), (Py_ssize_t)offsetof(gSLICr::objects::spixel_info, color_info),
+				(Py_ssize_t)offsetof(gSLICr::objects::spixel_info, id), (Py_ssize_t)offsetof(gSLICr::objects::spixel_info, no_pixels),
+			"itemsize", (Py_ssize_t)sizeof(gSLICr::objects::spixel_info));
+		if (spec == NULL) return false;
+		int converted = PyArray_DescrConverter(spec, &spixel_descr);
+		Py_DECREF(spec);
+		return converted == NPY_SUCCEED;
+	}
+}
+
+#if PY_MAJOR_VERSION >= 3
+
+static struct PyModuleDef superpixels_module =
+{
+	PyModuleDef_HEAD_INIT, "superpixels", "gSLICr superpixel segmentation on NumPy arrays", -1, Module_Methods
+};
+
+PyMODINIT_FUNC PyInit_superpixels()
+{
+	import_array();
+	if (!Init_Types()) return NULL;
+
+	PyObject *module = PyModule_Create(&superpixels_module);
+	if (module == NULL) return NULL;
+
+	Py_INCREF(&EngineType);
+	PyModule_AddObject(module, "Engine", (PyObject*)&EngineType);
+	return module;
+}
+
+#else
+
+PyMODINIT_FUNC initsuperpixels()
+{
+	import_array();
+	if (!Init_Types()) return;
+
+	PyObject *module = Py_InitModule3("superpixels", Module_Methods, "gSLICr superpixel segmentation on NumPy arrays");
+	if (module == NULL) return;
+
+	Py_INCREF(&EngineType);
+	PyModule_AddObject(module, "Engine", (PyObject*)&EngineType);
+}
+
+#endif
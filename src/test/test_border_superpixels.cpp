@@ -0,0 +1,128 @@
+// Regression test for the superpixels of partial cells at the right and
+// bottom image borders. It runs on the CPU engine, so it needs no GPU.
+
+#include "../gSLICr/gSLICr_Lib/gSLICr.h"
+
+#include <iostream>
+
+namespace
+{
+	struct TestCase
+	{
+		int width;
+		int height;
+		int spixel_size;
+	};
+
+	// Image sizes that leave a partial column and/or row of superpixels
+	const TestCase TEST_CASES[] = {
+		{ 641, 479, 64 },
+		{ 100, 37, 16 },
+		{ 17, 17, 16 },
+		{ 33, 250, 32 },
+		{ 1023, 767, 16 },
+	};
+
+	gSLICr::objects::settings testSettings(const TestCase &test)
+	{
+		gSLICr::objects::settings settings;
+		settings.img_size = gSLICr::Vector2i(test.width, test.height);
+		settings.spixel_size = test.spixel_size;
+		settings.no_segs = 2000;
+		settings.coh_weight = 0.6f;
+		settings.no_iters = 5;
+		settings.color_space = gSLICr::XYZ;
+		settings.seg_method = gSLICr::GIVEN_SIZE;
+		settings.do_enforce_connectivity = true;
+		settings.device_type = gSLICr::DEVICE_CPU;
+		settings.cpu_isa = gSLICr::CPU_ISA_AUTO;
+		return settings;
+	}
+
+	// Smooth gradients with some texture, so the superpixels are not a plain grid
+	void fillImage(gSLICr::UChar4Image *image)
+	{
+		gSLICr::Vector4u *pixels = image->GetData(MEMORYDEVICE_CPU);
+		for (int y = 0; y < image->noDims.y; y++)
+		{
+			for (int x = 0; x < image->noDims.x; x++)
+			{
+				gSLICr::Vector4u &pixel = pixels[x + y * image->noDims.x];
+				pixel.r = (unsigned char)(x * 255 / image->noDims.x);
+				pixel.g = (unsigned char)(y * 255 / image->noDims.y);
+				pixel.b = (unsigned char)((x * 7 + y * 13) % 64 + 96);
+				pixel.a = 255;
+			}
+		}
+	}
+
+	bool runTest(const TestCase &test)
+	{
+		const gSLICr::objects::settings settings = testSettings(test);
+		gSLICr::engines::core_engine engine(settings);
+		gSLICr::UChar4Image in_img(settings.img_size, true, false);
+		fillImage(&in_img);
+		engine.Process_Frame(&in_img);
+
+		bool passed = true;
+		const std::string name = std::to_string(test.width) + "x" + std::to_string(test.height) + "/" + std::to_string(test.spixel_size);
+
+		// One cell per started superpixel in each direction, partial ones included
+		const gSLICr::SpixelMap *spixel_map = engine.Get_Spixel_Map();
+		const gSLICr::Vector2i map_size = spixel_map->noDims;
+		const gSLICr::Vector2i expected_size((test.width + test.spixel_size - 1) / test.spixel_size,
+			(test.height + test.spixel_size - 1) / test.spixel_size);
+		if (map_size != expected_size)
+		{
+			std::cerr << name << ": map is " << map_size.x << "x" << map_size.y
+				<< ", expected " << expected_size.x << "x" << expected_size.y << std::endl;
+			return false;
+		}
+
+		// Every cell of the last column and row has a center inside the image
+		const gSLICr::objects::spixel_info *spixels = spixel_map->GetData(MEMORYDEVICE_CPU);
+		for (int y = 0; y < map_size.y; y++)
+		{
+			for (int x = 0; x < map_size.x; x++)
+			{
+				if (x != map_size.x - 1 && y != map_size.y - 1) { continue; }
+
+				const gSLICr::objects::spixel_info &spixel = spixels[x + y * map_size.x];
+				if (spixel.id != x + y * map_size.x || spixel.no_pixels <= 0
+					|| spixel.center.x < 0 || spixel.center.x >= test.width
+					|| spixel.center.y < 0 || spixel.center.y >= test.height)
+				{
+					std::cerr << name << ": border cell (" << x << ", " << y << ") has no center" << std::endl;
+					passed = false;
+				}
+			}
+		}
+
+		// Every label indexes into the map
+		const gSLICr::IntImage *labels = engine.Get_Seg_Res();
+		const int *label_ptr = labels->GetData(MEMORYDEVICE_CPU);
+		for (int i = 0; i < labels->dataSize; i++)
+		{
+			if (label_ptr[i] < 0 || label_ptr[i] >= (int)spixel_map->dataSize)
+			{
+				std::cerr << name << ": pixel (" << i % test.width << ", " << i / test.width << ") has label "
+					<< label_ptr[i] << " outside of the map" << std::endl;
+				passed = false;
+				break;
+			}
+		}
+
+		std::cout << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+		return passed;
+	}
+}
+
+int main()
+{
+	bool passed = true;
+	for (const TestCase &test : TEST_CASES)
+	{
+		passed = runTest(test) && passed;
+	}
+	return passed ? 0 : 1;
+}
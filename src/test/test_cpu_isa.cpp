@@ -0,0 +1,140 @@
+// Regression test for the instruction-set variants of the CPU kernels: every
+// set the host supports has to give the labels and boundaries of the scalar
+// kernels, bit for bit, for each color space. Sets the host lacks are skipped.
+
+#include "../gSLICr/gSLICr_Lib/gSLICr.h"
+#include "../gSLICr/gSLICr_Lib/engines/gSLICr_cpu_dispatch.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace
+{
+	struct TestCase
+	{
+		int width;
+		int height;
+		int spixel_size;
+	};
+
+	// Widths that leave a partial vector at the end of the rows, for every set
+	const TestCase TEST_CASES[] = {
+		{ 320, 240, 16 },
+		{ 257, 97, 32 },
+		{ 100, 37, 16 },
+		{ 17, 17, 16 },
+		{ 641, 479, 64 },
+	};
+
+	const gSLICr::COLOR_SPACE COLOR_SPACES[] = { gSLICr::CIELAB, gSLICr::XYZ, gSLICr::RGB };
+	const char* const COLOR_SPACE_NAMES[] = { "CIELAB", "XYZ", "RGB" };
+
+	const gSLICr::CPU_ISA VECTOR_ISAS[] = { gSLICr::CPU_ISA_SSE42, gSLICr::CPU_ISA_AVX2, gSLICr::CPU_ISA_AVX512, gSLICr::CPU_ISA_NEON };
+
+	gSLICr::objects::settings testSettings(const TestCase &test, const gSLICr::COLOR_SPACE color_space, const gSLICr::CPU_ISA isa)
+	{
+		gSLICr::objects::settings settings;
+		settings.img_size = gSLICr::Vector2i(test.width, test.height);
+		settings.spixel_size = test.spixel_size;
+		settings.coh_weight = 0.6f;
+		settings.no_iters = 5;
+		settings.color_space = color_space;
+		settings.seg_method = gSLICr::GIVEN_SIZE;
+		settings.do_enforce_connectivity = true;
+		settings.device_type = gSLICr::DEVICE_CPU;
+		settings.cpu_isa = isa;
+		return settings;
+	}
+
+	// Smooth gradients with some texture, so the superpixels are not a plain grid
+	void fillImage(gSLICr::UChar4Image *image)
+	{
+		gSLICr::Vector4u *pixels = image->GetData(MEMORYDEVICE_CPU);
+		for (int y = 0; y < image->noDims.y; y++)
+		{
+			for (int x = 0; x < image->noDims.x; x++)
+			{
+				gSLICr::Vector4u &pixel = pixels[x + y * image->noDims.x];
+				pixel.r = (unsigned char)(x * 255 / image->noDims.x);
+				pixel.g = (unsigned char)(y * 255 / image->noDims.y);
+				pixel.b = (unsigned char)((x * 7 + y * 13) % 64 + 96);
+				pixel.a = 255;
+			}
+		}
+	}
+
+	// Labels and boundary image of one run
+	struct Result
+	{
+		std::unique_ptr<gSLICr::IntImage> labels;
+		std::unique_ptr<gSLICr::UChar4Image> boundaries;
+	};
+
+	Result segment(const gSLICr::objects::settings &settings)
+	{
+		gSLICr::engines::core_engine engine(settings);
+		gSLICr::UChar4Image in_img(settings.img_size, true, false);
+		fillImage(&in_img);
+		engine.Process_Frame(&in_img);
+
+		Result result;
+		result.labels.reset(new gSLICr::IntImage(settings.img_size, true, false));
+		result.labels->SetFrom(engine.Get_Seg_Res(), ORUtils::MemoryBlock<int>::CPU_TO_CPU);
+		result.boundaries.reset(new gSLICr::UChar4Image(settings.img_size, true, false));
+		fillImage(result.boundaries.get());
+		engine.Draw_Segmentation_Result(result.boundaries.get());
+		return result;
+	}
+
+	bool runTest(const TestCase &test, const int color_space_index, const gSLICr::CPU_ISA isa, const Result &expected)
+	{
+		const gSLICr::objects::settings settings = testSettings(test, COLOR_SPACES[color_space_index], isa);
+		const Result result = segment(settings);
+
+		const std::string name = std::string(gSLICr::engines::Get_CPU_ISA_Name(isa)) + " " + COLOR_SPACE_NAMES[color_space_index] + " "
+			+ std::to_string(test.width) + "x" + std::to_string(test.height) + "/" + std::to_string(test.spixel_size);
+		const size_t num_pixels = (size_t)test.width * test.height;
+
+		bool passed = true;
+		if (memcmp(result.labels->GetData(MEMORYDEVICE_CPU), expected.labels->GetData(MEMORYDEVICE_CPU), num_pixels * sizeof(int)) != 0)
+		{
+			std::cerr << name << ": labels differ from the scalar kernels" << std::endl;
+			passed = false;
+		}
+		if (memcmp(result.boundaries->GetData(MEMORYDEVICE_CPU), expected.boundaries->GetData(MEMORYDEVICE_CPU), num_pixels * sizeof(gSLICr::Vector4u)) != 0)
+		{
+			std::cerr << name << ": boundaries differ from the scalar kernels" << std::endl;
+			passed = false;
+		}
+
+		std::cout << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+		return passed;
+	}
+}
+
+int main()
+{
+	bool passed = true;
+	for (const gSLICr::CPU_ISA isa : VECTOR_ISAS)
+	{
+		if (!gSLICr::engines::Is_CPU_ISA_Supported(isa))
+		{
+			std::cout << gSLICr::engines::Get_CPU_ISA_Name(isa) << ": not supported here, skipped" << std::endl;
+		}
+	}
+
+	for (const TestCase &test : TEST_CASES)
+	{
+		for (int c = 0; c < (int)(sizeof(COLOR_SPACES) / sizeof(COLOR_SPACES[0])); c++)
+		{
+			const Result expected = segment(testSettings(test, COLOR_SPACES[c], gSLICr::CPU_ISA_SCALAR));
+			for (const gSLICr::CPU_ISA isa : VECTOR_ISAS)
+			{
+				if (!gSLICr::engines::Is_CPU_ISA_Supported(isa)) { continue; }
+				passed = runTest(test, c, isa, expected) && passed;
+			}
+		}
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+// Regression test for the determinism of the CPU engine: the label map must
+// not depend on the number of OpenMP threads it runs on. Without OpenMP the
+// engine is single threaded and the test only checks that it runs.
+
+#include "../gSLICr/gSLICr_Lib/gSLICr.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	struct TestCase
+	{
+		int width;
+		int height;
+		int spixel_size;
+		int pyramid_levels;
+		int band_after_iters;
+	};
+
+	// Odd sizes so the bands split unevenly, with the coarse-to-fine and band modes
+	const TestCase TEST_CASES[] = {
+		{ 641, 479, 16, 0, 0 },
+		{ 1023, 767, 32, 2, 0 },
+		{ 500, 333, 16, 0, 2 },
+		{ 97, 61, 16, 0, 0 },
+	};
+
+	gSLICr::objects::settings testSettings(const TestCase &test)
+	{
+		gSLICr::objects::settings settings;
+		settings.img_size = gSLICr::Vector2i(test.width, test.height);
+		settings.spixel_size = test.spixel_size;
+		settings.coh_weight = 0.6f;
+		settings.no_iters = 5;
+		settings.color_space = gSLICr::CIELAB;
+		settings.seg_method = gSLICr::GIVEN_SIZE;
+		settings.do_enforce_connectivity = true;
+		settings.pyramid_levels = test.pyramid_levels;
+		settings.band_after_iters = test.band_after_iters;
+		settings.device_type = gSLICr::DEVICE_CPU;
+		settings.cpu_isa = gSLICr::CPU_ISA_AUTO;
+		return settings;
+	}
+
+	// Smooth gradients with some texture, so the superpixels are not a plain grid
+	void fillImage(gSLICr::UChar4Image *image)
+	{
+		gSLICr::Vector4u *pixels = image->GetData(MEMORYDEVICE_CPU);
+		for (int y = 0; y < image->noDims.y; y++)
+		{
+			for (int x = 0; x < image->noDims.x; x++)
+			{
+				gSLICr::Vector4u &pixel = pixels[x + y * image->noDims.x];
+				pixel.r = (unsigned char)(x * 255 / image->noDims.x);
+				pixel.g = (unsigned char)(y * 255 / image->noDims.y);
+				pixel.b = (unsigned char)((x * 7 + y * 13) % 64 + 96);
+				pixel.a = 255;
+			}
+		}
+	}
+
+	std::vector<int> segment(const gSLICr::objects::settings &settings, const int num_threads)
+	{
+#ifdef _OPENMP
+		omp_set_num_threads(num_threads);
+#endif
+		gSLICr::engines::core_engine engine(settings);
+		gSLICr::UChar4Image in_img(settings.img_size, true, false);
+		fillImage(&in_img);
+		engine.Process_Frame(&in_img);
+
+		const int *labels = engine.Get_Seg_Res()->GetData(MEMORYDEVICE_CPU);
+		return std::vector<int>(labels, labels + settings.img_size.x * settings.img_size.y);
+	}
+
+	bool runTest(const TestCase &test, const std::vector<int> &thread_counts)
+	{
+		const gSLICr::objects::settings settings = testSettings(test);
+		const std::string name = std::to_string(test.width) + "x" + std::to_string(test.height) + "/" + std::to_string(test.spixel_size);
+
+		bool passed = true;
+		const std::vector<int> expected = segment(settings, 1);
+		for (const int num_threads : thread_counts)
+		{
+			if (segment(settings, num_threads) != expected)
+			{
+				std::cerr << name << ": labels on " << num_threads << " threads differ from 1 thread" << std::endl;
+				passed = false;
+			}
+		}
+
+		std::cout << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+		return passed;
+	}
+}
+
+int main()
+{
+	// Two threads, an odd count, and every core (oversubscribed if there are few)
+	std::vector<int> thread_counts = { 2, 3 };
+#ifdef _OPENMP
+	thread_counts.push_back(omp_get_num_procs() > 4 ? omp_get_num_procs() : 8);
+#endif
+
+	bool passed = true;
+	for (const TestCase &test : TEST_CASES)
+	{
+		passed = runTest(test, thread_counts) && passed;
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Regression test for letterboxed segmentation: an image padded with a border
+// the engine is told to skip has to get the labels of the unpadded image, and
+// the border none. It runs on the CPU engine, so it needs no GPU.
+
+#include "../gSLICr/gSLICr_Lib/gSLICr.h"
+
+#include <iostream>
+
+namespace
+{
+	struct TestCase
+	{
+		int width;
+		int height;
+		int padded_width;
+		int padded_height;
+		int spixel_size;
+		int pyramid_levels;
+		int band_after_iters;
+	};
+
+	// Padding to the right, at the bottom and both, with partial superpixels
+	// at the content borders and with the coarse-to-fine and band modes
+	const TestCase TEST_CASES[] = {
+		{ 300, 200, 320, 320, 16, 0, 0 },
+		{ 257, 97, 320, 128, 32, 0, 0 },
+		{ 320, 203, 320, 256, 32, 2, 0 },
+		{ 201, 320, 256, 320, 16, 0, 2 },
+		{ 100, 37, 128, 64, 16, 1, 0 },
+	};
+
+	gSLICr::objects::settings testSettings(const TestCase &test)
+	{
+		gSLICr::objects::settings settings;
+		settings.img_size = gSLICr::Vector2i(test.width, test.height);
+		settings.spixel_size = test.spixel_size;
+		settings.coh_weight = 0.6f;
+		settings.no_iters = 5;
+		settings.color_space = gSLICr::XYZ;
+		settings.seg_method = gSLICr::GIVEN_SIZE;
+		settings.do_enforce_connectivity = true;
+		settings.pyramid_levels = test.pyramid_levels;
+		settings.band_after_iters = test.band_after_iters;
+		settings.dense_labels = true;
+		settings.device_type = gSLICr::DEVICE_CPU;
+		settings.cpu_isa = gSLICr::CPU_ISA_AUTO;
+		return settings;
+	}
+
+	// Smooth gradients with some texture over the content, a bright border
+	// that would attract superpixels if it took part in the clustering
+	void fillImage(gSLICr::UChar4Image *image, const int width, const int height)
+	{
+		gSLICr::Vector4u *pixels = image->GetData(MEMORYDEVICE_CPU);
+		for (int y = 0; y < image->noDims.y; y++)
+		{
+			for (int x = 0; x < image->noDims.x; x++)
+			{
+				gSLICr::Vector4u &pixel = pixels[x + y * image->noDims.x];
+				if (x >= width || y >= height)
+				{
+					pixel = gSLICr::Vector4u((unsigned char)255);
+					continue;
+				}
+				pixel.r = (unsigned char)(x * 255 / width);
+				pixel.g = (unsigned char)(y * 255 / height);
+				pixel.b = (unsigned char)((x * 7 + y * 13) % 64 + 96);
+				pixel.a = 255;
+			}
+		}
+	}
+
+	bool runTest(const TestCase &test)
+	{
+		const gSLICr::objects::settings settings = testSettings(test);
+		const std::string name = std::to_string(test.width) + "x" + std::to_string(test.height) + " in "
+			+ std::to_string(test.padded_width) + "x" + std::to_string(test.padded_height) + "/" + std::to_string(test.spixel_size);
+
+		gSLICr::engines::core_engine engine(settings);
+		gSLICr::UChar4Image in_img(settings.img_size, true, false);
+		fillImage(&in_img, test.width, test.height);
+		engine.Process_Frame(&in_img);
+
+		gSLICr::objects::settings padded_settings = settings;
+		padded_settings.img_size = gSLICr::Vector2i(test.padded_width, test.padded_height);
+		gSLICr::engines::core_engine padded_engine(padded_settings);
+		gSLICr::UChar4Image padded_img(padded_settings.img_size, true, false);
+		fillImage(&padded_img, test.width, test.height);
+		padded_engine.Process_Frame(&padded_img, settings.img_size);
+
+		bool passed = true;
+		if (padded_engine.Get_No_Labels() != engine.Get_No_Labels())
+		{
+			std::cerr << name << ": " << padded_engine.Get_No_Labels() << " labels, expected " << engine.Get_No_Labels() << std::endl;
+			passed = false;
+		}
+
+		// Dense labels do not depend on the superpixel map size, so they match pixel for pixel
+		const int *labels = engine.Get_Seg_Res()->GetData(MEMORYDEVICE_CPU);
+		const int *padded_labels = padded_engine.Get_Seg_Res()->GetData(MEMORYDEVICE_CPU);
+		int num_mismatches = 0;
+		int num_border_labels = 0;
+		for (int y = 0; y < test.padded_height; y++)
+		{
+			for (int x = 0; x < test.padded_width; x++)
+			{
+				const int padded_label = padded_labels[x + y * test.padded_width];
+				if (x >= test.width || y >= test.height)
+				{
+					num_border_labels += padded_label != -1;
+				}
+				else
+				{
+					num_mismatches += padded_label != labels[x + y * test.width];
+				}
+			}
+		}
+		if (num_mismatches > 0)
+		{
+			std::cerr << name << ": " << num_mismatches << " pixels labeled differently from the unpadded image" << std::endl;
+			passed = false;
+		}
+		if (num_border_labels > 0)
+		{
+			std::cerr << name << ": " << num_border_labels << " border pixels have a label" << std::endl;
+			passed = false;
+		}
+
+		std::cout << name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+		return passed;
+	}
+}
+
+int main()
+{
+	bool passed = true;
+	for (const TestCase &test : TEST_CASES)
+	{
+		passed = runTest(test) && passed;
+	}
+	return passed ? 0 : 1;
+}